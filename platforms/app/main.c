@@ -5,6 +5,10 @@
 //  All rights reserved.
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE      // for fileno (), used to map the wasm files
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -13,6 +17,14 @@
 #include "wasm3.h"
 #include "m3_api_libc.h"
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#define MAP_WASM_FILES
+#define MAX_WASM_FILE_SIZE  (1024*1024*1024)    // mapped, rather than read into memory
+#else
+#define MAX_WASM_FILE_SIZE  (64*1024*1024)
+#endif
+
 #if defined(d_m3HasWASI) || defined(d_m3HasMetaWASI) || defined(d_m3HasUVWASI)
 #include "m3_api_wasi.h"
 #define LINK_WASI
@@ -40,10 +52,24 @@
 
 static IM3Environment env;
 static IM3Runtime runtime;
+static M3MemoryBacking memoryBacking = c_m3MemoryBacking_default;
+static unsigned compileThreads = 0;     // one per processor
 
 static u8* wasm_bins[MAX_MODULES];
+static u32 wasm_bins_mapped[MAX_MODULES];   // the size of a mmapped binary; 0 if it's malloc'd
 static int wasm_bins_qty = 0;
 
+static void free_wasm_bin (u8* wasm, u32 mapped)
+{
+#if defined(MAP_WASM_FILES)
+    if (mapped) {
+        munmap (wasm, mapped);
+        return;
+    }
+#endif
+    free (wasm);
+}
+
 #if defined(GAS_LIMIT)
 
 static int64_t initial_gas = GAS_FACTOR * GAS_LIMIT;
@@ -107,6 +133,35 @@ const char* modname_from_fn(const char* fn)
     return fn;
 }
 
+// a module read from a pipe is parsed, and its functions compiled, as it arrives
+M3Result repl_load_stream  (FILE* f, const char* fn)
+{
+    M3Result result = m3Err_none;
+    IM3ModuleStream stream = NULL;
+    IM3Module module = NULL;
+
+    result = m3_NewModuleStream (runtime, &stream, 0);
+    if (result) return result;
+
+    u8 chunk[4096];
+    size_t n;
+    while (!result && (n = fread (chunk, 1, sizeof(chunk), f)) > 0) {
+        result = m3_AppendModuleStream (stream, chunk, n);
+    }
+    if (!result && ferror (f)) {
+        result = "cannot read file";
+    }
+    if (!result) {
+        result = m3_FinishModuleStream (stream, &module);
+    }
+    m3_FreeModuleStream (stream);
+    if (result) return result;
+
+    m3_SetModuleName(module, modname_from_fn(fn));
+
+    return link_all (module);
+}
+
 M3Result repl_load  (const char* fn)
 {
     M3Result result = m3Err_none;
@@ -114,23 +169,38 @@ M3Result repl_load  (const char* fn)
 
     u8* wasm = NULL;
     u32 fsize = 0;
+    u32 mapped = 0;
 
     FILE* f = fopen (fn, "rb");
     if (!f) {
         return "cannot open file";
     }
-    fseek (f, 0, SEEK_END);
+    if (fseek (f, 0, SEEK_END) != 0) {
+        result = repl_load_stream (f, fn);
+        fclose (f);
+        return result;
+    }
     fsize = ftell(f);
     fseek (f, 0, SEEK_SET);
 
     if (fsize < 8) {
         result = "file is too small";
         goto on_error;
-    } else if (fsize > 64*1024*1024) {
+    } else if (fsize > MAX_WASM_FILE_SIZE) {
         result = "file is too big";
         goto on_error;
     }
 
+#if defined(MAP_WASM_FILES)
+    // mapped rather than read, so that the data segments can be mapped into the memory from the file
+    wasm = (u8*) mmap (NULL, fsize, PROT_READ, MAP_PRIVATE, fileno (f), 0);
+    if (wasm == MAP_FAILED) {
+        wasm = NULL;
+        result = "cannot map file";
+        goto on_error;
+    }
+    mapped = fsize;
+#else
     wasm = (u8*) malloc(fsize);
     if (!wasm) {
         result = "cannot allocate memory for wasm binary";
@@ -141,21 +211,28 @@ M3Result repl_load  (const char* fn)
         result = "cannot read file";
         goto on_error;
     }
-    fclose (f);
-    f = NULL;
+#endif
 
     result = m3_ParseModule (env, &module, wasm, fsize);
     if (result) goto on_error;
 
+#if defined(MAP_WASM_FILES)
+    m3_SetModuleFile (module, fileno (f), 0);
+#endif
+
     result = m3_LoadModule (runtime, module);
     if (result) goto on_error;
 
+    fclose (f);
+    f = NULL;
+
     m3_SetModuleName(module, modname_from_fn(fn));
 
     result = link_all (module);
     if (result) goto on_error;
 
     if (wasm_bins_qty < MAX_MODULES) {
+        wasm_bins_mapped[wasm_bins_qty] = mapped;
         wasm_bins[wasm_bins_qty++] = wasm;
     }
 
@@ -163,7 +240,7 @@ M3Result repl_load  (const char* fn)
 
 on_error:
     m3_FreeModule(module);
-    if (wasm) free(wasm);
+    if (wasm) free_wasm_bin(wasm, mapped);
     if (f) fclose(f);
 
     return result;
@@ -432,7 +509,7 @@ M3Result repl_global_set  (const char* name, const char* value)
 
 M3Result repl_compile  ()
 {
-    return m3_CompileModule(runtime->modules);
+    return m3_CompileModuleInParallel(runtime->modules, compileThreads);
 }
 
 M3Result repl_dump  ()
@@ -452,6 +529,33 @@ M3Result repl_dump  ()
     return m3Err_none;
 }
 
+M3Result repl_preinit  (const char* init_func, const char* out_fn)
+{
+    uint8_t* wasm = NULL;
+    uint32_t size = 0;
+
+    M3Result result = m3_PreinitializeModule (runtime->modules, init_func, &wasm, &size);
+    if (result) return result;
+
+    FILE* f = fopen (out_fn, "wb");
+    if (!f) {
+        result = "cannot open file";
+    } else {
+        if (fwrite (wasm, 1, size, f) != size) {
+            result = "cannot write file";
+        }
+        fclose (f);
+    }
+    free (wasm);
+
+    if (!result) {
+        fprintf(stderr, "Wrote %s: %u bytes, without the start function", out_fn, size);
+        if (init_func) fprintf(stderr, " and the '%s' export", init_func);
+        fprintf(stderr, "\n");
+    }
+    return result;
+}
+
 void repl_free  ()
 {
     if (runtime) {
@@ -460,7 +564,7 @@ void repl_free  ()
     }
 
     for (int i = 0; i < wasm_bins_qty; i++) {
-        free (wasm_bins[i]);
+        free_wasm_bin (wasm_bins[i], wasm_bins_mapped[i]);
         wasm_bins[i] = NULL;
     }
 }
@@ -472,7 +576,7 @@ M3Result repl_init  (unsigned stack)
     if (runtime == NULL) {
         return "m3_NewRuntime failed";
     }
-    return m3Err_none;
+    return m3_SetMemoryBacking (runtime, memoryBacking);
 }
 
 static
@@ -549,8 +653,14 @@ void print_usage() {
     puts("  --func <function>     function to run       default: _start");
     puts("  --stack-size <size>   stack size in bytes   default: 64KB");
     puts("  --compile             disable lazy compilation");
+    puts("  --compile-threads <n> compile on n threads  default: one per processor");
+    puts("  --cache-dir <dir>     keep compiled code in <dir> for the next run");
     puts("  --dump-on-trap        dump wasm memory");
     puts("  --gas-limit           set gas limit");
+    puts("  --memory-backing <b>  default, thp, hugetlb or prefault");
+    puts("  --preinit <out.wasm>  run the start function and --func (or _initialize),");
+    puts("                        and write the module with their results to <out.wasm>,");
+    puts("                        without the start function and that export");
 }
 
 #define ARGV_SHIFT()  { i_argc--; i_argv++; }
@@ -567,6 +677,8 @@ int  main  (int i_argc, const char* i_argv[])
     bool argCompile = false;
     const char* argFile = NULL;
     const char* argFunc = "_start";
+    bool argFuncSet = false;
+    const char* argPreinit = NULL;
     unsigned argStackSize = 64*1024;
 
 //    m3_PrintM3Info ();
@@ -591,6 +703,17 @@ int  main  (int i_argc, const char* i_argv[])
             argDumpOnTrap = true;
         } else if (!strcmp("--compile", arg)) {
             argCompile = true;
+        } else if (!strcmp("--compile-threads", arg)) {
+            const char* tmp = "0";
+            ARGV_SET(tmp);
+            compileThreads = atol(tmp);
+            argCompile = true;
+        } else if (!strcmp("--cache-dir", arg)) {
+            const char* argCacheDir = NULL;
+            ARGV_SET(argCacheDir);
+            result = m3_SetCodeCacheDirectory (env, argCacheDir);
+            if (result) FATAL("m3_SetCodeCacheDirectory: %s", result);
+            argCompile = true;
         } else if (!strcmp("--stack-size", arg)) {
             const char* tmp = "65536";
             ARGV_SET(tmp);
@@ -599,12 +722,27 @@ int  main  (int i_argc, const char* i_argv[])
             const char* tmp = "0";
             ARGV_SET(tmp);
             initial_gas = current_gas = GAS_FACTOR * atol(tmp);
+        } else if (!strcmp("--memory-backing", arg)) {
+            const char* tmp = "default";
+            ARGV_SET(tmp);
+            if      (!strcmp("thp", tmp))       memoryBacking = c_m3MemoryBacking_thp;
+            else if (!strcmp("hugetlb", tmp))   memoryBacking = c_m3MemoryBacking_hugeTLB;
+            else if (!strcmp("prefault", tmp))  memoryBacking = c_m3MemoryBacking_prefault;
+            else if (!strcmp("default", tmp))   memoryBacking = c_m3MemoryBacking_default;
+            else {
+                fprintf(stderr, "Error: unknown memory backing '%s'\n", tmp);
+                print_usage();
+                return 1;
+            }
         } else if (!strcmp("--dir", arg)) {
             const char* argDir;
             ARGV_SET(argDir);
             (void)argDir;
         } else if (!strcmp("--func", arg) or !strcmp("-f", arg)) {
             ARGV_SET(argFunc);
+            argFuncSet = true;
+        } else if (!strcmp("--preinit", arg)) {
+            ARGV_SET(argPreinit);
         }
     }
 
@@ -628,6 +766,18 @@ int  main  (int i_argc, const char* i_argv[])
             repl_compile();
         }
 
+        if (argPreinit) {
+            IM3Function func;
+            const char* initFunc = argFuncSet ? argFunc : "_initialize";
+            if (!argFuncSet and m3_FindFunction (&func, runtime, initFunc)) {
+                initFunc = NULL;
+            }
+            result = repl_preinit(initFunc, argPreinit);
+            if (result) FATAL("repl_preinit: %s", result);
+            repl_free();
+            return 0;
+        }
+
         if (argFunc and not argRepl) {
             if (!strcmp(argFunc, "_start")) {
                 // When passing args to WASI, include wasm filename as argv[0]
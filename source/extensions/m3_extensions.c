@@ -20,6 +20,7 @@ IM3Module  m3_NewModule  (IM3Environment i_environment)
     {
         module->name = ".unnamed";
         module->startFunction = -1;
+        module->fileDescriptor = -1;
         module->environment = i_environment;
 
         module->wasmStart = NULL;
@@ -41,7 +42,6 @@ M3Result  m3_InjectFunction  (IM3Module                 i_module,
 
     IM3Function function = NULL;
     IM3FuncType ftype = NULL;
-_   (SignatureToFuncType (& ftype, i_signature));
 
     i32 index = * io_functionIndex;
 
@@ -49,12 +49,16 @@ _   (SignatureToFuncType (& ftype, i_signature));
     bytes_t end = i_wasmBytes + 5;
 
     u32 size;
+    size_t numBytes;
+
+_   (SignatureToFuncType (& ftype, i_signature));
+
 _   (ReadLEB_u32 (& size, & bytes, end));
     end = bytes + size;
 
     if (index >= 0)
     {
-        _throwif ("function index out of bounds", index >= i_module->numFunctions);
+        _throwif ("function index out of bounds", (u32) index >= i_module->numFunctions);
 
         function = & i_module->functions [index];
 
@@ -85,7 +89,7 @@ _       (Module_AddFunction (i_module, funcTypeIndex, NULL));
     if (function->ownsWasmCode)
         m3_Free (function->wasm);
 
-    size_t numBytes = end - i_wasmBytes;
+    numBytes = end - i_wasmBytes;
     function->wasm = m3_CopyMem (i_wasmBytes, numBytes);
     _throwifnull (function->wasm);
 
@@ -730,6 +730,7 @@ m3ApiRawFunction(m3_wasi_generic_fd_pread)
         iovs[i].buf = m3ApiOffsetToPtr(m3ApiReadMem32(&wasi_iovs[i].buf));
         iovs[i].buf_len = m3ApiReadMem32(&wasi_iovs[i].buf_len);
         m3ApiCheckMem(iovs[i].buf,     iovs[i].buf_len);
+        m3_MarkMemoryDirty(runtime, iovs[i].buf, iovs[i].buf_len);
         //fprintf(stderr, "> fd_pread fd:%d iov%d.len:%d\n", fd, i, iovs[i].buf_len);
     }
 
@@ -768,6 +769,7 @@ m3ApiRawFunction(m3_wasi_generic_fd_read)
         iovs[i].buf = m3ApiOffsetToPtr(m3ApiReadMem32(&wasi_iovs[i].buf));
         iovs[i].buf_len = m3ApiReadMem32(&wasi_iovs[i].buf_len);
         m3ApiCheckMem(iovs[i].buf,     iovs[i].buf_len);
+        m3_MarkMemoryDirty(runtime, iovs[i].buf, iovs[i].buf_len);
         //fprintf(stderr, "> fd_read fd:%d iov%d.len:%d\n", fd, i, iovs[i].buf_len);
     }
 
@@ -903,6 +905,7 @@ m3ApiRawFunction(m3_wasi_generic_random_get)
     m3ApiGetArg      (uvwasi_size_t        , buf_len)
 
     m3ApiCheckMem(buf, buf_len);
+    m3_MarkMemoryDirty(runtime, buf, buf_len);
 
     uvwasi_errno_t ret = uvwasi_random_get(&uvwasi, buf, buf_len);
 
@@ -582,6 +582,9 @@ m3ApiRawFunction(m3_wasi_generic_fd_read)
     if (mem_check != m3Err_none) {
         return mem_check;
     }
+    for (__wasi_size_t i = 0; i < iovs_len; i++) {
+        m3_MarkMemoryDirty(runtime, iovs[i].iov_base, iovs[i].iov_len);
+    }
 
     ssize_t ret = readv(fd, iovs, iovs_len);
     if (ret < 0) { m3ApiReturn(errno_to_wasi(errno)); }
@@ -594,6 +597,7 @@ m3ApiRawFunction(m3_wasi_generic_fd_read)
         size_t len = m3ApiReadMem32(&wasi_iovs[i].buf_len);
         if (len == 0) continue;
         m3ApiCheckMem(addr,     len);
+        m3_MarkMemoryDirty(runtime, addr, len);
         int ret = read (fd, addr, len);
         if (ret < 0) m3ApiReturn(errno_to_wasi(errno));
         res += ret;
@@ -676,6 +680,7 @@ m3ApiRawFunction(m3_wasi_generic_random_get)
     m3ApiGetArg      (__wasi_size_t        , buf_len)
 
     m3ApiCheckMem(buf, buf_len);
+    m3_MarkMemoryDirty(runtime, buf, buf_len);
 
     while (1) {
         ssize_t retlen = 0;
@@ -765,6 +770,33 @@ m3ApiRawFunction(m3_wasi_generic_proc_exit)
     m3ApiTrap(m3Err_trapExit);
 }
 
+/*
+ * Extensions, imported from "wasm3"
+ */
+
+// fd_pread without the copy: the file range is mapped copy-on-write at buf, and changes to it stay in the memory.
+// buf and offset must be multiples of the host page size (64 KiB always is); anything that can't be mapped returns
+// NOTSUP, and the guest falls back to fd_pread. See m3_MapFileIntoMemory
+m3ApiRawFunction(m3_wasm3_fd_mmap)
+{
+    m3ApiReturnType  (uint32_t)
+    m3ApiGetArg      (__wasi_fd_t          , fd)
+    m3ApiGetArgMem   (uint8_t *            , buf)
+    m3ApiGetArg      (__wasi_size_t        , buf_len)
+    m3ApiGetArg      (__wasi_filesize_t    , offset)
+
+    m3ApiCheckMem(buf, buf_len);
+
+    if ((int32_t) fd < 0) m3ApiReturn(__WASI_ERRNO_BADF);
+
+    errno = 0;
+    if (m3_MapFileIntoMemory(runtime, m3ApiPtrToOffset(buf), buf_len, fd, offset) != m3Err_none) {
+        m3ApiReturn(errno ? errno_to_wasi(errno) : __WASI_ERRNO_NOTSUP);
+    }
+
+    m3ApiReturn(__WASI_ERRNO_SUCCESS);
+}
+
 
 static
 M3Result SuppressLookupFailure(M3Result i_result)
@@ -866,6 +898,8 @@ _       (SuppressLookupFailure (m3_LinkRawFunction (module, wasi, "random_get",
 //_     (SuppressLookupFailure (m3_LinkRawFunction (module, wasi, "sock_shutdown",        "i(ii)",            )));
     }
 
+_   (SuppressLookupFailure (m3_LinkRawFunction (module, "wasm3", "fd_mmap", "i(i*iI)", &m3_wasm3_fd_mmap)));
+
 _catch:
     return result;
 }
@@ -120,6 +120,28 @@ _   (SignatureToFuncType (& ftype, i_linkingSignature));
 }
 
 
+static
+bool  MatchesImport  (IM3Function i_function, ccstr_t i_moduleName, ccstr_t i_functionName)
+{
+    return strcmp (i_function->import.fieldUtf8, i_functionName) == 0 and
+          (strcmp (i_moduleName, "*") == 0 or strcmp (i_function->import.moduleUtf8, i_moduleName) == 0);
+}
+
+
+static
+M3Result  LinkFunction  (IM3Module io_module, IM3Function io_function, ccstr_t i_signature, voidptr_t i_function, voidptr_t i_userdata)
+{
+    M3Result result = m3Err_none;
+
+    if (i_signature) {
+_       (ValidateSignature (io_function, i_signature));
+    }
+_   (CompileRawFunction (io_module, io_function, i_function, i_userdata));
+
+    _catch: return result;
+}
+
+
 M3Result  FindAndLinkFunction      (IM3Module       io_module,
                                     ccstr_t         i_moduleName,
                                     ccstr_t         i_functionName,
@@ -130,23 +152,20 @@ M3Result  FindAndLinkFunction      (IM3Module       io_module,
 _try {
     _throwif(m3Err_moduleNotLinked, !io_module->runtime);
 
-    const bool wildcardModule = (strcmp (i_moduleName, "*") == 0);
-
     result = m3Err_functionLookupFailed;
 
-    for (u32 i = 0; i < io_module->numFunctions; ++i)
-    {
-        const IM3Function f = & io_module->functions [i];
+    const M3NameIndex * imports = & io_module->imports;
 
-        if (f->import.moduleUtf8 and f->import.fieldUtf8)
+    // every import of the name, in order
+    if (imports->slots)
+    {
+        for (u32 s = HashName (i_functionName) & imports->mask; imports->slots [s]; s = (s + 1) & imports->mask)
         {
-            if (strcmp (f->import.fieldUtf8, i_functionName) == 0 and
-               (wildcardModule or strcmp (f->import.moduleUtf8, i_moduleName) == 0))
+            const IM3Function f = & io_module->functions [imports->slots [s] - 1];
+
+            if (MatchesImport (f, i_moduleName, i_functionName))
             {
-                if (i_signature) {
-_                   (ValidateSignature (f, i_signature));
-                }
-_               (CompileRawFunction (io_module, f, i_function, i_userdata));
+_               (LinkFunction (io_module, f, i_signature, i_function, i_userdata));
             }
         }
     }
@@ -173,3 +192,45 @@ M3Result  m3_LinkRawFunction  (IM3Module            io_module,
     return FindAndLinkFunction (io_module, i_moduleName, i_functionName, i_signature, (voidptr_t)i_function, NULL);
 }
 
+
+M3Result  m3_LinkRawFunctions  (IM3Module io_module, const M3RawImport * i_imports, uint32_t i_numImports)
+{
+    M3NameIndex entries = { NULL, 0 };
+_try {
+    _throwif(m3Err_moduleNotLinked, !io_module->runtime);
+
+_   (NameIndex_Init (& entries, i_numImports));
+
+    for (u32 i = 0; i < i_numImports; ++i)
+        NameIndex_Insert (& entries, i_imports [i].functionName, i);
+
+    for (u32 i = 0; entries.slots and i < io_module->numFuncImports; ++i)
+    {
+        const IM3Function f = & io_module->functions [i];
+
+        if (not (f->import.moduleUtf8 and f->import.fieldUtf8))
+            continue;
+
+        // the last entry that matches, as linking the entries one by one would leave it
+        const M3RawImport * link = NULL;
+
+        for (u32 s = HashName (f->import.fieldUtf8) & entries.mask; entries.slots [s]; s = (s + 1) & entries.mask)
+        {
+            const M3RawImport * entry = & i_imports [entries.slots [s] - 1];
+
+            if (MatchesImport (f, entry->moduleName, entry->functionName))
+                link = entry;
+        }
+
+        if (link)
+        {
+_           (LinkFunction (io_module, f, link->signature, (voidptr_t) link->function, link->userdata));
+        }
+    }
+
+} _catch:
+
+    NameIndex_Release (& entries);
+
+    return result;
+}
@@ -0,0 +1,947 @@
+//
+//  m3_cache.c
+//
+//  Compiled code written out to files, and read back in instead of compiling; see m3_SetCodeCacheDirectory () in wasm3.h
+//
+
+#include "m3_env.h"
+#include "m3_exception.h"
+
+#if d_m3CodeCache
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a file holds a module's code pages as they were compiled, and its functions' compiled state. the words that hold
+// ops and pointers are rewritten on the way back in, from the relocations; the rest of the code is position independent.
+// the files are trusted like the engine itself: the hashes only catch stale and damaged ones
+
+#define d_m3CacheMagic                  0x6863336d      // "m3ch"
+#define d_m3CacheVersion                1
+
+enum
+{
+    c_cacheOp,                  // value: the op's index; see GetOpIndex ()
+    c_cacheCode,                // value: the line it points to
+    c_cacheFunction,            // value: the function's index
+    c_cacheImportCall,          // value: the import's index. its host function was called directly; now op_Compile links it
+    c_cacheModule,
+    c_cacheFuncType,            // value: the index in the module's types
+    c_cacheGlobal,              // value: the global's index
+    c_cacheNull,
+};
+
+typedef struct M3CacheHeader
+{
+    u32                     magic;
+    u32                     version;
+
+    u64                     moduleHash;         // of the wasm
+    u64                     buildHash;          // of the engine; see GetBuildHash ()
+    u64                     contentHash;        // of everything after the header
+
+    u32                     numFunctions;
+    u32                     numPages;
+    u32                     numLines;
+    u32                     numRelocations;
+    u32                     numFunctionRecords;
+    u32                     numMappings;
+}
+M3CacheHeader;
+
+// then: the pages' line counts (u32), their lines, the relocations, the function records each followed by its
+// constants and local init ranges, and the backtrace mappings
+
+typedef struct M3CacheRelocation
+{
+    u32                     line;
+    u32                     kind;
+    u32                     value;
+}
+M3CacheRelocation;
+
+typedef struct M3CacheFunction
+{
+    u32                     index;
+    u32                     line;               // its op_Entry
+
+    u16                     maxStackSlots;
+    u16                     numRetSlots;
+    u16                     numRetAndArgSlots;
+    u16                     numLocals;
+    u16                     numLocalBytes;
+    u16                     numConstantBytes;
+    u16                     numLocalInitRanges;
+    u16                     unused;
+}
+M3CacheFunction;
+
+typedef struct M3CacheMapping
+{
+    u32                     line;
+    u32                     moduleOffset;
+}
+M3CacheMapping;
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  hashing
+//---------------------------------------------------------------------------------------------------------------------------------
+
+// FNV-1a, on four words at a time rather than a byte: the files are hashed whole every time they're read
+static const u64 c_hashStart = 14695981039346656037ULL;
+
+static
+u64  Hash  (u64 i_hash, const void * i_bytes, size_t i_numBytes)
+{
+    const u8 * bytes = (const u8 *) i_bytes;
+    const u64 prime = 1099511628211ULL;
+
+    u64 lanes [4] = { i_hash, i_hash + 1, i_hash + 2, i_hash + 3 };
+
+    for (; i_numBytes >= sizeof (lanes); i_numBytes -= sizeof (lanes), bytes += sizeof (lanes))
+    {
+        u64 words [4];
+        memcpy (words, bytes, sizeof (words));
+
+        for (u32 i = 0; i < 4; ++i)
+        {
+            lanes [i] = (lanes [i] ^ words [i]) * prime;
+            lanes [i] ^= lanes [i] >> 29;
+        }
+    }
+
+    i_hash = lanes [0];
+    for (u32 i = 1; i < 4; ++i)
+        i_hash = (i_hash ^ lanes [i]) * prime;
+
+    while (i_numBytes--)
+        i_hash = (i_hash ^ * bytes++) * prime;
+
+    return i_hash;
+}
+
+
+static u64                  s_buildHash;
+static pthread_once_t       s_buildHashed = PTHREAD_ONCE_INIT;
+
+// another build of the engine places its ops differently, and one with other settings emits different code
+static
+void  HashBuild  (void)
+{
+    cstr_t stamp = GetCompilerBuildStamp ();
+    u32 settings [] = { sizeof (code_t), sizeof (m3slot_t), d_m3RecordBacktraces, GetNumOps () };
+
+    u64 hash = Hash (c_hashStart, stamp, strlen (stamp));
+    hash = Hash (hash, settings, sizeof (settings));
+
+    uintptr_t first = (uintptr_t) GetOpAtIndex (1);
+
+    for (u32 i = 1; i < GetNumOps (); ++i)
+    {
+        u64 offset = (uintptr_t) GetOpAtIndex (i) - first;
+        hash = Hash (hash, & offset, sizeof (offset));
+    }
+
+    s_buildHash = hash;
+}
+
+
+static
+u64  GetBuildHash  (void)
+{
+    pthread_once (& s_buildHashed, HashBuild);
+    return s_buildHash;
+}
+
+
+static
+M3Result  GetCachePath  (char * o_path, size_t i_size, IM3Module i_module, u64 * o_moduleHash)
+{
+    * o_moduleHash = Hash (c_hashStart, i_module->wasmStart, i_module->wasmEnd - i_module->wasmStart);
+
+    int length = snprintf (o_path, i_size, "%s/%016llx-%016llx.m3cache", i_module->environment->codeCacheDirectory,
+                           (unsigned long long) * o_moduleHash, (unsigned long long) GetBuildHash ());
+
+    return (length > 0 and (size_t) length < i_size) ? m3Err_none : "code cache path too long";
+}
+
+
+// only a module none of whose code has been compiled yet, nor will be shared by instances
+static
+bool  IsUncompiled  (IM3Module i_module)
+{
+    if (not i_module->environment->codeCacheDirectory or not i_module->runtime or i_module->compiled)
+        return false;
+
+    u32 numBodies = 0;
+
+    for (u32 i = 0; i < i_module->numFunctions; ++i)
+    {
+        IM3Function function = & i_module->functions [i];
+
+        if (function->wasm)
+        {
+            if (function->compiled)
+                return false;
+
+            ++numBodies;
+        }
+    }
+
+    return numBodies > 0;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  writing
+//---------------------------------------------------------------------------------------------------------------------------------
+
+typedef struct M3CachePages
+{
+    u32                     numPages;
+    IM3CodePage *           pages;              // by address
+    u32 *                   firstLines;         // of each page in the file
+    u32                     numLines;
+}
+M3CachePages;
+
+
+static
+int  ComparePages  (const void * i_a, const void * i_b)
+{
+    uintptr_t a = (uintptr_t) * (const IM3CodePage *) i_a;
+    uintptr_t b = (uintptr_t) * (const IM3CodePage *) i_b;
+
+    return (a > b) - (a < b);
+}
+
+
+static
+int  CompareRelocations  (const void * i_a, const void * i_b)
+{
+    u32 a = ((const M3CacheRelocation *) i_a)->line;
+    u32 b = ((const M3CacheRelocation *) i_b)->line;
+
+    return (a > b) - (a < b);
+}
+
+
+static
+bool  FindLine  (M3CachePages * i_pages, const void * i_pc, u32 * o_line)
+{
+    uintptr_t pc = (uintptr_t) i_pc;
+    u32 first = 0, last = i_pages->numPages;
+
+    while (first < last)
+    {
+        u32 middle = (first + last) / 2;
+        IM3CodePage page = i_pages->pages [middle];
+
+        if (pc < (uintptr_t) GetPageStartPC (page))
+            last = middle;
+        else if (pc >= (uintptr_t) GetPagePC (page))
+            first = middle + 1;
+        else
+        {
+            uintptr_t offset = pc - (uintptr_t) GetPageStartPC (page);
+
+            if (offset % sizeof (code_t))
+                return false;
+
+            * o_line = i_pages->firstLines [middle] + (u32) (offset / sizeof (code_t));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static
+M3Result  ClassifyPointer  (M3CacheRelocation * o_relocation, IM3Module i_module, M3CachePages * i_pages, pc_t i_word)
+{
+    const u8 * pointer = * (const u8 **) i_word;
+
+    const u8 * functions = (const u8 *) i_module->functions;
+    const u8 * globals = (const u8 *) i_module->globals;
+
+    if (not pointer)
+    {
+        o_relocation->kind = c_cacheNull;
+    }
+    else if (FindLine (i_pages, pointer, & o_relocation->value))
+    {
+        o_relocation->kind = c_cacheCode;
+    }
+    else if (pointer >= functions and pointer < functions + i_module->numFunctions * sizeof (M3Function)
+             and (pointer - functions) % sizeof (M3Function) == 0)
+    {
+        o_relocation->kind = c_cacheFunction;
+        o_relocation->value = (u32) ((pointer - functions) / sizeof (M3Function));
+    }
+    else if (pointer == (const u8 *) i_module)
+    {
+        o_relocation->kind = c_cacheModule;
+    }
+    else if (pointer >= globals and pointer < globals + i_module->numGlobals * sizeof (M3Global)
+             and (pointer - globals) % sizeof (M3Global) == offsetof (M3Global, intValue))
+    {
+        o_relocation->kind = c_cacheGlobal;
+        o_relocation->value = (u32) ((pointer - globals) / sizeof (M3Global));
+    }
+    else
+    {
+        for (u32 i = 0; i < i_module->numFuncTypes; ++i)
+        {
+            if (pointer == (const u8 *) i_module->funcTypes [i])
+            {
+                o_relocation->kind = c_cacheFuncType;
+                o_relocation->value = i;
+                return m3Err_none;
+            }
+        }
+
+        // an import's host function, which only an op_Call is given
+        for (u32 i = 0; i < i_module->numFunctions; ++i)
+        {
+            IM3Function function = & i_module->functions [i];
+
+            if (not function->wasm and pointer == (const u8 *) function->compiled)
+            {
+                o_relocation->kind = c_cacheImportCall;
+                o_relocation->value = i;
+                return m3Err_none;
+            }
+        }
+
+        return "unknown pointer in the code";
+    }
+
+    return m3Err_none;
+}
+
+
+typedef struct M3CacheOutput
+{
+    u8 *                    bytes;
+    size_t                  size;
+    size_t                  capacity;
+}
+M3CacheOutput;
+
+
+static
+M3Result  Write  (M3CacheOutput * io_output, const void * i_bytes, size_t i_numBytes)
+{
+    if (io_output->size + i_numBytes > io_output->capacity)
+    {
+        size_t capacity = M3_MAX (io_output->capacity * 2, io_output->size + i_numBytes + 4096);
+
+        u8 * bytes = m3_ReallocArray (u8, io_output->bytes, capacity, io_output->capacity);
+        if (not bytes)
+            return m3Err_mallocFailed;
+
+        io_output->bytes = bytes;
+        io_output->capacity = capacity;
+    }
+
+    memcpy (io_output->bytes + io_output->size, i_bytes, i_numBytes);
+    io_output->size += i_numBytes;
+
+    return m3Err_none;
+}
+
+
+// everything after the header, which is hashed before it's written
+static
+M3Result  WriteBody  (M3CacheOutput * io_output, IM3Module i_module, M3CachePages * i_pages,
+                      M3CacheRelocation * i_relocations, u32 i_numRelocations)
+{
+    M3Result result = m3Err_none;
+
+    for (u32 i = 0; i < i_pages->numPages; ++i)
+    {
+        u32 numLines = i_pages->pages [i]->info.lineIndex;
+_       (Write (io_output, & numLines, sizeof (numLines)));
+    }
+
+    for (u32 i = 0; i < i_pages->numPages; ++i)
+_       (Write (io_output, GetPageStartPC (i_pages->pages [i]), i_pages->pages [i]->info.lineIndex * sizeof (code_t)));
+
+_   (Write (io_output, i_relocations, i_numRelocations * sizeof (M3CacheRelocation)));
+
+    for (u32 i = 0; i < i_module->numFunctions; ++i)
+    {
+        IM3Function function = & i_module->functions [i];
+
+        if (function->wasm)
+        {
+            M3CacheFunction record = { i, 0, function->maxStackSlots, function->numRetSlots, function->numRetAndArgSlots, function->numLocals,
+                                       function->numLocalBytes, function->numConstantBytes, function->numLocalInitRanges, 0 };
+
+            _throwif ("function compiled elsewhere", not FindLine (i_pages, function->compiled, & record.line));
+
+_           (Write (io_output, & record, sizeof (record)));
+_           (Write (io_output, function->constants, function->numConstantBytes));
+_           (Write (io_output, function->localInitRanges, function->numLocalInitRanges * 2 * sizeof (u16)));
+        }
+    }
+
+# if d_m3RecordBacktraces
+    for (u32 i = 0; i < i_pages->numPages; ++i)
+    {
+        M3CodeMappingPage * mapping = i_pages->pages [i]->info.mapping;
+
+        for (u32 e = 0; e < mapping->size; ++e)
+        {
+            M3CacheMapping entry = { i_pages->firstLines [i] + mapping->entries [e].pcOffset, mapping->entries [e].moduleOffset };
+_           (Write (io_output, & entry, sizeof (entry)));
+        }
+    }
+# endif
+
+    _catch: return result;
+}
+
+
+static
+M3Result  WriteCodeCache  (IM3Module i_module, IM3Runtime i_codeRuntime, M3CodeWords * i_words)
+{
+    M3Result result = m3Err_none;
+
+    M3CachePages pages = { 0 };
+    M3CacheRelocation * relocations = NULL;
+    M3CacheOutput body = { 0 };
+    M3CacheHeader header;
+    FILE * file;
+    bool written;
+
+    char path [1024], temporaryPath [1100];
+    u64 moduleHash;
+    u32 p = 0, numMappings = 0, numRelocations, numFunctionRecords = 0;
+
+_   (GetCachePath (path, sizeof (path), i_module, & moduleHash));
+
+    _throwif ("out of memory compiling", i_words->failed);
+
+    pages.numPages = CountCodePages (i_codeRuntime->pagesOpen) + CountCodePages (i_codeRuntime->pagesFull);
+    pages.pages = m3_AllocArray (IM3CodePage, pages.numPages);
+    pages.firstLines = m3_AllocArray (u32, pages.numPages);
+    _throwifnull (pages.pages);
+    _throwifnull (pages.firstLines);
+
+    for (IM3CodePage page = i_codeRuntime->pagesOpen; page; page = page->info.next)
+        pages.pages [p++] = page;
+    for (IM3CodePage page = i_codeRuntime->pagesFull; page; page = page->info.next)
+        pages.pages [p++] = page;
+
+    qsort (pages.pages, pages.numPages, sizeof (IM3CodePage), ComparePages);
+
+    for (u32 i = 0; i < pages.numPages; ++i)
+    {
+        pages.firstLines [i] = pages.numLines;
+        pages.numLines += pages.pages [i]->info.lineIndex;
+# if d_m3RecordBacktraces
+        numMappings += pages.pages [i]->info.mapping->size;
+# endif
+    }
+
+    numRelocations = i_words->numOps + i_words->numPointers;
+    relocations = m3_AllocArray (M3CacheRelocation, numRelocations);
+    _throwifnull (relocations);
+
+    for (u32 i = 0; i < i_words->numOps; ++i)
+    {
+        M3CacheRelocation * relocation = & relocations [i];
+        relocation->kind = c_cacheOp;
+        relocation->value = GetOpIndex (* (IM3Operation *) i_words->ops [i]);
+
+        _throwif ("op missing from the op table", not relocation->value);
+        _throwif ("op outside the code", not FindLine (& pages, i_words->ops [i], & relocation->line));
+    }
+
+    for (u32 i = 0; i < i_words->numPointers; ++i)
+    {
+        M3CacheRelocation * relocation = & relocations [i_words->numOps + i];
+
+        _throwif ("pointer outside the code", not FindLine (& pages, i_words->pointers [i], & relocation->line));
+_       (ClassifyPointer (relocation, i_module, & pages, i_words->pointers [i]));
+    }
+
+    qsort (relocations, numRelocations, sizeof (M3CacheRelocation), CompareRelocations);
+
+    for (u32 i = 0; i < i_module->numFunctions; ++i)
+        numFunctionRecords += (i_module->functions [i].wasm != NULL);
+
+    header = (M3CacheHeader) { d_m3CacheMagic, d_m3CacheVersion, moduleHash, GetBuildHash (), c_hashStart,
+                               i_module->numFunctions, pages.numPages, pages.numLines, numRelocations, numFunctionRecords, numMappings };
+
+_   (WriteBody (& body, i_module, & pages, relocations, numRelocations));
+
+    header.contentHash = Hash (c_hashStart, body.bytes, body.size);
+
+    snprintf (temporaryPath, sizeof (temporaryPath), "%s.%d", path, (int) getpid ());
+
+    file = fopen (temporaryPath, "wb");
+    _throwif ("can't create code cache file", not file);
+
+    written = fwrite (& header, sizeof (header), 1, file) == 1 and fwrite (body.bytes, 1, body.size, file) == body.size;
+    written = (fclose (file) == 0) and written;
+    file = NULL;
+
+    // the file appears whole or not at all, to another process reading it
+    if (not written or rename (temporaryPath, path))
+    {
+        unlink (temporaryPath);
+        _throw ("code cache write failed");
+    }
+
+    m3log (runtime, "code cache written: %s", path);
+
+    _catch:
+
+    m3_Free (body.bytes);
+    m3_Free (relocations);
+    m3_Free (pages.pages);
+    m3_Free (pages.firstLines);
+
+    return result;
+}
+
+
+// compiles the module into a runtime of its own, so that its code pages hold nothing else, then moves them over
+void  CodeCache_CompileModule  (IM3Module io_module)
+{
+    if (not IsUncompiled (io_module))
+        return;
+
+    M3Result result = m3Err_none;
+
+    IM3Runtime runtime = io_module->runtime;
+    IM3Runtime codeRuntime = m3_AllocStruct (M3Runtime);
+    M3CodeWords words = { 0 };
+    M3CallSites calls = { 0 };
+
+    if (not codeRuntime)
+        return;
+
+    codeRuntime->environment = runtime->environment;
+    codeRuntime->codeWords = & words;
+
+    for (u32 i = 0; i < io_module->numFunctions and not result; ++i)
+    {
+        IM3Function f = & io_module->functions [i];
+
+        if (f->wasm)
+            result = CompileFunctionOn (codeRuntime, f, & calls);
+    }
+
+    ResolveCallSites (& calls);
+
+    if (not result)
+        result = WriteCodeCache (io_module, codeRuntime, & words);
+
+    if (result)
+        m3log (runtime, "code cache not written: %s", result);
+                                                                        d_m3Assert (codeRuntime->numActiveCodePages == 0);
+    AppendCodePages (& runtime->pagesOpen, codeRuntime->pagesOpen);
+    AppendCodePages (& runtime->pagesFull, codeRuntime->pagesFull);
+    runtime->numCodePages += codeRuntime->numCodePages;
+
+    m3_Free (calls.calls);
+    m3_Free (words.ops);
+    m3_Free (words.pointers);
+    m3_Free (codeRuntime);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  reading
+//---------------------------------------------------------------------------------------------------------------------------------
+
+typedef struct M3CacheReader
+{
+    const u8 *              bytes;
+    const u8 *              end;
+}
+M3CacheReader;
+
+
+static
+const u8 *  Skip  (M3CacheReader * io_reader, u64 i_numBytes)
+{
+    const u8 * bytes = io_reader->bytes;
+
+    if (i_numBytes > (u64) (io_reader->end - bytes))
+        return NULL;
+
+    io_reader->bytes += i_numBytes;
+
+    return bytes;
+}
+
+
+static
+bool  Read  (M3CacheReader * io_reader, void * o_data, u64 i_numBytes)
+{
+    const u8 * bytes = Skip (io_reader, i_numBytes);
+
+    if (bytes)
+        memcpy (o_data, bytes, i_numBytes);
+
+    return (bytes != NULL);
+}
+
+
+static
+u32  FindPage  (const u32 * i_firstLines, u32 i_numPages, u32 i_line)
+{
+    u32 first = 0, last = i_numPages;
+
+    while (last - first > 1)
+    {
+        u32 middle = (first + last) / 2;
+
+        if (i_line < i_firstLines [middle])
+            last = middle;
+        else
+            first = middle;
+    }
+
+    return first;
+}
+
+
+static
+M3Result  CheckRelocation  (IM3Module i_module, const M3CacheHeader * i_header, const u32 * i_firstLines, const M3CacheRelocation * i_relocation)
+{
+    u32 value = i_relocation->value;
+
+    switch (i_relocation->kind)
+    {
+        case c_cacheOp:         return (value and value < GetNumOps ()) ? m3Err_none : "bad op";
+        case c_cacheCode:       return (value < i_header->numLines) ? m3Err_none : "bad code line";
+        case c_cacheFunction:   return (value < i_module->numFunctions) ? m3Err_none : "bad function";
+        case c_cacheFuncType:   return (value < i_module->numFuncTypes) ? m3Err_none : "bad type";
+        case c_cacheGlobal:     return (value < i_module->numGlobals) ? m3Err_none : "bad global";
+        case c_cacheModule:
+        case c_cacheNull:       return m3Err_none;
+
+        case c_cacheImportCall:
+        {
+            // the op before it is rewritten too, so it must be on the same page
+            u32 page = FindPage (i_firstLines, i_header->numPages, i_relocation->line);
+
+            if (value < i_module->numFunctions and not i_module->functions [value].wasm and i_relocation->line > i_firstLines [page])
+                return m3Err_none;
+
+            return "bad import call";
+        }
+    }
+
+    return "bad relocation";
+}
+
+
+static
+void  ApplyRelocation  (IM3Module io_module, void ** o_word, pc_t * i_pagePCs, const u32 * i_firstLines, u32 i_numPages, const M3CacheRelocation * i_relocation)
+{
+    void ** word = o_word;
+    u32 value = i_relocation->value;
+
+    switch (i_relocation->kind)
+    {
+        case c_cacheOp:         * word = (void *) GetOpAtIndex (value);                             break;
+        case c_cacheFunction:   * word = & io_module->functions [value];                            break;
+        case c_cacheFuncType:   * word = io_module->funcTypes [value];                              break;
+        case c_cacheGlobal:     * word = & io_module->globals [value].intValue;                     break;
+        case c_cacheModule:     * word = io_module;                                                 break;
+        case c_cacheNull:       * word = NULL;                                                      break;
+
+        case c_cacheCode:
+        {
+            u32 target = FindPage (i_firstLines, i_numPages, value);
+            * word = (void *) (i_pagePCs [target] + (value - i_firstLines [target]));
+            break;
+        }
+
+        case c_cacheImportCall:
+            UnresolveCallSite ((pc_t) word, & io_module->functions [value]);
+            break;
+    }
+}
+
+
+static
+M3Result  LoadCode  (IM3Module io_module, M3CacheReader * io_reader, u64 i_moduleHash)
+{
+    M3Result result = m3Err_none;
+
+    IM3Runtime runtime = io_module->runtime;
+
+    u32 * firstLines = NULL;
+    IM3CodePage * pages = NULL;
+    pc_t * pagePCs = NULL;
+    u32 numAcquired = 0;
+    bool filled = false;
+
+    M3CacheHeader header;
+    M3CacheReader records;
+    const u8 * lineCounts, * lines, * relocations, * mappings;
+    u64 numLines = 0;
+    u32 previousLine = 0, numBodies = 0, page = 0;
+
+    _throwif ("truncated", not Read (io_reader, & header, sizeof (header)));
+
+    _throwif ("not a code cache file",  header.magic != d_m3CacheMagic or header.version != d_m3CacheVersion);
+    _throwif ("another module's",       header.moduleHash != i_moduleHash);
+    _throwif ("another build's",        header.buildHash != GetBuildHash ());
+    _throwif ("damaged",                header.contentHash != Hash (c_hashStart, io_reader->bytes, io_reader->end - io_reader->bytes));
+    _throwif ("another module's",       header.numFunctions != io_module->numFunctions);
+    _throwif ("bad page count",         not header.numPages or header.numPages > header.numLines);
+    _throwif ("bad mappings",           header.numMappings and not d_m3RecordBacktraces);
+
+    lineCounts = Skip (io_reader, header.numPages * (u64) sizeof (u32));
+    _throwif ("truncated", not lineCounts);
+
+    firstLines = m3_AllocArray (u32, header.numPages);
+    pages = m3_AllocArray (IM3CodePage, header.numPages);
+    pagePCs = m3_AllocArray (pc_t, header.numPages);
+    _throwifnull (firstLines);
+    _throwifnull (pages);
+    _throwifnull (pagePCs);
+
+    for (u32 i = 0; i < header.numPages; ++i)
+    {
+        u32 count;
+        memcpy (& count, lineCounts + i * sizeof (u32), sizeof (u32));
+
+        _throwif ("bad page", not count);
+
+        firstLines [i] = (u32) numLines;
+        numLines += count;
+    }
+
+    _throwif ("bad line count", numLines != header.numLines);
+
+    lines = Skip (io_reader, numLines * sizeof (code_t));
+    relocations = Skip (io_reader, header.numRelocations * (u64) sizeof (M3CacheRelocation));
+    _throwif ("truncated", not lines or not relocations);
+
+    for (u32 i = 0; i < header.numRelocations; ++i)
+    {
+        M3CacheRelocation relocation;
+        memcpy (& relocation, relocations + i * sizeof (M3CacheRelocation), sizeof (relocation));
+
+        _throwif ("bad relocation", relocation.line >= header.numLines or (i and relocation.line <= previousLine));
+        previousLine = relocation.line;
+_       (CheckRelocation (io_module, & header, firstLines, & relocation));
+    }
+
+    for (u32 i = 0; i < io_module->numFunctions; ++i)
+        numBodies += (io_module->functions [i].wasm != NULL);
+
+    _throwif ("another module's", header.numFunctionRecords != numBodies);
+
+    records = * io_reader;
+
+    for (u32 i = 0; i < header.numFunctionRecords; ++i)
+    {
+        M3CacheFunction record;
+        _throwif ("truncated", not Read (io_reader, & record, sizeof (record)));
+        _throwif ("bad function", record.index >= io_module->numFunctions or not io_module->functions [record.index].wasm);
+        _throwif ("bad function", record.line >= header.numLines);
+        _throwif ("truncated", not Skip (io_reader, record.numConstantBytes + record.numLocalInitRanges * 2 * (u64) sizeof (u16)));
+    }
+
+    mappings = Skip (io_reader, header.numMappings * (u64) sizeof (M3CacheMapping));
+    _throwif ("truncated", not mappings);
+    _throwif ("trailing bytes", io_reader->bytes != io_reader->end);
+
+    // everything checks out. what can fail is done before any code is written
+    for (numAcquired = 0; numAcquired < header.numPages; ++numAcquired)
+    {
+        u32 end = (numAcquired + 1 < header.numPages) ? firstLines [numAcquired + 1] : header.numLines;
+
+        pages [numAcquired] = AcquireCodePageWithCapacity (runtime, end - firstLines [numAcquired]);
+        _throwif (m3Err_mallocFailedCodePage, not pages [numAcquired]);
+
+        pagePCs [numAcquired] = GetPagePC (pages [numAcquired]);
+    }
+
+    for (u32 i = 0; i < header.numFunctionRecords; ++i)
+    {
+        M3CacheFunction record;
+        Read (& records, & record, sizeof (record));
+
+        IM3Function function = & io_module->functions [record.index];
+
+        if (record.numConstantBytes)
+        {
+            function->constants = m3_CopyMem (Skip (& records, record.numConstantBytes), record.numConstantBytes);
+            _throwifnull (function->constants);
+        }
+
+        if (record.numLocalInitRanges)
+        {
+            u32 size = record.numLocalInitRanges * 2 * sizeof (u16);
+            function->localInitRanges = m3_CopyMem (Skip (& records, size), size);
+            _throwifnull (function->localInitRanges);
+        }
+
+        function->maxStackSlots         = record.maxStackSlots;
+        function->numRetSlots           = record.numRetSlots;
+        function->numRetAndArgSlots     = record.numRetAndArgSlots;
+        function->numLocals             = record.numLocals;
+        function->numLocalBytes         = record.numLocalBytes;
+        function->numConstantBytes      = record.numConstantBytes;
+        function->numLocalInitRanges    = record.numLocalInitRanges;
+
+        u32 p = FindPage (firstLines, header.numPages, record.line);
+        function->compiled = pagePCs [p] + (record.line - firstLines [p]);
+    }
+
+    for (u32 i = 0; i < header.numPages; ++i)
+    {
+        IM3CodePage page = pages [i];
+        u32 count = ((i + 1 < header.numPages) ? firstLines [i + 1] : header.numLines) - firstLines [i];
+
+        memcpy ((void *) pagePCs [i], lines + firstLines [i] * sizeof (code_t), count * sizeof (code_t));
+        page->info.lineIndex += count;
+    }
+
+    // the relocations are in line order, so the page only moves forward. an import call rewrites the op before it,
+    // whose own relocation has been applied by then
+    for (u32 i = 0; i < header.numRelocations; ++i)
+    {
+        M3CacheRelocation relocation;
+        memcpy (& relocation, relocations + i * sizeof (M3CacheRelocation), sizeof (relocation));
+
+        while (page + 1 < header.numPages and relocation.line >= firstLines [page + 1])
+            ++page;
+
+        void ** word = (void **) (pagePCs [page] + (relocation.line - firstLines [page]));
+        ApplyRelocation (io_module, word, pagePCs, firstLines, header.numPages, & relocation);
+    }
+
+# if d_m3RecordBacktraces
+    for (u32 i = 0; i < header.numMappings; ++i)
+    {
+        M3CacheMapping entry;
+        memcpy (& entry, mappings + i * sizeof (M3CacheMapping), sizeof (entry));
+
+        u32 p = FindPage (firstLines, header.numPages, entry.line);
+        M3CodeMappingPage * mapping = pages [p]->info.mapping;
+
+        if (mapping->size < mapping->capacity)
+        {
+            pc_t pc = pagePCs [p] + (entry.line - firstLines [p]);
+            mapping->entries [mapping->size++] = (M3CodeMapEntry) { (u32) (pc - mapping->basePC), entry.moduleOffset };
+        }
+    }
+# endif
+
+    filled = true;
+    io_module->codeFromCache = true;
+
+    _catch:
+
+    // on failure, the pages go back as they were, and the functions are compiled as usual
+    if (result and not filled)
+    {
+        for (u32 i = 0; i < io_module->numFunctions; ++i)
+        {
+            IM3Function function = & io_module->functions [i];
+
+            if (function->wasm)
+            {
+                m3_Free (function->constants);
+                m3_Free (function->localInitRanges);
+                function->compiled = NULL;
+            }
+        }
+    }
+
+    for (u32 i = 0; i < numAcquired; ++i)
+        ReleaseCodePage (runtime, pages [i]);
+
+    m3_Free (firstLines);
+    m3_Free (pages);
+    m3_Free (pagePCs);
+
+    return result;
+}
+
+
+void  CodeCache_LoadModule  (IM3Module io_module)
+{
+    if (not IsUncompiled (io_module))
+        return;
+
+    M3Result result = m3Err_none;
+
+    char path [1024];
+    u64 moduleHash;
+    int file = -1;
+    void * map = MAP_FAILED;
+    struct stat status;
+    M3CacheReader reader;
+
+    int flags = MAP_PRIVATE;
+#   if defined (MAP_POPULATE)
+    flags |= MAP_POPULATE;      // it's all read: one fault instead of one per page
+#   endif
+
+_   (GetCachePath (path, sizeof (path), io_module, & moduleHash));
+
+    file = open (path, O_RDONLY);
+    _throwif ("no code cache file", file < 0);
+    _throwif ("no code cache file", fstat (file, & status) or status.st_size < (off_t) sizeof (M3CacheHeader));
+
+    map = mmap (NULL, status.st_size, PROT_READ, flags, file, 0);
+    _throwif ("can't map the code cache file", map == MAP_FAILED);
+
+    reader = (M3CacheReader) { (const u8 *) map, (const u8 *) map + status.st_size };
+    result = LoadCode (io_module, & reader, moduleHash);
+
+    _catch:                                                             m3log (runtime, "code cache %s: %s", result ? "not read" : "read", result ? result : path);
+
+    if (map != MAP_FAILED)
+        munmap (map, status.st_size);
+
+    if (file >= 0)
+        close (file);
+}
+
+
+// the code read from the cache can't be shared by instances, so it's left unused, and compiled again
+void  CodeCache_DiscardCode  (IM3Module io_module)
+{
+    if (not io_module->codeFromCache)
+        return;
+
+    for (u32 i = 0; i < io_module->numFunctions; ++i)
+    {
+        IM3Function function = & io_module->functions [i];
+
+        if (function->wasm)
+        {
+            m3_Free (function->constants);
+            m3_Free (function->localInitRanges);
+
+            function->compiled = NULL;
+            function->numConstantBytes = 0;
+            function->numLocalInitRanges = 0;
+        }
+    }
+
+    io_module->codeFromCache = false;
+}
+
+#endif // d_m3CodeCache
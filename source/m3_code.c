@@ -148,6 +148,18 @@ IM3CodePage  PopCodePage  (IM3CodePage * i_list)
 }
 
 
+void  AppendCodePages  (IM3CodePage * io_list, IM3CodePage i_pages)
+{
+    IM3CodePage end = GetEndCodePage (i_pages);
+
+    if (end)
+    {
+        end->info.next = * io_list;
+        * io_list = i_pages;
+    }
+}
+
+
 
 u32  FindCodePageEnd  (IM3CodePage i_list, IM3CodePage * o_end)
 {
@@ -38,6 +38,7 @@ void                    EmitMappingEntry        (IM3CodePage i_page, u32 i_modul
 
 void                    PushCodePage            (IM3CodePage * io_list, IM3CodePage i_codePage);
 IM3CodePage             PopCodePage             (IM3CodePage * io_list);
+void                    AppendCodePages         (IM3CodePage * io_list, IM3CodePage i_pages);   // i_pages = NULL is valid
 
 IM3CodePage             GetEndCodePage          (IM3CodePage i_list); // i_list = NULL is valid
 u32                     CountCodePages          (IM3CodePage i_list); // i_list = NULL is valid
@@ -14,6 +14,10 @@
 #include "m3_exception.h"
 #include "m3_info.h"
 
+#if d_m3CodeCache
+#   include <pthread.h>
+#endif
+
 //----- EMIT --------------------------------------------------------------------------------------------------------------
 
 static inline
@@ -22,6 +26,15 @@ pc_t GetPC (IM3Compilation o)
     return GetPagePC (o->page);
 }
 
+static inline
+void  RecordCodeWord  (IM3Compilation o, bool i_isOp)
+{
+# if d_m3CodeCache
+    if (o->codeWords)
+        AddCodeWord (o->codeWords, GetPagePC (o->page), i_isOp);
+# endif
+}
+
 static M3_NOINLINE
 M3Result  EnsureCodePageNumLines  (IM3Compilation o, u32 i_numLines)
 {
@@ -38,7 +51,9 @@ M3Result  EnsureCodePageNumLines  (IM3Compilation o, u32 i_numLines)
             m3log (emit, "bridging new code page from: %d %p (free slots: %d) to: %d", o->page->info.sequence, GetPC (o), NumFreeLines (o->page), page->info.sequence);
             d_m3Assert (NumFreeLines (o->page) >= 2);
 
+            RecordCodeWord (o, true);
             EmitWord (o->page, op_Branch);
+            RecordCodeWord (o, false);
             EmitWord (o->page, GetPagePC (page));
 
             ReleaseCodePage (o->runtime, o->page);
@@ -72,6 +87,7 @@ M3Result  EmitOp  (IM3Compilation o, IM3Operation i_operation)
 # if d_m3RecordBacktraces
             EmitMappingEntry (o->page, o->lastOpcodeStart - o->module->wasmStart);
 # endif // d_m3RecordBacktraces
+            RecordCodeWord (o, true);
             EmitWord (o->page, i_operation);
         }
     }
@@ -87,6 +103,13 @@ void  EmitConstant32  (IM3Compilation o, const u32 i_immediate)
         EmitWord32 (o->page, i_immediate);
 }
 
+static M3_NOINLINE
+void  EmitConstant64  (IM3Compilation o, const u64 i_immediate)
+{
+    if (o->page)
+        EmitWord64 (o->page, i_immediate);
+}
+
 static M3_NOINLINE
 void  EmitSlotOffset  (IM3Compilation o, const i32 i_offset)
 {
@@ -100,7 +123,10 @@ pc_t  EmitPointer  (IM3Compilation o, const void * const i_pointer)
     pc_t ptr = GetPagePC (o->page);
 
     if (o->page)
+    {
+        RecordCodeWord (o, false);
         EmitWord (o->page, i_pointer);
+    }
 
     return ptr;
 }
@@ -138,6 +164,8 @@ static const IM3Operation c_setSetOps [] =       { NULL, op_SetSlot_i32,
                                                     FPOP(op_SetSlot_f32),         FPOP(op_SetSlot_f64) };
 static const IM3Operation c_setGlobalOps [] =    { NULL, op_SetGlobal_i32,             op_SetGlobal_i64,
                                                     FPOP(op_SetGlobal_f32),       FPOP(op_SetGlobal_f64) };
+static const IM3Operation c_setInstanceGlobalOps [] = { NULL, op_SetInstanceGlobal_i32, op_SetInstanceGlobal_i64,
+                                                    FPOP(op_SetInstanceGlobal_f32), FPOP(op_SetInstanceGlobal_f64) };
 static const IM3Operation c_setRegisterOps [] =  { NULL, op_SetRegister_i32,           op_SetRegister_i64,
                                                     FPOP(op_SetRegister_f32),     FPOP(op_SetRegister_f64) };
 
@@ -150,8 +178,121 @@ static const IM3Operation c_fpSelectOps [2] [2] [3] = { { { op_Select_f32_sss, o
                                                           { op_Select_f64_rss, op_Select_f64_rrs, op_Select_f64_rsr } } };    // selector in reg
 #endif
 
-// all args & returns are 64-bit aligned, so use 2 slots for a d_m3Use32BitSlots=1 build
-static const u16 c_ioSlotCount = sizeof (u64) / sizeof (m3slot_t);
+// fused compare & branch ops; indexed by [compare opcode - i32.eqz] [branch kind] [operand form, like M3OpInfo.operations]
+enum
+{
+    c_cmpBranchIf           = 0,    // br_if to a forward block
+    c_cmpBranchIfFailed     = 1,    // if; jumps to the else-pc when the compare fails
+    c_cmpContinueLoopIf     = 2     // br_if to a loop
+};
+
+#define d_unaryCmpBranchOps(PREFIX, TYPE, NAME)         { op_##PREFIX##_##TYPE##_##NAME##_r,  op_##PREFIX##_##TYPE##_##NAME##_s,  NULL }
+#define d_cmpBranchOps(PREFIX, TYPE, NAME)              { op_##PREFIX##_##TYPE##_##NAME##_rs, op_##PREFIX##_##TYPE##_##NAME##_sr, op_##PREFIX##_##TYPE##_##NAME##_ss }
+#define d_commutativeCmpBranchOps(PREFIX, TYPE, NAME)   { op_##PREFIX##_##TYPE##_##NAME##_rs, NULL,                               op_##PREFIX##_##TYPE##_##NAME##_ss }
+
+#define d_unaryCmpBranch(TYPE, NAME, INVERSE)           { d_unaryCmpBranchOps (BranchIf, TYPE, NAME),        d_unaryCmpBranchOps (BranchIf, TYPE, INVERSE), \
+                                                          d_unaryCmpBranchOps (ContinueLoopIf, TYPE, NAME) }
+#define d_cmpBranch(TYPE, NAME, INVERSE)                { d_cmpBranchOps (BranchIf, TYPE, NAME),             d_cmpBranchOps (BranchIf, TYPE, INVERSE), \
+                                                          d_cmpBranchOps (ContinueLoopIf, TYPE, NAME) }
+#define d_commutativeCmpBranch(TYPE, NAME, INVERSE)     { d_commutativeCmpBranchOps (BranchIf, TYPE, NAME),  d_commutativeCmpBranchOps (BranchIf, TYPE, INVERSE), \
+                                                          d_commutativeCmpBranchOps (ContinueLoopIf, TYPE, NAME) }
+#define d_fpCmpBranch(TYPE, NAME)                       { d_cmpBranchOps (BranchIf, TYPE, NAME),             d_cmpBranchOps (BranchIfNot, TYPE, NAME), \
+                                                          d_cmpBranchOps (ContinueLoopIf, TYPE, NAME) }
+#define d_fpCommutativeCmpBranch(TYPE, NAME)            { d_commutativeCmpBranchOps (BranchIf, TYPE, NAME),  d_commutativeCmpBranchOps (BranchIfNot, TYPE, NAME), \
+                                                          d_commutativeCmpBranchOps (ContinueLoopIf, TYPE, NAME) }
+
+// a row per compare opcode, i32.eqz through f64.ge
+static const IM3Operation c_cmpBranchOps [c_waOp_f64_ge - c_waOp_i32_eqz + 1] [3] [3] =
+{
+    d_unaryCmpBranch            (i32, EqualToZero,          NotEqualToZero),        // 0x45
+    d_commutativeCmpBranch      (i32, Equal,                NotEqual),
+    d_commutativeCmpBranch      (i32, NotEqual,             Equal),
+    d_cmpBranch                 (i32, LessThan,             GreaterThanOrEqual),
+    d_cmpBranch                 (u32, LessThan,             GreaterThanOrEqual),
+    d_cmpBranch                 (i32, GreaterThan,          LessThanOrEqual),
+    d_cmpBranch                 (u32, GreaterThan,          LessThanOrEqual),
+    d_cmpBranch                 (i32, LessThanOrEqual,      GreaterThan),
+    d_cmpBranch                 (u32, LessThanOrEqual,      GreaterThan),
+    d_cmpBranch                 (i32, GreaterThanOrEqual,   LessThan),
+    d_cmpBranch                 (u32, GreaterThanOrEqual,   LessThan),              // 0x4f
+
+    d_unaryCmpBranch            (i64, EqualToZero,          NotEqualToZero),        // 0x50
+    d_commutativeCmpBranch      (i64, Equal,                NotEqual),
+    d_commutativeCmpBranch      (i64, NotEqual,             Equal),
+    d_cmpBranch                 (i64, LessThan,             GreaterThanOrEqual),
+    d_cmpBranch                 (u64, LessThan,             GreaterThanOrEqual),
+    d_cmpBranch                 (i64, GreaterThan,          LessThanOrEqual),
+    d_cmpBranch                 (u64, GreaterThan,          LessThanOrEqual),
+    d_cmpBranch                 (i64, LessThanOrEqual,      GreaterThan),
+    d_cmpBranch                 (u64, LessThanOrEqual,      GreaterThan),
+    d_cmpBranch                 (i64, GreaterThanOrEqual,   LessThan),
+    d_cmpBranch                 (u64, GreaterThanOrEqual,   LessThan),              // 0x5a
+
+#if d_m3HasFloat
+    d_fpCommutativeCmpBranch    (f32, Equal),                                       // 0x5b
+    d_fpCommutativeCmpBranch    (f32, NotEqual),
+    d_fpCmpBranch               (f32, LessThan),
+    d_fpCmpBranch               (f32, GreaterThan),
+    d_fpCmpBranch               (f32, LessThanOrEqual),
+    d_fpCmpBranch               (f32, GreaterThanOrEqual),
+
+    d_fpCommutativeCmpBranch    (f64, Equal),                                       // 0x61
+    d_fpCommutativeCmpBranch    (f64, NotEqual),
+    d_fpCmpBranch               (f64, LessThan),
+    d_fpCmpBranch               (f64, GreaterThan),
+    d_fpCmpBranch               (f64, LessThanOrEqual),
+    d_fpCmpBranch               (f64, GreaterThanOrEqual),                          // 0x66
+#endif
+};
+
+// integer ops whose top operand is an immediate; indexed by [opcode - i32.eq] [first operand in register, in slot]
+#define d_immediateOps(TYPE, NAME)      { op_##TYPE##_##NAME##_ri, op_##TYPE##_##NAME##_si }
+#define d_noImmediateOps                { NULL, NULL }
+
+static const IM3Operation c_immediateOps [] [2] =
+{
+    d_immediateOps (i32, Equal),                d_immediateOps (i32, NotEqual),                 // 0x46
+    d_immediateOps (i32, LessThan),             d_immediateOps (u32, LessThan),
+    d_immediateOps (i32, GreaterThan),          d_immediateOps (u32, GreaterThan),
+    d_immediateOps (i32, LessThanOrEqual),      d_immediateOps (u32, LessThanOrEqual),
+    d_immediateOps (i32, GreaterThanOrEqual),   d_immediateOps (u32, GreaterThanOrEqual),       // 0x4f
+
+    d_noImmediateOps,                                                                           // 0x50
+    d_immediateOps (i64, Equal),                d_immediateOps (i64, NotEqual),
+    d_immediateOps (i64, LessThan),             d_immediateOps (u64, LessThan),
+    d_immediateOps (i64, GreaterThan),          d_immediateOps (u64, GreaterThan),
+    d_immediateOps (i64, LessThanOrEqual),      d_immediateOps (u64, LessThanOrEqual),
+    d_immediateOps (i64, GreaterThanOrEqual),   d_immediateOps (u64, GreaterThanOrEqual),       // 0x5a
+
+    d_noImmediateOps, d_noImmediateOps, d_noImmediateOps, d_noImmediateOps, d_noImmediateOps, d_noImmediateOps, // f32 compares
+    d_noImmediateOps, d_noImmediateOps, d_noImmediateOps, d_noImmediateOps, d_noImmediateOps, d_noImmediateOps, // f64 compares
+    d_noImmediateOps, d_noImmediateOps, d_noImmediateOps,                                                       // i32 clz, ctz, popcnt
+
+    d_immediateOps (i32, Add),                  d_immediateOps (i32, Subtract),                 // 0x6a
+    d_immediateOps (i32, Multiply),
+    d_immediateOps (i32, Divide),               d_immediateOps (u32, Divide),
+    d_immediateOps (i32, Remainder),            d_immediateOps (u32, Remainder),
+    d_immediateOps (u32, And),                  d_immediateOps (u32, Or),                       d_immediateOps (u32, Xor),
+    d_immediateOps (u32, ShiftLeft),            d_immediateOps (i32, ShiftRight),               d_immediateOps (u32, ShiftRight),
+    d_immediateOps (u32, Rotl),                 d_immediateOps (u32, Rotr),                     // 0x78
+
+    d_noImmediateOps, d_noImmediateOps, d_noImmediateOps,                                       // i64 clz, ctz, popcnt
+
+    d_immediateOps (i64, Add),                  d_immediateOps (i64, Subtract),                 // 0x7c
+    d_immediateOps (i64, Multiply),
+    d_immediateOps (i64, Divide),               d_immediateOps (u64, Divide),
+    d_immediateOps (i64, Remainder),            d_immediateOps (u64, Remainder),
+    d_immediateOps (u64, And),                  d_immediateOps (u64, Or),                       d_immediateOps (u64, Xor),
+    d_immediateOps (u64, ShiftLeft),            d_immediateOps (i64, ShiftRight),               d_immediateOps (u64, ShiftRight),
+    d_immediateOps (u64, Rotl),                 d_immediateOps (u64, Rotr),                     // 0x8a
+};
+
+// M3Compilation.localInitFlags
+enum
+{
+    c_localAssigned         = 1,    // definitely set at the current point of compilation
+    c_localReadBeforeSet    = 2     // read somewhere it wasn't definitely set, so op_Entry must zero it
+};
 
 static
 M3Result  AcquireCompilationCodePage  (IM3Compilation o, IM3CodePage * o_codePage)
@@ -258,6 +399,7 @@ u8  GetStackTypeFromBottom  (IM3Compilation o, u16 i_offset)
 
 static inline bool  IsConstantSlot    (IM3Compilation o, u16 i_slot)  { return (i_slot >= o->slotFirstConstIndex and i_slot < o->slotMaxConstIndex); }
 static inline bool  IsSlotAllocated   (IM3Compilation o, u16 i_slot)  { return o->m3Slots [i_slot]; }
+static inline bool  HasConstantTable  (IM3Compilation o)              { return o->slotFirstDynamicIndex > o->slotFirstConstIndex; }
 
 static inline
 bool  IsStackIndexInRegister  (IM3Compilation o, i32 i_stackIndex)
@@ -513,24 +655,23 @@ _   (PreserveRegisterIfOccupied (o, c_m3Type_i64));
     _catch: return result;
 }
 
+// preserves registers holding values below i_stackIndex; the values at and above it are about to be consumed
 static
-M3Result  PreserveNonTopRegisters  (IM3Compilation o)
+M3Result  PreserveRegistersBelow  (IM3Compilation o, i16 i_stackIndex)
 {
     M3Result result = m3Err_none;
 
-    i16 stackTop = GetStackTopIndex (o);
-
-    if (stackTop >= 0)
+    if (i_stackIndex >= 0)
     {
         if (IsRegisterAllocated (o, 0))     // r0
         {
-            if (GetRegisterStackIndex (o, 0) != stackTop)
+            if (GetRegisterStackIndex (o, 0) < i_stackIndex)
 _               (PreserveRegisterIfOccupied (o, c_m3Type_i64));
         }
 
         if (IsRegisterAllocated (o, 1))     // fp0
         {
-            if (GetRegisterStackIndex (o, 1) != stackTop)
+            if (GetRegisterStackIndex (o, 1) < i_stackIndex)
 _               (PreserveRegisterIfOccupied (o, c_m3Type_f64));
         }
     }
@@ -538,6 +679,12 @@ _               (PreserveRegisterIfOccupied (o, c_m3Type_f64));
     _catch: return result;
 }
 
+static inline
+M3Result  PreserveNonTopRegisters  (IM3Compilation o)
+{
+    return PreserveRegistersBelow (o, GetStackTopIndex (o));
+}
+
 
 //----------------------------------------------------------------------------------------------------------------------
 
@@ -1148,14 +1295,66 @@ _               (Pop (o));
 
 //-------------------------------------------------------------------------------------------------------------------------
 
+// an integer constant that's directly consumed as the top operand of an operator with immediate forms is
+// deferred; Compile_Operator then emits the constant into the code stream instead of the constant table.
+// it's left as a slot when the operator would otherwise fuse with whatever follows it, unless there's
+// no constant table, in which case that slot would have to be filled by an op_Const anyway.
+static
+bool  IsDeferrableImmediate  (IM3Compilation o, u8 i_type)
+{
+    if (not o->page or IsStackPolymorphic (o) or o->wasm >= o->wasmEnd)
+        return false;
+
+    u8 next = * o->wasm;
+
+    if (next < c_waOp_i32_eq or next >= c_waOp_i32_eq + M3_COUNT_OF (c_immediateOps) or not c_immediateOps [next - c_waOp_i32_eq] [0])
+        return false;
+
+    // compares produce an i32, so the operand type comes from the opcode range
+    bool is64BitOperator = (next > c_waOp_i64_eqz and next < c_waOp_f32_eq) or next >= c_waOp_i64_clz;
+
+    if (i_type != (is64BitOperator ? c_m3Type_i64 : c_m3Type_i32))
+        return false;
+
+    if (GetNumBlockValuesOnStack (o) < 1 or GetStackTopType (o) != i_type)
+        return false;
+
+    if (HasConstantTable (o) and o->wasm + 1 < o->wasmEnd)
+    {
+        u8 following = o->wasm [1];
+
+        if (next < c_waOp_f32_eq and (following == c_waOp_if or following == c_waOp_branchIf))
+            return false;
+
+        if (not IsStackTopInRegister (o))
+        {
+            if (GetOpInfo (next)->operations [3] and (following == c_waOp_setLocal or following == c_waOp_teeLocal))
+                return false;
+
+            if (next == c_waOp_i32_add and following >= c_waOp_i32_load and following <= c_waOp_i64_load32_u)
+                return false;
+        }
+    }
+
+    return true;
+}
+
 static
 M3Result  Compile_Const_i32  (IM3Compilation o, m3opcode_t i_opcode)
 {
     M3Result result;
 
     i32 value;
-_   (ReadLEB_i32 (& value, & o->wasm, o->wasmEnd));
-_   (PushConst (o, value, c_m3Type_i32));                       m3log (compile, d_indent " (const i32 = %" PRIi32 ")", get_indention_string (o), value);
+_   (ReadLEB_i32 (& value, & o->wasm, o->wasmEnd));             m3log (compile, d_indent " (const i32 = %" PRIi32 ")", get_indention_string (o), value);
+
+    if (IsDeferrableImmediate (o, c_m3Type_i32))
+    {
+        o->pendingImmediateType = c_m3Type_i32;
+        o->pendingImmediate = (u32) value;
+    }
+    else
+_       (PushConst (o, value, c_m3Type_i32));
+
     _catch: return result;
 }
 
@@ -1165,8 +1364,16 @@ M3Result  Compile_Const_i64  (IM3Compilation o, m3opcode_t i_opcode)
     M3Result result;
 
     i64 value;
-_   (ReadLEB_i64 (& value, & o->wasm, o->wasmEnd));
-_   (PushConst (o, value, c_m3Type_i64));                       m3log (compile, d_indent " (const i64 = %" PRIi64 ")", get_indention_string (o), value);
+_   (ReadLEB_i64 (& value, & o->wasm, o->wasmEnd));             m3log (compile, d_indent " (const i64 = %" PRIi64 ")", get_indention_string (o), value);
+
+    if (IsDeferrableImmediate (o, c_m3Type_i64))
+    {
+        o->pendingImmediateType = c_m3Type_i64;
+        o->pendingImmediate = (u64) value;
+    }
+    else
+_       (PushConst (o, value, c_m3Type_i64));
+
     _catch: return result;
 }
 
@@ -1279,9 +1486,13 @@ M3Result  Compile_End  (IM3Compilation o, m3opcode_t i_opcode)
             if (o->function)
             {
 _               (ReturnValues (o, & o->block, false));
+_               (EmitOp (o, op_Return));
+            }
+            else
+            {
+                // an init expression; it's run without a memory header to trampoline through
+_               (EmitOp (o, op_End));
             }
-
-_           (EmitOp (o, op_Return));
         }
     }
 
@@ -1289,6 +1500,48 @@ _           (EmitOp (o, op_Return));
 }
 
 
+// a set dominates everything that follows it within its own block (wasm control flow is structured), so a
+// local's first assignment holds at least until that block ends. CompileBlock then unwinds it with
+// UnwindAssignedLocals (), unless it's known to hold past the block too
+static inline
+void  MarkLocalAssigned  (IM3Compilation o, u16 i_localIndex)
+{
+    if (not (o->localInitFlags [i_localIndex] & c_localAssigned))
+    {
+        o->localInitFlags [i_localIndex] |= c_localAssigned;
+        o->assignedLocals [o->numAssignedLocals++] = i_localIndex;
+    }
+}
+
+// a branch to the end of a block only carries the assignments that block had made at its own level by then
+static
+void  LimitAssignedLocalsAtBranch  (IM3Compilation o, IM3CompilationScope i_scope)
+{
+    if (i_scope->opcode == c_waOp_loop)
+        return;
+
+    IM3CompilationScope scope = & o->block;
+    u16 numAssigned = o->numAssignedLocals;
+
+    while (scope != i_scope)
+    {
+        numAssigned = scope->assignedLocalsStart;
+        scope = scope->outer;
+    }
+
+    i_scope->assignedLocalsLimit = M3_MIN (i_scope->assignedLocalsLimit, numAssigned);
+}
+
+static inline
+void  UnwindAssignedLocals  (IM3Compilation o, u16 i_numAssignedLocals)
+{
+    while (o->numAssignedLocals > i_numAssignedLocals)
+    {
+        u16 localIndex = o->assignedLocals [--o->numAssignedLocals];
+        o->localInitFlags [localIndex] &= ~c_localAssigned;
+    }
+}
+
 static
 M3Result  Compile_SetLocal  (IM3Compilation o, m3opcode_t i_opcode)
 {
@@ -1301,16 +1554,49 @@ _   (ReadLEB_u32 (& localIndex, & o->wasm, o->wasmEnd));             //  printf
     {
         u16 localSlot = GetSlotForStackIndex (o, localIndex);
 
+        MarkLocalAssigned (o, localIndex);
+
         u16 preserveSlot;
-_       (FindReferencedLocalWithinCurrentBlock (o, & preserveSlot, localSlot));  // preserve will be different than local, if referenced
 
-        if (preserveSlot == localSlot)
-_           (CopyStackTopToSlot (o, localSlot))
+        if (o->pendingOpcode)
+        {
+            // three-address op; see IsFusableThreeAddressOp. its operands are read before the local is
+            // written, so they're hidden from the preservation search
+            IM3OpInfo opInfo = GetOpInfo (o->pendingOpcode);
+            o->pendingOpcode = 0;
+
+            o->stackIndex -= 2;
+            result = FindReferencedLocalWithinCurrentBlock (o, & preserveSlot, localSlot);
+            o->stackIndex += 2;
+_           (result);
+
+            if (preserveSlot != localSlot)
+            {
+_               (EmitOp (o, Is64BitType (opInfo->type) ? op_CopySlot_64 : op_CopySlot_32));
+                EmitSlotOffset (o, preserveSlot);
+                EmitSlotOffset (o, localSlot);
+            }
+
+_           (EmitOp (o, opInfo->operations [3]));
+            EmitSlotOffset (o, localSlot);
+_           (EmitSlotNumOfStackTopAndPop (o));
+_           (EmitSlotNumOfStackTopAndPop (o));
+
+            if (i_opcode == c_waOp_teeLocal)
+_               (Push (o, opInfo->type, localSlot));
+        }
         else
-_           (PreservedCopyTopSlot (o, localSlot, preserveSlot))
+        {
+_           (FindReferencedLocalWithinCurrentBlock (o, & preserveSlot, localSlot));  // preserve will be different than local, if referenced
 
-        if (i_opcode != c_waOp_teeLocal)
-_           (Pop (o));
+            if (preserveSlot == localSlot)
+_               (CopyStackTopToSlot (o, localSlot))
+            else
+_               (PreservedCopyTopSlot (o, localSlot, preserveSlot))
+
+            if (i_opcode != c_waOp_teeLocal)
+_               (Pop (o));
+        }
     }
     else _throw ("local index out of bounds");
 
@@ -1331,19 +1617,45 @@ _   (ReadLEB_u32 (& localIndex, & o->wasm, o->wasmEnd));
     u8 type = GetStackTypeFromBottom (o, localIndex);
     u16 slot = GetSlotForStackIndex (o, localIndex);
 
+    if (not (o->localInitFlags [localIndex] & c_localAssigned))
+        o->localInitFlags [localIndex] |= c_localReadBeforeSet;
+
 _   (Push (o, type, slot));
 
     } _catch: return result;
 }
 
+// a compiled module's functions are run by all its instances, which each have their own globals. constant
+// expressions are still evaluated against the module they're in
+static
+bool  IsSharedCode  (IM3Compilation o)
+{
+    return (o->module->compiled and o->function);
+}
+
+static
+void  EmitGlobal  (IM3Compilation o, M3Global * i_global)
+{
+    if (IsSharedCode (o))
+        EmitConstant32 (o, (u32) (i_global - o->module->globals));
+    else
+        EmitPointer (o, & i_global->intValue);
+}
+
 static
 M3Result  Compile_GetGlobal  (IM3Compilation o, M3Global * i_global)
 {
     M3Result result;
 
-    IM3Operation op = Is64BitType (i_global->type) ? op_GetGlobal_s64 : op_GetGlobal_s32;
+    IM3Operation op;
+
+    if (IsSharedCode (o))
+        op = Is64BitType (i_global->type) ? op_GetInstanceGlobal_s64 : op_GetInstanceGlobal_s32;
+    else
+        op = Is64BitType (i_global->type) ? op_GetGlobal_s64 : op_GetGlobal_s32;
+
 _   (EmitOp (o, op));
-    EmitPointer (o, & i_global->intValue);
+    EmitGlobal (o, i_global);
 _   (PushAllocatedSlotAndEmit (o, i_global->type));
 
     _catch: return result;
@@ -1359,14 +1671,21 @@ M3Result  Compile_SetGlobal  (IM3Compilation o, M3Global * i_global)
         IM3Operation op;
         u8 type = GetStackTopType (o);
 
-        if (IsStackTopInRegister (o))
+        if (IsSharedCode (o))
+        {
+            if (IsStackTopInRegister (o))
+                op = c_setInstanceGlobalOps [type];
+            else
+                op = Is64BitType (type) ? op_SetInstanceGlobal_s64 : op_SetInstanceGlobal_s32;
+        }
+        else if (IsStackTopInRegister (o))
         {
             op = c_setGlobalOps [type];
         }
         else op = Is64BitType (type) ? op_SetGlobal_s64 : op_SetGlobal_s32;
 
 _      (EmitOp (o, op));
-        EmitPointer (o, & i_global->intValue);
+        EmitGlobal (o, i_global);
 
         if (IsStackTopInSlot (o))
             EmitSlotOffset (o, GetStackTopSlotNumber (o));
@@ -1419,6 +1738,79 @@ _   (EmitOp (o, op_Branch));
     _catch: return result;
 }
 
+static inline
+bool  IsUnaryCompare  (m3opcode_t i_opcode)
+{
+    return (i_opcode == c_waOp_i32_eqz or i_opcode == c_waOp_i64_eqz);
+}
+
+// a compare that's directly followed by an 'if' or by a br_if that doesn't carry any values is deferred by
+// Compile_Operator. the branch then consumes the compare operands and emits a single fused op instead.
+static
+bool  IsFusableCompareBranch  (IM3Compilation o, m3opcode_t i_compareOpcode)
+{
+    if (i_compareOpcode < c_waOp_i32_eqz or i_compareOpcode > c_waOp_f64_ge)
+        return false;
+
+    if (IsStackPolymorphic (o) or o->wasm >= o->wasmEnd)
+        return false;
+
+    if (GetNumBlockValuesOnStack (o) < (IsUnaryCompare (i_compareOpcode) ? 1 : 2))
+        return false;
+
+    bytes_t wasm = o->wasm;
+    u8 opcode = * wasm++;
+
+    if (opcode == c_waOp_if)
+        return true;
+
+    if (opcode == c_waOp_branchIf)
+    {
+        u32 depth;
+        IM3CompilationScope scope;
+
+        if (ReadLEB_u32 (& depth, & wasm, o->wasmEnd) or GetBlockScope (o, & scope, depth))
+            return false;
+
+        if (scope->opcode == c_waOp_loop)
+            return (GetFuncTypeNumParams (scope->type) == 0);
+        else
+            return (scope->depth != 0 and GetFuncTypeNumResults (scope->type) == 0);
+    }
+
+    return false;
+}
+
+static
+M3Result  EmitCompareBranch  (IM3Compilation o, u32 i_branchKind)
+{
+_try {
+    m3opcode_t opcode = o->pendingOpcode;
+    o->pendingOpcode = 0;
+
+    const IM3Operation * ops = c_cmpBranchOps [opcode - c_waOp_i32_eqz] [i_branchKind];
+    bool isUnary = IsUnaryCompare (opcode);
+
+    IM3Operation op;
+
+    if (IsStackTopInRegister (o))
+        op = ops [0];                               // _r, _rs
+    else if (isUnary)
+        op = ops [1];                               // _s
+    else if (IsStackTopMinus1InRegister (o))
+        op = ops [1] ? ops [1] : ops [0];           // _sr; commutative compares just swap to _rs
+    else
+        op = ops [2];                               // _ss
+
+_   (EmitOp (o, op));
+_   (EmitSlotNumOfStackTopAndPop (o));
+
+    if (not isUnary)
+_       (EmitSlotNumOfStackTopAndPop (o));
+
+} _catch: return result;
+}
+
 static
 M3Result  Compile_Branch  (IM3Compilation o, m3opcode_t i_opcode)
 {
@@ -1430,6 +1822,8 @@ _   (ReadLEB_u32 (& depth, & o->wasm, o->wasmEnd));
     IM3CompilationScope scope;
 _   (GetBlockScope (o, & scope, depth));
 
+    LimitAssignedLocalsAtBranch (o, scope);
+
     // branch target is a loop (continue)
     if (scope->opcode == c_waOp_loop)
     {
@@ -1451,6 +1845,11 @@ _               (EmitOp (o, op_ContinueLoop));
 
                 * jumpTo = GetPC (o);
             }
+            else if (o->pendingOpcode)
+            {
+_               (EmitCompareBranch (o, c_cmpContinueLoopIf));
+                EmitPointer (o, scope->pc);
+            }
             else
             {
                 // move the condition to a register
@@ -1491,10 +1890,17 @@ _               (EmitOp (o, op_ContinueLoopIf));
             }
             else
             {
-                IM3Operation op = IsStackTopInRegister (o) ? op_BranchIf_r : op_BranchIf_s;
+                if (o->pendingOpcode)
+                {
+    _               (EmitCompareBranch (o, c_cmpBranchIf));
+                }
+                else
+                {
+                    IM3Operation op = IsStackTopInRegister (o) ? op_BranchIf_r : op_BranchIf_s;
 
-    _           (EmitOp (o, op));
-    _           (EmitSlotNumOfStackTopAndPop (o)); // condition
+    _               (EmitOp (o, op));
+    _               (EmitSlotNumOfStackTopAndPop (o)); // condition
+                }
 
                 EmitPatchingBranchPointer (o, scope);
                 goto _catch;
@@ -1560,6 +1966,8 @@ _       (ReadLEB_u32 (& target, & o->wasm, o->wasmEnd));
         IM3CompilationScope scope;
 _       (GetBlockScope (o, & scope, target));
 
+        LimitAssignedLocalsAtBranch (o, scope);
+
         // TODO: don't need codepage rigmarole for
         // no-param forward-branch targets
 
@@ -1620,6 +2028,10 @@ _try {
     // e.g. see Wasm spec test 'runaway' in call.wast
     topSlot = M3_MAX (1, topSlot);
 
+# if d_m3TrampolinedExecution
+    topSlot += c_callRecordSlots;
+# endif
+
     // stack frame is 64-bit aligned
     AlignSlotToType (& topSlot, c_m3Type_i64);
 
@@ -1654,6 +2066,23 @@ _       (Push (o, type, topSlot));
     } _catch: return result;
 }
 
+// a tail callee hands its results straight back to the caller's caller, so they must match the caller's
+static
+M3Result  ValidateTailCall  (IM3Compilation o, IM3FuncType i_type)
+{
+    M3Result result = m3Err_none;
+
+    IM3FuncType callerType = o->function->funcType;
+    u16 numResults = GetFuncTypeNumResults (i_type);
+
+    _throwif (m3Err_typeMismatch, numResults != GetFuncTypeNumResults (callerType));
+
+    for (u16 i = 0; i < numResults; ++i)
+        _throwif (m3Err_typeMismatch, GetFuncTypeResultType (i_type, i) != GetFuncTypeResultType (callerType, i));
+
+    _catch: return result;
+}
+
 static
 M3Result  Compile_Call  (IM3Compilation o, m3opcode_t i_opcode)
 {
@@ -1666,7 +2095,9 @@ _   (ReadLEB_u32 (& functionIndex, & o->wasm, o->wasmEnd));
     if (function)
     {                                                                   m3log (compile, d_indent " (func= [%d] '%s'; args= %d)",
                                                                                 get_indention_string (o), functionIndex, m3_GetFunctionName (function), function->funcType->numArgs);
-        if (function->module)
+        // a module that's still streaming in isn't loaded, so its imports can't have been linked yet; the calls are
+        // left to op_Compile. see m3_AppendModuleStream ()
+        if (function->module or not o->module->runtime)
         {
             u16 slotTop;
 _           (CompileCallArgsAndReturn (o, & slotTop, function->funcType, false));
@@ -1674,7 +2105,13 @@ _           (CompileCallArgsAndReturn (o, & slotTop, function->funcType, false))
             IM3Operation op;
             const void * operand;
 
-            if (function->compiled)
+            if (i_opcode == c_waOp_returnCall)
+            {
+_               (ValidateTailCall (o, function->funcType));
+                op = op_TailCall;
+                operand = function;
+            }
+            else if (not (o->deferCalls and function->wasm) and function->compiled)
             {
                 op = op_Call;
                 operand = function->compiled;
@@ -1686,8 +2123,14 @@ _           (CompileCallArgsAndReturn (o, & slotTop, function->funcType, false))
             }
 
 _           (EmitOp     (o, op));
-            EmitPointer (o, operand);
+            pc_t operandPC = EmitPointer (o, operand);
             EmitSlotOffset  (o, slotTop);
+
+            if (op == op_Compile and o->callSites and operandPC)
+_               (AddCallSite (o->callSites, operandPC));
+
+            if (i_opcode == c_waOp_returnCall)
+_               (SetStackPolymorphic (o));
         }
         else
         {
@@ -1720,13 +2163,21 @@ _       (PreserveRegisterIfOccupied (o, c_m3Type_i32));
     IM3FuncType type = o->module->funcTypes [typeIndex];
 _   (CompileCallArgsAndReturn (o, & execTop, type, true));
 
-_   (EmitOp         (o, op_CallIndirect));
+    bool isTailCall = (i_opcode == c_waOp_returnCallIndirect);
+
+    if (isTailCall)
+_       (ValidateTailCall (o, type));
+
+_   (EmitOp         (o, isTailCall ? op_TailCallIndirect : op_CallIndirect));
     EmitSlotOffset  (o, tableIndex);
     EmitSlotOffset  (o, tableIndexSlot);
-    EmitPointer     (o, o->module);
+    EmitPointer     (o, IsSharedCode (o) ? NULL : o->module);  // shared code uses the running instance's tables
     EmitPointer     (o, type);              // TODO: unify all types in M3Environment
     EmitSlotOffset  (o, execTop);
 
+    if (isTailCall)
+_       (SetStackPolymorphic (o));
+
 } _catch:
     return result;
 }
@@ -1935,13 +2386,32 @@ M3Result  Compile_If  (IM3Compilation o, m3opcode_t i_opcode)
 
 _try {
 
-_   (PreserveNonTopRegisters (o));
-_   (PreserveArgsAndLocals (o));
+    if (o->pendingOpcode)
+    {
+        // the fused op consumes the compare operands before entering the block, so they're
+        // hidden from the preservation of locals
+        u16 numOperands = IsUnaryCompare (o->pendingOpcode) ? 1 : 2;
+        u16 operandsIndex = o->stackIndex - numOperands;
 
-    IM3Operation op = IsStackTopInRegister (o) ? op_If_r : op_If_s;
+_       (PreserveRegistersBelow (o, operandsIndex));
 
-_   (EmitOp (o, op));
-_   (EmitSlotNumOfStackTopAndPop (o));
+        o->stackIndex = operandsIndex;
+        result = PreserveArgsAndLocals (o);
+        o->stackIndex += numOperands;
+_       (result);
+
+_       (EmitCompareBranch (o, c_cmpBranchIfFailed));
+    }
+    else
+    {
+_       (PreserveNonTopRegisters (o));
+_       (PreserveArgsAndLocals (o));
+
+        IM3Operation op = IsStackTopInRegister (o) ? op_If_r : op_If_s;
+
+_       (EmitOp (o, op));
+_       (EmitSlotNumOfStackTopAndPop (o));
+    }
 
     pc_t * pc = (pc_t *) ReservePointer (o);
 
@@ -2088,6 +2558,85 @@ _   (SetStackPolymorphic (o));
 }
 
 
+// an i32.add of a slot and a constant that's directly followed by a load is deferred; Compile_Load_Store
+// then emits a _si load that adds the constant to the slot value itself
+static
+bool  IsFusableAddressAdd  (IM3Compilation o, m3opcode_t i_opcode)
+{
+    if (i_opcode != c_waOp_i32_add or IsStackPolymorphic (o) or o->wasm >= o->wasmEnd)
+        return false;
+
+    u8 next = * o->wasm;
+
+    if (next < c_waOp_i32_load or next > c_waOp_i64_load32_u)
+        return false;
+
+#   if !d_m3HasFloat
+    if (next == c_waOp_f32_load or next == c_waOp_f64_load)
+        return false;
+#   endif
+
+    if (GetNumBlockValuesOnStack (o) < 2)
+        return false;
+
+    i16 top = GetStackTopIndex (o);
+    u16 topSlot = GetSlotForStackIndex (o, top);
+    u16 otherSlot = GetSlotForStackIndex (o, top - 1);
+
+    if (IsRegisterSlotAlias (topSlot) or IsRegisterSlotAlias (otherSlot))
+        return false;
+
+    return (IsConstantSlot (o, topSlot) or IsConstantSlot (o, otherSlot));
+}
+
+// a binary op with both operands in slots that's directly followed by local.set/tee is deferred;
+// Compile_SetLocal then emits its three-address form, which writes straight into the local
+static
+bool  IsFusableThreeAddressOp  (IM3Compilation o, IM3OpInfo i_opInfo)
+{
+    if (not i_opInfo->operations [3] or i_opInfo->stackOffset != -1 or i_opInfo->type == c_m3Type_none)
+        return false;
+
+    if (IsStackPolymorphic (o) or o->wasm >= o->wasmEnd)
+        return false;
+
+    u8 next = * o->wasm;
+
+    if (next != c_waOp_setLocal and next != c_waOp_teeLocal)
+        return false;
+
+    if (GetNumBlockValuesOnStack (o) < 2)
+        return false;
+
+    return (not IsStackTopInRegister (o) and not IsStackTopMinus1InRegister (o));
+}
+
+// the top operand is the constant deferred by Compile_Const_i32/i64
+static
+M3Result  EmitImmediateOperator  (IM3Compilation o, IM3OpInfo i_opInfo, m3opcode_t i_opcode)
+{
+_try {
+    u8 type = o->pendingImmediateType;
+    o->pendingImmediateType = c_m3Type_none;
+
+    bool inRegister = IsStackTopInRegister (o);
+
+    if (not inRegister)
+_       (PreserveRegisterIfOccupied (o, i_opInfo->type));
+
+_   (EmitOp (o, c_immediateOps [i_opcode - c_waOp_i32_eq] [inRegister ? 0 : 1]));
+_   (EmitSlotNumOfStackTopAndPop (o));
+
+    if (type == c_m3Type_i64)
+        EmitConstant64 (o, o->pendingImmediate);
+    else
+        EmitConstant32 (o, (u32) o->pendingImmediate);
+
+_   (PushRegister (o, i_opInfo->type));
+}
+    _catch: return result;
+}
+
 // OPTZ: currently all stack slot indices take up a full word, but
 // dual stack source operands could be packed together
 static
@@ -2098,6 +2647,15 @@ M3Result  Compile_Operator  (IM3Compilation o, m3opcode_t i_opcode)
     IM3OpInfo opInfo = GetOpInfo (i_opcode);
     _throwif (m3Err_unknownOpcode, not opInfo);
 
+    if (o->pendingImmediateType)
+        return EmitImmediateOperator (o, opInfo, i_opcode);
+
+    if (IsFusableCompareBranch (o, i_opcode) or IsFusableAddressAdd (o, i_opcode) or IsFusableThreeAddressOp (o, opInfo))
+    {
+        o->pendingOpcode = i_opcode;     // operands stay on the stack for the fused operation
+        return m3Err_none;
+    }
+
     IM3Operation op;
 
     // This preserve is for for FP compare operations.
@@ -2212,7 +2770,35 @@ _   (ReadLEB_u32 (& memoryOffset, & o->wasm, o->wasmEnd));
     if (IsFpType (opInfo->type))
 _       (PreserveRegisterIfOccupied (o, c_m3Type_f64));
 
-_   (Compile_Operator (o, i_opcode));
+    if (o->pendingOpcode == c_waOp_i32_add)
+    {
+        // address is (slot + constant); see IsFusableAddressAdd
+        o->pendingOpcode = 0;
+
+        i16 top = GetStackTopIndex (o);
+        u16 baseSlot = GetSlotForStackIndex (o, top - 1);
+        u16 constSlot = GetSlotForStackIndex (o, top);
+
+        if (not IsConstantSlot (o, constSlot))
+        {
+            constSlot = baseSlot;
+            baseSlot = GetSlotForStackIndex (o, top);
+        }
+
+        u32 addend = * (u32 *) & o->constants [constSlot - o->slotFirstConstIndex];
+
+_       (PreserveRegisterIfOccupied (o, opInfo->type));
+_       (Pop (o));
+_       (Pop (o));
+
+_       (EmitOp (o, opInfo->operations [2]));  // _si
+        EmitSlotOffset (o, baseSlot);
+        EmitConstant32 (o, addend);
+
+_       (PushRegister (o, opInfo->type));
+    }
+    else
+_       (Compile_Operator (o, i_opcode));
 
     EmitConstant32 (o, memoryOffset);
 }
@@ -2245,6 +2831,74 @@ M3Result  CompileRawFunction  (IM3Module io_module,  IM3Function io_function, co
 }
 
 
+M3Result  AddCallSite  (M3CallSites * io_sites, pc_t i_operand)
+{
+_try {
+    io_sites->calls = m3_ReallocArray (pc_t, io_sites->calls, io_sites->numCalls + 1, io_sites->numCalls);
+    _throwifnull (io_sites->calls);
+
+    io_sites->calls [io_sites->numCalls++] = i_operand;
+
+} _catch:
+    return result;
+}
+
+
+// turns the recorded op_Compile calls into op_Calls, as they'd rewrite themselves. every callee must be compiled
+void  ResolveCallSites  (M3CallSites * io_sites)
+{
+    for (u32 i = 0; i < io_sites->numCalls; ++i)
+    {
+        void ** operand = (void **) io_sites->calls [i];
+        IM3Function function = (IM3Function) * operand;
+
+        // an import linked later stays an op_Compile, which patches itself when it's first run
+        if (function->compiled)
+        {
+            * (operand - 1) = (void *) op_Call;
+            * operand = (void *) function->compiled;
+        }
+    }
+}
+
+
+# if d_m3CodeCache
+// makes the call whose operand is at i_operand an op_Compile again, which links its function when it's first run
+void  UnresolveCallSite  (pc_t i_operand, IM3Function i_function)
+{
+    void ** operand = (void **) i_operand;
+
+    * (operand - 1) = (void *) op_Compile;
+    * operand = i_function;
+}
+
+
+void  AddCodeWord  (M3CodeWords * io_words, pc_t i_word, bool i_isOp)
+{
+    u32 * count     = i_isOp ? & io_words->numOps : & io_words->numPointers;
+    u32 * capacity  = i_isOp ? & io_words->capacityOps : & io_words->capacityPointers;
+    pc_t ** words   = i_isOp ? & io_words->ops : & io_words->pointers;
+
+    if (* count == * capacity)
+    {
+        u32 newCapacity = * capacity ? * capacity * 2 : 1024;
+        pc_t * grown = m3_ReallocArray (pc_t, * words, newCapacity, * capacity);
+
+        if (not grown)
+        {
+            io_words->failed = true;
+            return;
+        }
+
+        * words = grown;
+        * capacity = newCapacity;
+    }
+
+    (* words) [(* count)++] = i_word;
+}
+# endif
+
+
 
 // d_logOp, d_logOp2 macros aren't actually used by the compiler, just codepage decoding (d_m3LogCodePages = 1)
 #define d_logOp(OP)                         { op_##OP,                  NULL,                       NULL,                       NULL }
@@ -2252,9 +2906,12 @@ M3Result  CompileRawFunction  (IM3Module io_module,  IM3Function io_function, co
 
 #define d_emptyOpList                       { NULL,                     NULL,                       NULL,                       NULL }
 #define d_unaryOpList(TYPE, NAME)           { op_##TYPE##_##NAME##_r,   op_##TYPE##_##NAME##_s,     NULL,                       NULL }
+#define d_loadOpList(TYPE, NAME)            { op_##TYPE##_##NAME##_r,   op_##TYPE##_##NAME##_s,     op_##TYPE##_##NAME##_si,    NULL }
 #define d_binOpList(TYPE, NAME)             { op_##TYPE##_##NAME##_rs,  op_##TYPE##_##NAME##_sr,    op_##TYPE##_##NAME##_ss,    NULL }
 #define d_storeFpOpList(TYPE, NAME)         { op_##TYPE##_##NAME##_rs,  op_##TYPE##_##NAME##_sr,    op_##TYPE##_##NAME##_ss,    op_##TYPE##_##NAME##_rr }
 #define d_commutativeBinOpList(TYPE, NAME)  { op_##TYPE##_##NAME##_rs,  NULL,                       op_##TYPE##_##NAME##_ss,    NULL }
+#define d_binOpList3(TYPE, NAME)            { op_##TYPE##_##NAME##_rs,  op_##TYPE##_##NAME##_sr,    op_##TYPE##_##NAME##_ss,    op_##TYPE##_##NAME##_s_ss }
+#define d_commutativeBinOpList3(TYPE, NAME) { op_##TYPE##_##NAME##_rs,  NULL,                       op_##TYPE##_##NAME##_ss,    op_##TYPE##_##NAME##_s_ss }
 #define d_convertOpList(OP)                 { op_##OP##_r_r,            op_##OP##_r_s,              op_##OP##_s_r,              op_##OP##_s_s }
 
 
@@ -2276,8 +2933,8 @@ const M3OpInfo c_operations [] =
     M3OP( "return",              0, any,    d_logOp (Return),                   Compile_Return ),       // 0x0f
     M3OP( "call",                0, any,    d_logOp (Call),                     Compile_Call ),         // 0x10
     M3OP( "call_indirect",       0, any,    d_logOp (CallIndirect),             Compile_CallIndirect ), // 0x11
-    M3OP( "return_call",         0, any,    d_emptyOpList,                      Compile_Call ),         // 0x12 TODO: Optimize
-    M3OP( "return_call_indirect",0, any,    d_emptyOpList,                      Compile_CallIndirect ), // 0x13
+    M3OP( "return_call",         0, any,    d_logOp (TailCall),                 Compile_Call ),         // 0x12
+    M3OP( "return_call_indirect",0, any,    d_logOp (TailCallIndirect),         Compile_CallIndirect ), // 0x13
 
     M3OP_RESERVED,  M3OP_RESERVED,                                                                      // 0x14...
     M3OP_RESERVED,  M3OP_RESERVED, M3OP_RESERVED, M3OP_RESERVED,                                        // ...0x19
@@ -2295,22 +2952,22 @@ const M3OpInfo c_operations [] =
 
     M3OP_RESERVED,  M3OP_RESERVED, M3OP_RESERVED,                                                       // 0x25...0x27
 
-    M3OP( "i32.load",           0,  i_32,   d_unaryOpList (i32, Load_i32),      Compile_Load_Store ),   // 0x28
-    M3OP( "i64.load",           0,  i_64,   d_unaryOpList (i64, Load_i64),      Compile_Load_Store ),   // 0x29
-    M3OP_F( "f32.load",         0,  f_32,   d_unaryOpList (f32, Load_f32),      Compile_Load_Store ),   // 0x2a
-    M3OP_F( "f64.load",         0,  f_64,   d_unaryOpList (f64, Load_f64),      Compile_Load_Store ),   // 0x2b
+    M3OP( "i32.load",           0,  i_32,   d_loadOpList (i32, Load_i32),      Compile_Load_Store ),   // 0x28
+    M3OP( "i64.load",           0,  i_64,   d_loadOpList (i64, Load_i64),      Compile_Load_Store ),   // 0x29
+    M3OP_F( "f32.load",         0,  f_32,   d_loadOpList (f32, Load_f32),      Compile_Load_Store ),   // 0x2a
+    M3OP_F( "f64.load",         0,  f_64,   d_loadOpList (f64, Load_f64),      Compile_Load_Store ),   // 0x2b
 
-    M3OP( "i32.load8_s",        0,  i_32,   d_unaryOpList (i32, Load_i8),       Compile_Load_Store ),   // 0x2c
-    M3OP( "i32.load8_u",        0,  i_32,   d_unaryOpList (i32, Load_u8),       Compile_Load_Store ),   // 0x2d
-    M3OP( "i32.load16_s",       0,  i_32,   d_unaryOpList (i32, Load_i16),      Compile_Load_Store ),   // 0x2e
-    M3OP( "i32.load16_u",       0,  i_32,   d_unaryOpList (i32, Load_u16),      Compile_Load_Store ),   // 0x2f
+    M3OP( "i32.load8_s",        0,  i_32,   d_loadOpList (i32, Load_i8),       Compile_Load_Store ),   // 0x2c
+    M3OP( "i32.load8_u",        0,  i_32,   d_loadOpList (i32, Load_u8),       Compile_Load_Store ),   // 0x2d
+    M3OP( "i32.load16_s",       0,  i_32,   d_loadOpList (i32, Load_i16),      Compile_Load_Store ),   // 0x2e
+    M3OP( "i32.load16_u",       0,  i_32,   d_loadOpList (i32, Load_u16),      Compile_Load_Store ),   // 0x2f
 
-    M3OP( "i64.load8_s",        0,  i_64,   d_unaryOpList (i64, Load_i8),       Compile_Load_Store ),   // 0x30
-    M3OP( "i64.load8_u",        0,  i_64,   d_unaryOpList (i64, Load_u8),       Compile_Load_Store ),   // 0x31
-    M3OP( "i64.load16_s",       0,  i_64,   d_unaryOpList (i64, Load_i16),      Compile_Load_Store ),   // 0x32
-    M3OP( "i64.load16_u",       0,  i_64,   d_unaryOpList (i64, Load_u16),      Compile_Load_Store ),   // 0x33
-    M3OP( "i64.load32_s",       0,  i_64,   d_unaryOpList (i64, Load_i32),      Compile_Load_Store ),   // 0x34
-    M3OP( "i64.load32_u",       0,  i_64,   d_unaryOpList (i64, Load_u32),      Compile_Load_Store ),   // 0x35
+    M3OP( "i64.load8_s",        0,  i_64,   d_loadOpList (i64, Load_i8),       Compile_Load_Store ),   // 0x30
+    M3OP( "i64.load8_u",        0,  i_64,   d_loadOpList (i64, Load_u8),       Compile_Load_Store ),   // 0x31
+    M3OP( "i64.load16_s",       0,  i_64,   d_loadOpList (i64, Load_i16),      Compile_Load_Store ),   // 0x32
+    M3OP( "i64.load16_u",       0,  i_64,   d_loadOpList (i64, Load_u16),      Compile_Load_Store ),   // 0x33
+    M3OP( "i64.load32_s",       0,  i_64,   d_loadOpList (i64, Load_i32),      Compile_Load_Store ),   // 0x34
+    M3OP( "i64.load32_u",       0,  i_64,   d_loadOpList (i64, Load_u32),      Compile_Load_Store ),   // 0x35
 
     M3OP( "i32.store",          -2, none,   d_binOpList (i32, Store_i32),       Compile_Load_Store ),   // 0x36
     M3OP( "i64.store",          -2, none,   d_binOpList (i64, Store_i64),       Compile_Load_Store ),   // 0x37
@@ -2374,19 +3031,19 @@ const M3OpInfo c_operations [] =
     M3OP( "i32.ctz",            0,  i_32,   d_unaryOpList (u32, Ctz)                , NULL  ),          // 0x68
     M3OP( "i32.popcnt",         0,  i_32,   d_unaryOpList (u32, Popcnt)             , NULL  ),          // 0x69
 
-    M3OP( "i32.add",            -1, i_32,   d_commutativeBinOpList (i32, Add)       , NULL  ),          // 0x6a
-    M3OP( "i32.sub",            -1, i_32,   d_binOpList (i32, Subtract)             , NULL  ),          // 0x6b
-    M3OP( "i32.mul",            -1, i_32,   d_commutativeBinOpList (i32, Multiply)  , NULL  ),          // 0x6c
+    M3OP( "i32.add",            -1, i_32,   d_commutativeBinOpList3 (i32, Add)      , NULL  ),          // 0x6a
+    M3OP( "i32.sub",            -1, i_32,   d_binOpList3 (i32, Subtract)            , NULL  ),          // 0x6b
+    M3OP( "i32.mul",            -1, i_32,   d_commutativeBinOpList3 (i32, Multiply) , NULL  ),          // 0x6c
     M3OP( "i32.div_s",          -1, i_32,   d_binOpList (i32, Divide)               , NULL  ),          // 0x6d
     M3OP( "i32.div_u",          -1, i_32,   d_binOpList (u32, Divide)               , NULL  ),          // 0x6e
     M3OP( "i32.rem_s",          -1, i_32,   d_binOpList (i32, Remainder)            , NULL  ),          // 0x6f
     M3OP( "i32.rem_u",          -1, i_32,   d_binOpList (u32, Remainder)            , NULL  ),          // 0x70
-    M3OP( "i32.and",            -1, i_32,   d_commutativeBinOpList (u32, And)       , NULL  ),          // 0x71
-    M3OP( "i32.or",             -1, i_32,   d_commutativeBinOpList (u32, Or)        , NULL  ),          // 0x72
-    M3OP( "i32.xor",            -1, i_32,   d_commutativeBinOpList (u32, Xor)       , NULL  ),          // 0x73
-    M3OP( "i32.shl",            -1, i_32,   d_binOpList (u32, ShiftLeft)            , NULL  ),          // 0x74
-    M3OP( "i32.shr_s",          -1, i_32,   d_binOpList (i32, ShiftRight)           , NULL  ),          // 0x75
-    M3OP( "i32.shr_u",          -1, i_32,   d_binOpList (u32, ShiftRight)           , NULL  ),          // 0x76
+    M3OP( "i32.and",            -1, i_32,   d_commutativeBinOpList3 (u32, And)      , NULL  ),          // 0x71
+    M3OP( "i32.or",             -1, i_32,   d_commutativeBinOpList3 (u32, Or)       , NULL  ),          // 0x72
+    M3OP( "i32.xor",            -1, i_32,   d_commutativeBinOpList3 (u32, Xor)      , NULL  ),          // 0x73
+    M3OP( "i32.shl",            -1, i_32,   d_binOpList3 (u32, ShiftLeft)           , NULL  ),          // 0x74
+    M3OP( "i32.shr_s",          -1, i_32,   d_binOpList3 (i32, ShiftRight)          , NULL  ),          // 0x75
+    M3OP( "i32.shr_u",          -1, i_32,   d_binOpList3 (u32, ShiftRight)          , NULL  ),          // 0x76
     M3OP( "i32.rotl",           -1, i_32,   d_binOpList (u32, Rotl)                 , NULL  ),          // 0x77
     M3OP( "i32.rotr",           -1, i_32,   d_binOpList (u32, Rotr)                 , NULL  ),          // 0x78
 
@@ -2394,19 +3051,19 @@ const M3OpInfo c_operations [] =
     M3OP( "i64.ctz",            0,  i_64,   d_unaryOpList (u64, Ctz)                , NULL  ),          // 0x7a
     M3OP( "i64.popcnt",         0,  i_64,   d_unaryOpList (u64, Popcnt)             , NULL  ),          // 0x7b
 
-    M3OP( "i64.add",            -1, i_64,   d_commutativeBinOpList (i64, Add)       , NULL  ),          // 0x7c
-    M3OP( "i64.sub",            -1, i_64,   d_binOpList (i64, Subtract)             , NULL  ),          // 0x7d
-    M3OP( "i64.mul",            -1, i_64,   d_commutativeBinOpList (i64, Multiply)  , NULL  ),          // 0x7e
+    M3OP( "i64.add",            -1, i_64,   d_commutativeBinOpList3 (i64, Add)      , NULL  ),          // 0x7c
+    M3OP( "i64.sub",            -1, i_64,   d_binOpList3 (i64, Subtract)            , NULL  ),          // 0x7d
+    M3OP( "i64.mul",            -1, i_64,   d_commutativeBinOpList3 (i64, Multiply) , NULL  ),          // 0x7e
     M3OP( "i64.div_s",          -1, i_64,   d_binOpList (i64, Divide)               , NULL  ),          // 0x7f
     M3OP( "i64.div_u",          -1, i_64,   d_binOpList (u64, Divide)               , NULL  ),          // 0x80
     M3OP( "i64.rem_s",          -1, i_64,   d_binOpList (i64, Remainder)            , NULL  ),          // 0x81
     M3OP( "i64.rem_u",          -1, i_64,   d_binOpList (u64, Remainder)            , NULL  ),          // 0x82
-    M3OP( "i64.and",            -1, i_64,   d_commutativeBinOpList (u64, And)       , NULL  ),          // 0x83
-    M3OP( "i64.or",             -1, i_64,   d_commutativeBinOpList (u64, Or)        , NULL  ),          // 0x84
-    M3OP( "i64.xor",            -1, i_64,   d_commutativeBinOpList (u64, Xor)       , NULL  ),          // 0x85
-    M3OP( "i64.shl",            -1, i_64,   d_binOpList (u64, ShiftLeft)            , NULL  ),          // 0x86
-    M3OP( "i64.shr_s",          -1, i_64,   d_binOpList (i64, ShiftRight)           , NULL  ),          // 0x87
-    M3OP( "i64.shr_u",          -1, i_64,   d_binOpList (u64, ShiftRight)           , NULL  ),          // 0x88
+    M3OP( "i64.and",            -1, i_64,   d_commutativeBinOpList3 (u64, And)      , NULL  ),          // 0x83
+    M3OP( "i64.or",             -1, i_64,   d_commutativeBinOpList3 (u64, Or)       , NULL  ),          // 0x84
+    M3OP( "i64.xor",            -1, i_64,   d_commutativeBinOpList3 (u64, Xor)      , NULL  ),          // 0x85
+    M3OP( "i64.shl",            -1, i_64,   d_binOpList3 (u64, ShiftLeft)           , NULL  ),          // 0x86
+    M3OP( "i64.shr_s",          -1, i_64,   d_binOpList3 (i64, ShiftRight)          , NULL  ),          // 0x87
+    M3OP( "i64.shr_u",          -1, i_64,   d_binOpList3 (u64, ShiftRight)          , NULL  ),          // 0x88
     M3OP( "i64.rotl",           -1, i_64,   d_binOpList (u64, Rotl)                 , NULL  ),          // 0x89
     M3OP( "i64.rotr",           -1, i_64,   d_binOpList (u64, Rotr)                 , NULL  ),          // 0x8a
 
@@ -2434,9 +3091,9 @@ const M3OpInfo c_operations [] =
     M3OP_F( "f64.nearest",      0,  f_64,   d_unaryOpList(f64, Nearest)             , NULL  ),          // 0x9e
     M3OP_F( "f64.sqrt",         0,  f_64,   d_unaryOpList(f64, Sqrt)                , NULL  ),          // 0x9f
 
-    M3OP_F( "f64.add",          -1, f_64,   d_commutativeBinOpList (f64, Add)       , NULL  ),          // 0xa0
+    M3OP_F( "f64.add",          -1, f_64,   d_commutativeBinOpList3 (f64, Add)      , NULL  ),          // 0xa0
     M3OP_F( "f64.sub",          -1, f_64,   d_binOpList (f64, Subtract)             , NULL  ),          // 0xa1
-    M3OP_F( "f64.mul",          -1, f_64,   d_commutativeBinOpList (f64, Multiply)  , NULL  ),          // 0xa2
+    M3OP_F( "f64.mul",          -1, f_64,   d_commutativeBinOpList3 (f64, Multiply) , NULL  ),          // 0xa2
     M3OP_F( "f64.div",          -1, f_64,   d_binOpList (f64, Divide)               , NULL  ),          // 0xa3
     M3OP_F( "f64.min",          -1, f_64,   d_commutativeBinOpList (f64, Min)       , NULL  ),          // 0xa4
     M3OP_F( "f64.max",          -1, f_64,   d_commutativeBinOpList (f64, Max)       , NULL  ),          // 0xa5
@@ -2490,7 +3147,7 @@ const M3OpInfo c_operations [] =
 #   define d_m3DebugTypedOp(OP) M3OP (#OP, 0, none, { op_##OP##_i32, op_##OP##_i64 })
 # endif
 
-    d_m3DebugOp (Compile),          d_m3DebugOp (Entry),            d_m3DebugOp (End),
+    d_m3DebugOp (Compile),          d_m3DebugOp (Entry),            d_m3DebugOp (Entry_LocalRanges),    d_m3DebugOp (End),
     d_m3DebugOp (Unsupported),      d_m3DebugOp (CallRawFunction),
 
     d_m3DebugOp (GetGlobal_s32),    d_m3DebugOp (GetGlobal_s64),    d_m3DebugOp (ContinueLoop),     d_m3DebugOp (ContinueLoopIf),
@@ -2513,6 +3170,9 @@ const M3OpInfo c_operations [] =
 
     d_m3DebugTypedOp (SetGlobal),   d_m3DebugOp (SetGlobal_s32),    d_m3DebugOp (SetGlobal_s64),
 
+    d_m3DebugOp (GetInstanceGlobal_s32),    d_m3DebugOp (GetInstanceGlobal_s64),
+    d_m3DebugTypedOp (SetInstanceGlobal),   d_m3DebugOp (SetInstanceGlobal_s32),    d_m3DebugOp (SetInstanceGlobal_s64),
+
     d_m3DebugTypedOp (SetRegister), d_m3DebugTypedOp (SetSlot),     d_m3DebugTypedOp (PreserveSetSlot),
 # endif
 
@@ -2566,6 +3226,121 @@ IM3OpInfo  GetOpInfo  (m3opcode_t opcode)
     return NULL;
 }
 
+
+# if d_m3CodeCache
+
+// the ops that are only emitted directly, not from the tables
+static const IM3Operation c_directOps [] =
+{
+    op_Entry,               op_Entry_LocalRanges,   op_Compile,             op_Call,                op_TailCall,
+    op_CallIndirect,        op_TailCallIndirect,    op_CallRawFunction,     op_Return,              op_End,
+    op_Unreachable,         op_Unsupported,         op_Branch,              op_BranchTable,         op_Loop,
+    op_ContinueLoop,        op_ContinueLoopIf,      op_If_r,                op_If_s,                op_BranchIf_r,
+    op_BranchIf_s,          op_BranchIfPrologue_r,  op_BranchIfPrologue_s,  op_Const32,             op_Const64,
+    op_CopySlot_32,         op_CopySlot_64,         op_PreserveCopySlot_32, op_PreserveCopySlot_64, op_MemSize,
+    op_MemGrow,             op_MemCopy,             op_MemFill,             op_GetGlobal_s32,       op_GetGlobal_s64,
+    op_SetGlobal_s32,       op_SetGlobal_s64,       op_GetInstanceGlobal_s32,   op_GetInstanceGlobal_s64,
+    op_SetInstanceGlobal_s32,   op_SetInstanceGlobal_s64,
+#   if d_m3EnableOpTracing
+    op_DumpStack,
+#   endif
+};
+
+# define d_m3MaxNumOps      4096
+
+// every op the compiler emits once, by address, from 1
+static IM3Operation         s_ops [d_m3MaxNumOps];
+static u32                  s_numOps = 1;
+
+static pthread_once_t       s_opsGathered = PTHREAD_ONCE_INIT;
+
+
+static
+void  GatherOps  (const IM3Operation * i_ops, u32 i_numOps)
+{
+    for (u32 i = 0; i < i_numOps; ++i)
+    {
+        if (i_ops [i] and s_numOps < d_m3MaxNumOps)
+            s_ops [s_numOps++] = i_ops [i];
+    }
+}
+
+
+static
+int  CompareOps  (const void * i_a, const void * i_b)
+{
+    uintptr_t a = (uintptr_t) * (const IM3Operation *) i_a;
+    uintptr_t b = (uintptr_t) * (const IM3Operation *) i_b;
+
+    return (a > b) - (a < b);
+}
+
+
+static
+void  GatherAllOps  (void)
+{
+    for (u32 i = 0; i < M3_COUNT_OF (c_operations); ++i)
+        GatherOps (c_operations [i].operations, 4);
+
+    for (u32 i = 0; i < M3_COUNT_OF (c_operationsFC); ++i)
+        GatherOps (c_operationsFC [i].operations, 4);
+
+    GatherOps (c_directOps,             M3_COUNT_OF (c_directOps));
+    GatherOps (c_preserveSetSlot,       M3_COUNT_OF (c_preserveSetSlot));
+    GatherOps (c_setSetOps,             M3_COUNT_OF (c_setSetOps));
+    GatherOps (c_setGlobalOps,          M3_COUNT_OF (c_setGlobalOps));
+    GatherOps (c_setInstanceGlobalOps,  M3_COUNT_OF (c_setInstanceGlobalOps));
+    GatherOps (c_setRegisterOps,        M3_COUNT_OF (c_setRegisterOps));
+    GatherOps (& c_intSelectOps [0][0], sizeof (c_intSelectOps) / sizeof (IM3Operation));
+#   if d_m3HasFloat
+    GatherOps (& c_fpSelectOps [0][0][0], sizeof (c_fpSelectOps) / sizeof (IM3Operation));
+#   endif
+    GatherOps (& c_cmpBranchOps [0][0][0], sizeof (c_cmpBranchOps) / sizeof (IM3Operation));
+    GatherOps (& c_immediateOps [0][0], sizeof (c_immediateOps) / sizeof (IM3Operation));
+                                                                        d_m3Assert (s_numOps < d_m3MaxNumOps);
+    qsort (& s_ops [1], s_numOps - 1, sizeof (IM3Operation), CompareOps);
+
+    u32 numUnique = 1;
+    for (u32 i = 1; i < s_numOps; ++i)
+    {
+        if (s_ops [i] != s_ops [numUnique - 1])
+            s_ops [numUnique++] = s_ops [i];
+    }
+
+    s_numOps = numUnique;
+}
+
+
+u32  GetNumOps  (void)
+{
+    pthread_once (& s_opsGathered, GatherAllOps);
+    return s_numOps;
+}
+
+
+IM3Operation  GetOpAtIndex  (u32 i_index)
+{
+    return (i_index < GetNumOps ()) ? s_ops [i_index] : NULL;
+}
+
+
+u32  GetOpIndex  (IM3Operation i_operation)
+{
+    const IM3Operation * found = bsearch (& i_operation, & s_ops [1], GetNumOps () - 1, sizeof (IM3Operation), CompareOps);
+
+    return found ? (u32) (found - s_ops) : 0;
+}
+
+
+// the ops are all compiled along with this file, so its build is the engine's
+cstr_t  GetCompilerBuildStamp  (void)
+{
+    return M3_VERSION " " __DATE__ " " __TIME__;
+}
+
+# endif // d_m3CodeCache
+
+
 M3Result  CompileBlockStatements  (IM3Compilation o)
 {
     M3Result result = m3Err_none;
@@ -2667,6 +3442,8 @@ M3Result  CompileBlock  (IM3Compilation o, IM3FuncType i_blockType, m3opcode_t i
     block->type             = i_blockType;
     block->depth            ++;
     block->opcode           = i_blockOpcode;
+    block->assignedLocalsStart = o->numAssignedLocals;
+    block->assignedLocalsLimit = 0xffff;     // no branches yet
 
     /*
      The block stack frame is a little strange but for good reasons.  Because blocks need to be restarted to
@@ -2757,6 +3534,13 @@ _           (PushBlockResults (o));
 
     PatchBranches (o);
 
+    // the first assignments made at this block's own level, before any branch to its end, still hold past it.
+    // an if's might not have happened at all
+    if (i_blockOpcode == c_waOp_block or i_blockOpcode == c_waOp_loop)
+        UnwindAssignedLocals (o, M3_MIN (o->numAssignedLocals, o->block.assignedLocalsLimit));
+    else
+        UnwindAssignedLocals (o, o->block.assignedLocalsStart);
+
     o->block = outerScope;
 
 }   _catch: return result;
@@ -2800,8 +3584,16 @@ M3Result  ReserveConstants  (IM3Compilation o)
     // that looks like an const opcode.
     u16 numConstantSlots = 0;
 
+#   if d_m3ConstantsInCodeStream
+    // a table only pays for its copy in op_Entry where its constants get reused, so only functions that may loop
+    // keep one. the same blind scan: a stray loop byte just keeps the table
+    bool reserveTable = memchr (o->wasm, c_waOp_loop, o->wasmEnd - o->wasm) != NULL;
+#   else
+    bool reserveTable = true;
+#   endif
+
     bytes_t wa = o->wasm;
-    while (wa < o->wasmEnd)
+    while (reserveTable and wa < o->wasmEnd)
     {
         u8 code = * wa++;
 
@@ -2817,6 +3609,7 @@ M3Result  ReserveConstants  (IM3Compilation o)
     // if constants overflow their reserved stack space, the compiler simply emits op_Const
     // operations as needed. Compiled expressions (global inits) don't pass through this
     // ReserveConstants function and thus always produce inline constants.
+    // with d_m3ConstantsInCodeStream that's every constant of a function without a loop.
 
     AlignSlotToType (& numConstantSlots, c_m3Type_i64);                                         m3log (compile, "reserved constant slots: %d", numConstantSlots);
 
@@ -2830,13 +3623,103 @@ M3Result  ReserveConstants  (IM3Compilation o)
 }
 
 
+// gathers the slots of the locals that can be read before they're set into ranges. when those don't cover
+// all of the locals, the function's op_Entry is swapped for op_Entry_LocalRanges, which zeroes just them.
+// o_ranges can be null to only count the ranges
+static
+u16  GetLocalInitRanges  (IM3Compilation o, u16 * o_ranges)
+{
+    u16 numRanges = 0;
+    u16 rangeFirst = 0, rangeEnd = 0;
+
+    u16 firstLocal = GetFunctionNumArgs (o->function);
+    u16 endLocal = firstLocal + o->function->numLocals;
+
+    for (u16 i = firstLocal; i < endLocal; ++i)
+    {
+        if (not (o->localInitFlags [i] & c_localReadBeforeSet))
+            continue;
+
+        u16 first = o->wasmStack [i] - o->slotFirstLocalIndex;
+        u16 end = first + GetTypeNumSlots (o->typeStack [i]);
+
+        // locals aren't necessarily in slot order; a 32-bit local can fill the alignment gap before a 64-bit one.
+        // zeroing a gap slot is harmless, so a range can grow across one
+        if (numRanges and first >= rangeFirst and end <= rangeEnd)
+            continue;
+
+        if (numRanges and first >= rangeFirst and first <= rangeEnd + 1)
+        {
+            rangeEnd = M3_MAX (end, rangeEnd);
+        }
+        else
+        {
+            ++numRanges;
+            rangeFirst = first;
+            rangeEnd = end;
+        }
+
+        if (o_ranges)
+        {
+            o_ranges [(numRanges - 1) * 2] = rangeFirst;
+            o_ranges [(numRanges - 1) * 2 + 1] = rangeEnd - rangeFirst;
+        }
+    }
+
+    return numRanges;
+}
+
+static
+M3Result  ResolveLocalInitRanges  (IM3Compilation o, pc_t i_entryPC)
+{
+    M3Result result = m3Err_none;
+
+    IM3Function function = o->function;
+    u16 numLocalSlots = function->numLocalBytes / sizeof (m3slot_t);
+
+    if (numLocalSlots == 0)
+        return result;
+
+    u16 numRanges = GetLocalInitRanges (o, NULL);
+
+    if (numRanges == 1)
+    {
+        u16 range [2];
+        GetLocalInitRanges (o, range);
+
+        if (range [0] == 0 and range [1] >= numLocalSlots)
+            return result;  // everything; the plain op_Entry does it with a memset
+    }
+
+    if (numRanges)
+    {
+        function->localInitRanges = m3_AllocArray (u16, numRanges * 2);
+        _throwifnull (function->localInitRanges);
+
+        GetLocalInitRanges (o, function->localInitRanges);
+    }
+
+    function->numLocalInitRanges = numRanges;                                                       m3log (compile, "local init ranges: %d", (u32) numRanges);
+    * (IM3Operation *) i_entryPC = op_Entry_LocalRanges;
+
+    _catch: return result;
+}
+
 M3Result  CompileFunction  (IM3Function io_function)
+{
+    return CompileFunctionOn (io_function->module->runtime, io_function, NULL);
+}
+
+
+// compiles with io_runtime's compilation state and code pages, which needn't be the module's. with io_deferredCalls,
+// every call to wasm code is left to an op_Compile and recorded there
+M3Result  CompileFunctionOn  (IM3Runtime io_runtime, IM3Function io_function, M3CallSites * io_deferredCalls)
 {
     if (!io_function->wasm) return "function body is missing";
 
     IM3FuncType funcType = io_function->funcType;                   m3log (compile, "compiling: [%d] %s %s; wasm-size: %d",
                                                                         io_function->index, m3_GetFunctionName (io_function), SPrintFuncTypeSignature (funcType), (u32) (io_function->wasmEnd - io_function->wasm));
-    IM3Runtime runtime = io_function->module->runtime;
+    IM3Runtime runtime = io_runtime;
 
     IM3Compilation o = & runtime->compilation;                      d_m3Assert (d_m3MaxFunctionSlots >= d_m3MaxFunctionStackHeight * (d_m3Use32BitSlots + 1))  // need twice as many slots in 32-bit mode
     memset (o, 0x0, sizeof (M3Compilation));
@@ -2848,6 +3731,11 @@ M3Result  CompileFunction  (IM3Function io_function)
     o->wasmEnd  = io_function->wasmEnd;
     o->block.type = funcType;
 
+    // shared code is never rewritten while it runs; m3_NewCompiledModule () resolves its calls up front
+    o->deferCalls = (io_deferredCalls != NULL);
+    o->callSites = io_deferredCalls ? io_deferredCalls : (o->module->compiled ? & o->module->compiled->calls : NULL);
+    o->codeWords = runtime->codeWords;
+
 _try {
     // skip over code size. the end was already calculated during parse phase
     u32 size;
@@ -2872,6 +3760,8 @@ _   (AcquireCompilationCodePage (o, & o->page));
         u8 type = GetFunctionArgType (o->function, i);
 _       (PushAllocatedSlot (o, type));
 
+        o->localInitFlags [i] = c_localAssigned;
+
         // prevent allocator fill-in
         o->slotFirstDynamicIndex += c_ioSlotCount;
     }
@@ -2902,6 +3792,8 @@ _   (CompileBlockStatements (o));
     // TODO: validate opcode sequences
     _throwif(m3Err_wasmMalformed, o->previousOpcode != c_waOp_end);
 
+_   (ResolveLocalInitRanges (o, pc));
+
     io_function->compiled = pc;
     io_function->maxStackSlots = o->maxStackSlots;
 
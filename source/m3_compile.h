@@ -25,12 +25,19 @@ enum
     c_waOp_branchTable          = 0x0e,
     c_waOp_branchIf             = 0x0d,
     c_waOp_call                 = 0x10,
+    c_waOp_returnCall           = 0x12,
+    c_waOp_returnCallIndirect   = 0x13,
     c_waOp_getLocal             = 0x20,
     c_waOp_setLocal             = 0x21,
     c_waOp_teeLocal             = 0x22,
 
     c_waOp_getGlobal            = 0x23,
 
+    c_waOp_i32_load             = 0x28,
+    c_waOp_f32_load             = 0x2a,
+    c_waOp_f64_load             = 0x2b,
+    c_waOp_i64_load32_u         = 0x35,
+
     c_waOp_store_f32            = 0x38,
     c_waOp_store_f64            = 0x39,
 
@@ -39,6 +46,15 @@ enum
     c_waOp_f32_const            = 0x43,
     c_waOp_f64_const            = 0x44,
 
+    c_waOp_i32_eqz              = 0x45,
+    c_waOp_i32_eq               = 0x46,
+    c_waOp_i64_eqz              = 0x50,
+    c_waOp_f32_eq               = 0x5b,
+    c_waOp_f64_ge               = 0x66,
+
+    c_waOp_i32_add              = 0x6a,
+    c_waOp_i64_clz              = 0x79,
+
     c_waOp_extended             = 0xfc,
 
     c_waOp_memoryCopy           = 0xfc0a,
@@ -64,11 +80,33 @@ typedef struct M3CompilationScope
     IM3FuncType                     type;
     m3opcode_t                      opcode;
     bool                            isPolymorphic;
+
+    u16                             assignedLocalsStart;    // M3Compilation.numAssignedLocals when the block began
+    u16                             assignedLocalsLimit;    // ... when the first branch to the block's end was taken
 }
 M3CompilationScope;
 
 typedef M3CompilationScope *        IM3CompilationScope;
 
+// the operands of op_Compile calls, which ResolveCallSites () turns into op_Calls once every callee is compiled
+typedef struct M3CallSites
+{
+    u32                 numCalls;
+    pc_t *              calls;
+}
+M3CallSites;
+
+// the code words that hold ops and pointers, which m3_cache.c relocates. the rest are position independent
+typedef struct M3CodeWords
+{
+    u32                 numOps,         capacityOps;
+    u32                 numPointers,    capacityPointers;
+    pc_t *              ops;
+    pc_t *              pointers;
+    bool                failed;         // an allocation did; the words aren't all here
+}
+M3CodeWords;
+
 typedef struct
 {
     IM3Runtime          runtime;
@@ -115,6 +153,19 @@ typedef struct
     u16                 regStackIndexPlusOne        [2];
 
     m3opcode_t          previousOpcode;
+    m3opcode_t          pendingOpcode;              // an operation deferred by Compile_Operator, so that it can be fused with the following one
+
+    u8                  pendingImmediateType;       // a deferred i32/i64.const that the following operator takes as an immediate
+    u64                 pendingImmediate;
+
+    // definite assignment of locals: a local that can be read before it's set must be zeroed by op_Entry
+    u8                  localInitFlags              [d_m3MaxFunctionStackHeight];
+    u16                 assignedLocals              [d_m3MaxFunctionStackHeight];   // first assignments, unwound at the end of their block
+    u16                 numAssignedLocals;
+
+    M3CallSites *       callSites;                  // op_Compile calls that mustn't rewrite themselves are recorded here; see ResolveCallSites ()
+    bool                deferCalls;                 // other threads are compiling the module, so no call to wasm code can be resolved yet
+    M3CodeWords *       codeWords;                  // for the code cache; see M3Runtime.codeWords
 }
 M3Compilation;
 
@@ -136,7 +187,8 @@ typedef struct M3OpInfo
     u8                      type;
 
     // for most operations:
-    // [0]= top operand in register, [1]= top operand in stack, [2]= both operands in stack
+    // [0]= top operand in register, [1]= top operand in stack, [2]= both operands in stack,
+    // [3]= both operands in stack with the result written to a local slot (or both in registers for fp.store)
     IM3Operation            operations [4];
 
     M3Compiler              compiler;
@@ -156,6 +208,12 @@ u8 GetSingleRetType(IM3FuncType ftype) {
 static const u16 c_m3RegisterUnallocated = 0;
 static const u16 c_slotUnused = 0xffff;
 
+// all args & returns are 64-bit aligned, so use 2 slots for a d_m3Use32BitSlots=1 build
+static const u16 c_ioSlotCount = sizeof (u64) / sizeof (m3slot_t);
+
+// d_m3TrampolinedExecution: room for the M3CallRecord that op_Call leaves below the callee's frame
+static const u16 c_callRecordSlots = 4 * c_ioSlotCount;
+
 static inline
 bool  IsRegisterAllocated  (IM3Compilation o, u32 i_register)
 {
@@ -198,8 +256,21 @@ M3Result    CompileBlock                (IM3Compilation io, IM3FuncType i_blockT
 
 M3Result    CompileBlockStatements      (IM3Compilation io);
 M3Result    CompileFunction             (IM3Function io_function);
+M3Result    CompileFunctionOn           (IM3Runtime io_runtime, IM3Function io_function, M3CallSites * io_deferredCalls);
 
 M3Result    CompileRawFunction          (IM3Module io_module, IM3Function io_function, const void * i_function, const void * i_userdata);
+M3Result    AddCallSite                 (M3CallSites * io_sites, pc_t i_operand);
+void        ResolveCallSites            (M3CallSites * io_sites);
+
+# if d_m3CodeCache
+void        UnresolveCallSite           (pc_t i_operand, IM3Function i_function);
+void        AddCodeWord                 (M3CodeWords * io_words, pc_t i_word, bool i_isOp);
+
+u32         GetNumOps                   (void);
+IM3Operation GetOpAtIndex               (u32 i_index);
+u32         GetOpIndex                  (IM3Operation i_operation);      // 0 if it isn't an op the compiler emits
+cstr_t      GetCompilerBuildStamp       (void);
+# endif
 
 d_m3EndExternC
 
@@ -36,6 +36,50 @@
 #   define d_m3MaxConstantTableSize             120
 # endif
 
+# ifndef d_m3ConstantsInCodeStream                      // Constants are read from the code stream (as immediates or op_Const) instead of
+#   define d_m3ConstantsInCodeStream            0       // a constant table that op_Entry copies into every frame. Cheaper calls, more ops
+# endif
+
+# ifndef d_m3TrampolinedExecution                       // Calls, returns and loop iterations go back through a loop in RunCode () instead of
+#   define d_m3TrampolinedExecution             0       // recursing on the native stack. Native stack use no longer grows with call depth
+# endif
+
+# ifndef d_m3UseDispatchLoop                            // Every op hands its successor back to that loop too, instead of tail-calling it. A
+#   define d_m3UseDispatchLoop                  0       // fallback for toolchains without sibling-call optimization, about 3x slower where they
+# endif                                                 // have it. Needs the above
+
+# if d_m3UseDispatchLoop && !d_m3TrampolinedExecution
+#   error "d_m3UseDispatchLoop requires d_m3TrampolinedExecution"
+# endif
+
+# ifndef d_m3UseReservedMemory                          // Linear memory is an address space reservation for its maximum size, and memory.grow
+#   if defined(__linux__) && defined(__LP64__) && !defined(__ANDROID__)
+#     define d_m3UseReservedMemory              1       // makes more of it accessible in place: nothing is copied and the memory doesn't move
+#   else
+#     define d_m3UseReservedMemory              0
+#   endif
+# endif
+
+# ifndef d_m3UseGuardPages                              // The reservation covers every address a load or store can form, with the unused part
+#   define d_m3UseGuardPages                    0       // inaccessible. Loads and stores aren't bounds checked; a SIGSEGV handler turns the
+# endif                                                 // faults into traps. 64-bit Linux only
+
+# if d_m3UseGuardPages && !(defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__)))
+#   error "d_m3UseGuardPages is only supported on x86-64 and AArch64 Linux"
+# endif
+
+# if d_m3UseGuardPages && !d_m3UseReservedMemory
+#   error "d_m3UseGuardPages requires d_m3UseReservedMemory"
+# endif
+
+# ifndef d_m3UseIndexMasking                            // The memory's capacity is rounded up to a power of two, and loads and stores mask their
+#   define d_m3UseIndexMasking                  0       // address with it instead of checking it. Out of bounds accesses wrap around instead of
+# endif                                                 // trapping, but can't leave the memory. For hosts without guard pages
+
+# if d_m3UseIndexMasking && d_m3UseGuardPages
+#   error "d_m3UseIndexMasking and d_m3UseGuardPages are exclusive"
+# endif
+
 # ifndef d_m3MaxDuplicateFunctionImpl
 #   define d_m3MaxDuplicateFunctionImpl         10
 # endif
@@ -57,6 +101,22 @@
 #   define d_m3FixedHeapAlign                   16
 # endif
 
+# ifndef d_m3ParallelCompilation                        // m3_CompileModuleInParallel () compiles on a pool of pthreads. Without it, it compiles
+#   if defined(__linux__) || defined(__APPLE__)         // on the calling thread. Needs a thread-safe heap, which d_m3FixedHeap isn't
+#     define d_m3ParallelCompilation            1
+#   else
+#     define d_m3ParallelCompilation            0
+#   endif
+# endif
+
+# ifndef d_m3CodeCache                                  // m3_SetCodeCacheDirectory (): compiled code is written to files that later runs
+#   if (defined(__linux__) || defined(__APPLE__)) && !d_m3EnableCodePageRefCounting
+#     define d_m3CodeCache                      1       // read back instead of compiling. Not with d_m3EnableCodePageRefCounting
+#   else
+#     define d_m3CodeCache                      0
+#   endif
+# endif
+
 # ifndef d_m3Use32BitSlots
 #   define d_m3Use32BitSlots                    1
 # endif
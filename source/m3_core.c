@@ -517,9 +517,29 @@ M3Result  Read_utf8  (cstr_t * o_utf8, bytes_t * io_bytes, cbytes_t i_end)
     return result;
 }
 
+// FNV-1a. for the hash tables of names; see M3NameIndex
+u32  HashName  (cstr_t i_name)
+{
+    u32 hash = 2166136261u;
+
+    for (const u8 * c = (const u8 *) i_name; * c; ++c)
+        hash = (hash ^ * c) * 16777619u;
+
+    return hash;
+}
+
 #if d_m3RecordBacktraces
 u32  FindModuleOffset  (IM3Runtime i_runtime, pc_t i_pc)
 {
+    // an instance of a compiled module runs the compiled module's code
+    if (i_runtime->codeRuntime)
+    {
+        u32 offset = FindModuleOffset (i_runtime->codeRuntime, i_pc);
+
+        if (offset)
+            return offset;
+    }
+
     // walk the code pages
     IM3CodePage curr = i_runtime->pagesOpen;
     bool pageFound = false;
@@ -134,6 +134,22 @@ typedef struct M3MemoryHeader
     IM3Runtime      runtime;
     void *          maxStack;
     size_t          length;
+    IM3Module       instance;       // set on runtimes instantiated from a compiled module; see m3_InstantiateModule ()
+    IM3Global       globals;        // the instance's globals, which the shared code indexes
+#if d_m3UseIndexMasking
+    size_t          mask;           // capacity - 1; see MaskedMemorySize () in m3_env.c
+#endif
+#if d_m3UseGuardPages && d_m3RecordBacktraces
+    pc_t            accessPC;       // the last op to touch the memory; see HandleGuardPageFault () in m3_env.c
+#endif
+#if d_m3TrampolinedExecution
+    pc_t            resumePC;       // where RunCode () continues; see d_m3TrampolinedExecution in m3_exec_defs.h
+    m3stack_t       resumeSP;
+#endif
+#if d_m3UseDispatchLoop
+    m3reg_t         resumeR0;
+    f64             resumeFP0;
+#endif
 }
 M3MemoryHeader;
 
@@ -301,12 +317,15 @@ M3Result    ReadLEB_i32             (i32 * o_value, bytes_t * io_bytes, cbytes_t
 M3Result    ReadLEB_i64             (i64 * o_value, bytes_t * io_bytes, cbytes_t i_end);
 M3Result    Read_utf8               (cstr_t * o_utf8, bytes_t * io_bytes, cbytes_t i_end);
 
+u32         HashName                (cstr_t i_name);
+
 cstr_t      SPrintValue             (void * i_value, u8 i_type);
 size_t      SPrintArg               (char * o_string, size_t i_stringBufferSize, voidptr_t i_sp, u8 i_type);
 
 void        ReportError             (IM3Runtime io_runtime, IM3Module i_module, IM3Function i_function, ccstr_t i_errorMessage, ccstr_t i_file, u32 i_lineNum);
 
 # if d_m3RecordBacktraces
+u32         FindModuleOffset           (IM3Runtime i_runtime, pc_t i_pc);
 void        PushBacktraceFrame         (IM3Runtime io_runtime, pc_t i_pc);
 void        FillBacktraceFunctionInfo  (IM3Runtime io_runtime, IM3Function i_function);
 void        ClearBacktrace             (IM3Runtime io_runtime);
@@ -5,6 +5,10 @@
 //  Copyright © 2019 Steven Massey. All rights reserved.
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE      // for the mmap () and madvise () flags used with d_m3UseReservedMemory
+#endif
+
 #include <stdarg.h>
 #include <limits.h>
 
@@ -13,6 +17,24 @@
 #include "m3_exception.h"
 #include "m3_info.h"
 
+#if d_m3UseReservedMemory
+#   include <signal.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <sys/syscall.h>
+#   include <sched.h>
+#   include <unistd.h>
+#endif
+
+#if d_m3UseGuardPages
+#   include <setjmp.h>
+#endif
+
+#if d_m3ParallelCompilation
+#   include <pthread.h>
+#   include <unistd.h>
+#endif
+
 
 IM3Environment  m3_NewEnvironment  ()
 {
@@ -64,6 +86,8 @@ void  Environment_Release  (IM3Environment i_environment)
 
     m3log (runtime, "freeing %d pages from environment", CountCodePages (i_environment->pagesReleased));
     FreeCodePages (& i_environment->pagesReleased);
+
+    m3_Free (i_environment->codeCacheDirectory);
 }
 
 
@@ -83,6 +107,29 @@ void m3_SetCustomSectionHandler  (IM3Environment i_environment, M3SectionHandler
 }
 
 
+M3Result  m3_SetCodeCacheDirectory  (IM3Environment i_environment, const char * i_directory)
+{
+#if d_m3CodeCache
+    cstr_t directory = NULL;
+
+    if (i_directory)
+    {
+        directory = m3_CopyMem (i_directory, strlen (i_directory) + 1);
+        if (not directory)
+            return m3Err_mallocFailed;
+    }
+
+    m3_Free (i_environment->codeCacheDirectory);
+    i_environment->codeCacheDirectory = directory;
+
+    return m3Err_none;
+#else
+    (void) i_environment; (void) i_directory;
+    return "the code cache isn't built in (d_m3CodeCache)";
+#endif
+}
+
+
 // returns the same io_funcType or replaces it with an equivalent that's already in the type linked list
 void  Environment_AddFuncType  (IM3Environment i_environment, IM3FuncType * io_funcType)
 {
@@ -210,6 +257,26 @@ void m3_SetMemToGrowCallback(IM3Runtime i_runtime, IM3MemToGrowCallback memToGro
     i_runtime->memory.memToGrowCallback = memToGrowCallback;
 }
 
+M3Result  m3_SetMemoryBacking  (IM3Runtime i_runtime, M3MemoryBacking i_backing)
+{
+    M3Result result = m3Err_none;
+
+    _throwif ("unknown memory backing", (u32) i_backing > c_m3MemoryBacking_prefault);
+
+#if d_m3UseReservedMemory
+    _throwif ("the memory is already allocated", i_runtime->memory.mallocated->dataBuffer);
+#   if d_m3UseGuardPages
+    // memory.grow commits whole huge pages, so a guard fault would come late
+    _throwif ("huge TLB pages need memory bounds checks", i_backing == c_m3MemoryBacking_hugeTLB);
+#   endif
+    i_runtime->memory.backing = i_backing;
+#else
+    _throwif ("memory backings need d_m3UseReservedMemory", i_backing != c_m3MemoryBacking_default);
+#endif
+
+    _catch: return result;
+}
+
 void *  ForEachModule  (IM3Runtime i_runtime, ModuleVisitor i_visitor, void * i_info)
 {
     void * r = NULL;
@@ -237,247 +304,1803 @@ void *  _FreeModule  (IM3Module i_module, void * i_info)
 }
 
 
-void  Runtime_Release  (IM3Runtime i_runtime)
-{
-    ForEachModule (i_runtime, _FreeModule, NULL);                   d_m3Assert (i_runtime->numActiveCodePages == 0);
+#if d_m3UseGuardPages
 
-    Environment_ReleaseCodePages (i_runtime->environment, i_runtime->pagesOpen);
-    Environment_ReleaseCodePages (i_runtime->environment, i_runtime->pagesFull);
+// a load or store address is a u32 plus a u32 offset, so nothing it can touch lies past this
+static const size_t c_m3GuardedMemorySize = ((size_t) 1 << 33) + d_m3MemPageSize;
 
-    m3_Free (i_runtime->stack);
-    if (!i_runtime->memory.isImported
-        && (i_runtime->memory.mallocated && i_runtime->memory.mallocated->dataBuffer)) {
-        m3_Free (i_runtime->memory.mallocated->dataBuffer);
-    }
-    m3_Free(i_runtime->memory.mallocated);
+// each m3_Call () leaves one of these for the fault handler; host functions can call back into wasm
+typedef struct M3GuardedCall
+{
+    struct M3GuardedCall *  previous;
+    IM3Runtime              runtime;
+    pc_t                    faultPC;
+    sigjmp_buf              onFault;
 }
+M3GuardedCall;
 
+static __thread M3GuardedCall *     s_guardedCall       = NULL;
 
-void  m3_FreeRuntime  (IM3Runtime i_runtime)
+
+#   if d_m3RecordBacktraces
+static
+IM3Function  FindFunctionAt  (IM3Runtime i_runtime, u32 i_moduleOffset)
 {
-    if (i_runtime)
+    for (IM3Module module = i_runtime->modules; module; module = module->next)
     {
-        m3_PrintProfilerInfo ();
+        bytes_t wasm = module->wasmStart + i_moduleOffset;
 
-        Runtime_Release (i_runtime);
-        m3_Free (i_runtime);
+        for (u32 i = 0; i < module->numFunctions; ++i)
+        {
+            IM3Function function = & module->functions [i];
+
+            if (function->wasm and wasm >= function->wasm and wasm < function->wasmEnd)
+                return function;
+        }
     }
+
+    return NULL;
 }
+#   endif // d_m3RecordBacktraces
 
-M3Result  EvaluateExpression  (IM3Module i_module, void * o_expressed, u8 i_type, bytes_t * io_bytes, cbytes_t i_end)
+
+// jumps out of the wasm access unless the fault is outside the memory
+static
+void  HandleGuardPageFault  (siginfo_t * i_info)
 {
-    M3Result result = m3Err_none;
+    M3GuardedCall * call = s_guardedCall;
 
-    // OPTZ: use a simplified interpreter for expressions
+    if (call)
+    {
+        u8 * base = call->runtime->memory.mallocated->dataBuffer;
+        u8 * fault = (u8 *) i_info->si_addr;
 
-    // create a temporary runtime context
-#if defined(d_m3PreferStaticAlloc)
-    static M3Runtime runtime;
-#else
-    M3Runtime runtime;
-#endif
-    M3_INIT (runtime);
+        if (base and fault >= base and fault < base + c_m3GuardedMemorySize)
+        {
+#   if d_m3RecordBacktraces
+            call->faultPC = call->runtime->memory.mallocated->header.accessPC;
+#   endif
+            siglongjmp (call->onFault, 1);
+        }
+    }
+}
 
-    runtime.environment = i_module->runtime->environment;
-    runtime.numStackSlots = i_module->runtime->numStackSlots;
-    runtime.stack = i_module->runtime->stack;
 
-    m3stack_t stack = (m3stack_t)runtime.stack;
+#endif // d_m3UseGuardPages
 
-    IM3Runtime savedRuntime = i_module->runtime;
-    i_module->runtime = & runtime;
 
-    IM3Compilation o = & runtime.compilation;
-    o->runtime = & runtime;
-    o->module =  i_module;
-    o->wasm =    * io_bytes;
-    o->wasmEnd = i_end;
-    o->lastOpcodeStart = o->wasm;
+#if d_m3UseIndexMasking
 
-    o->block.depth = -1;  // so that root compilation depth = 0
+// the widest load or store can start at the last masked address
+static const size_t c_m3IndexMaskSlack = sizeof (u64);
 
-    //  OPTZ: this code page could be erased after use.  maybe have 'empty' list in addition to full and open?
-    o->page = AcquireCodePage (& runtime);  // AcquireUnusedCodePage (...)
+// the capacity loads and stores wrap around in: the length, rounded up to a power of two
+static
+size_t  MaskedMemorySize  (size_t i_length)
+{
+    size_t capacity = 1;
 
-    if (o->page)
-    {
-        IM3FuncType ftype = runtime.environment->retFuncTypes[i_type];
+    while (capacity < i_length)
+        capacity <<= 1;
 
-        pc_t m3code = GetPagePC (o->page);
-        result = CompileBlock (o, ftype, c_waOp_block);
+    return capacity;
+}
 
-        if (not result && o->maxStackSlots >= runtime.numStackSlots) {
-            result = m3Err_trapStackOverflow;
-        }
+#endif
 
-        if (not result)
-        {
-            m3ret_t r = RunCode (m3code, stack, NULL, d_m3OpDefaultArgs);
 
-            if (r == 0)
-            {                                                                               m3log (runtime, "expression result: %s", SPrintValue (stack, i_type));
-                if (SizeOfType (i_type) == sizeof (u32))
-                {
-                    * (u32 *) o_expressed = * ((u32 *) stack);
-                }
-                else
-                {
-                    * (u64 *) o_expressed = * ((u64 *) stack);
-                }
-            }
-        }
+// the bytes behind a memory of i_length
+static
+size_t  AllocatedMemorySize  (size_t i_length)
+{
+#if d_m3UseIndexMasking
+    return MaskedMemorySize (i_length) + c_m3IndexMaskSlack;
+#else
+    return i_length;
+#endif
+}
 
-        // TODO: EraseCodePage (...) see OPTZ above
-        ReleaseCodePage (& runtime, o->page);
-    }
-    else result = m3Err_mallocFailedCodePage;
 
-    runtime.stack = NULL;        // prevent free(stack) in ReleaseRuntime
-    Runtime_Release (& runtime);
-    i_module->runtime = savedRuntime;
+#if d_m3UseReservedMemory
 
-    * io_bytes = o->wasm;
+static
+size_t  GetMemoryReservationSize  (size_t i_maxPages, size_t i_memoryLimit)
+{
+#   if d_m3UseGuardPages
+    return c_m3GuardedMemorySize;
+#   else
+    size_t numPages = i_maxPages;
+#       if d_m3MaxLinearMemoryPages > 0
+    numPages = M3_MIN (numPages, d_m3MaxLinearMemoryPages);
+#       endif
+    size_t numBytes = numPages * d_m3MemPageSize;
 
-    return result;
+    if (i_memoryLimit)
+        numBytes = M3_MIN (numBytes, i_memoryLimit);
+
+    return AllocatedMemorySize (numBytes);
+#   endif
 }
 
 
-M3Result  InitMemory  (IM3Runtime io_runtime, IM3Module i_module)
+static const size_t c_m3HugePageSize = 2 * 1024 * 1024;
+
+
+// huge pages need the reservation aligned to their size
+static
+u8 *  ReserveAddressSpace  (size_t i_numBytes, size_t i_alignment)
 {
-    M3Result result = m3Err_none;                                     //d_m3Assert (not io_runtime->memory.wasmPages);
+    u8 * base = mmap (NULL, i_numBytes + i_alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
 
-    if (not i_module->memoryImported)
+    if (base == MAP_FAILED)
+        return NULL;
+
+    if (i_alignment)
     {
-        u32 maxPages = i_module->memoryInfo.maxPages;
-        io_runtime->memory.maxPages = maxPages ? maxPages : 65536;
+        u8 * aligned = (u8 *) (((uintptr_t) base + i_alignment - 1) & ~(uintptr_t) (i_alignment - 1));
 
-        result = ResizeMemory (io_runtime, i_module->memoryInfo.initPages);
+        if (aligned > base)
+            munmap (base, aligned - base);
+
+        munmap (aligned + i_numBytes, base + i_alignment - aligned);
+        base = aligned;
     }
 
-    return result;
+    return base;
 }
 
 
-M3Result  ResizeMemory  (IM3Runtime io_runtime, u32 i_numPages)
+static
+void  PrefaultPages  (u8 * i_start, size_t i_numBytes, size_t i_pageSize)
 {
-    M3Result result = m3Err_none;
+#   ifdef MADV_POPULATE_WRITE
+    if (madvise (i_start, i_numBytes, MADV_POPULATE_WRITE) == 0)
+        return;
+#   endif
 
-    u32 numPagesToAlloc = i_numPages;
+    // older kernels; the pages are still zero
+    for (size_t i = 0; i < i_numBytes; i += i_pageSize)
+        ((volatile u8 *) i_start) [i] = 0;
+}
 
-    M3Memory * memory = & io_runtime->memory;
 
-#if 0 // Temporary fix for memory allocation
-    if (memory->mallocated) {
-        memory->numPages = i_numPages;
-        memory->mallocated->end = memory->wasmPages + (memory->numPages * c_m3MemPageSize);
-        return result;
-    }
+//---------------------------------------------------------------------------------------------------------------------------------
+//  dirty pages
+//---------------------------------------------------------------------------------------------------------------------------------
 
-    i_numPagesToAlloc = 256;
-#endif
+// with dirty page tracking, the clean pages of a memory are read-only. the first write to one faults, and
+// the fault handler marks it dirty and makes it writable. the handler walks these without a lock, so they're
+// reused instead of freed. an entry is published by storing its base last, and retired by clearing the base
+// first; its bits are only freed once no handler is still in the walk
+typedef struct M3DirtyPages
+{
+    struct M3DirtyPages *   next;
 
-    if (numPagesToAlloc <= memory->maxPages)
-    {
-        size_t numPageBytes = numPagesToAlloc * d_m3MemPageSize;
+    u8 *                    base;               // NULL while the handler should skip it
+    int                     inUse;
+    size_t volatile         numBytes;           // the accessible part of the memory
+    size_t                  pageSize;
+    u8 *                    bits;               // a bit per page of the reservation
+}
+M3DirtyPages;
 
-#if d_m3MaxLinearMemoryPages > 0
-        _throwif("linear memory limitation exceeded", numPagesToAlloc > d_m3MaxLinearMemoryPages);
-#endif
+static M3DirtyPages * volatile      s_dirtyPages        = NULL;
+static int                          s_numHandlersInWalk = 0;
+static struct sigaction             s_previousSegvAction;
 
-        // Limit the amount of memory that gets actually allocated
-        if (io_runtime->memoryLimit) {
-            numPageBytes = M3_MIN (numPageBytes, io_runtime->memoryLimit);
-        }
 
-        size_t numPreviousBytes = memory->numPages * d_m3MemPageSize;
+static
+void  SetDirtyBits  (M3DirtyPages * io_pages, size_t i_firstPage, size_t i_numPages)
+{
+    for (size_t i = i_firstPage; i < i_firstPage + i_numPages; ++i)
+        __sync_fetch_and_or (& io_pages->bits [i / 8], (u8) (1 << (i % 8)));
+}
 
-        if (numPageBytes > 0) {
-            void* newMem = m3_Realloc ("Wasm Linear Memory", memory->mallocated->dataBuffer, numPageBytes, numPreviousBytes);
-            _throwifnull(newMem);
 
-            memory->mallocated->dataBuffer = (uint8_t *)newMem;
-        } else {
-            if (memory->mallocated->dataBuffer) {
-                m3_Free (memory->mallocated->dataBuffer);
-            }
-        }
+static
+bool  IsPageDirty  (M3DirtyPages * i_pages, size_t i_page)
+{
+    return i_pages->bits [i_page / 8] & (1 << (i_page % 8));
+}
 
-# if d_m3LogRuntime
-        void * oldMallocated = memory->mallocated->dataBuffer;
-# endif
 
-        memory->numPages = numPagesToAlloc;
+static
+bool  HandleDirtyPageFault  (u8 * i_address)
+{
+    bool handled = false;
 
-        memory->mallocated->header.length =  numPageBytes;
-        memory->mallocated->header.runtime = io_runtime;
-        memory->mallocated->header.maxStack = (m3slot_t *) io_runtime->stack + io_runtime->numStackSlots;
+    __atomic_add_fetch (& s_numHandlersInWalk, 1, __ATOMIC_SEQ_CST);
 
-        m3log (runtime, "resized old: %p; mem: %p; length: %zu; pages: %d", oldMallocated, memory->mallocated->dataBuffer, memory->mallocated->header.length, memory->numPages);
+    for (M3DirtyPages * pages = s_dirtyPages; pages; pages = pages->next)
+    {
+        u8 * base = __atomic_load_n (& pages->base, __ATOMIC_SEQ_CST);
+
+        if (base and i_address >= base and i_address < base + pages->numBytes)
+        {
+            size_t page = (i_address - base) / pages->pageSize;
+
+            SetDirtyBits (pages, page, 1);
+            handled = (mprotect (base + page * pages->pageSize, pages->pageSize, PROT_READ | PROT_WRITE) == 0);
+            break;
+        }
     }
-    else result = m3Err_wasmMemoryOverflow;
 
-    _catch: return result;
+    __atomic_sub_fetch (& s_numHandlersInWalk, 1, __ATOMIC_SEQ_CST);
+
+    return handled;
 }
 
 
-M3Result  InitGlobals  (IM3Module io_module)
+static
+void  MemoryFaultHandler  (int i_signal, siginfo_t * i_info, void * i_context)
 {
-    M3Result result = m3Err_none;
+    // returning re-runs the write
+    if (HandleDirtyPageFault ((u8 *) i_info->si_addr))
+        return;
 
-    if (io_module->numGlobals)
-    {
-        // placing the globals in their structs isn't good for cache locality, but i don't really know what the global
-        // access patterns typically look like yet.
+#   if d_m3UseGuardPages
+    HandleGuardPageFault (i_info);
+#   endif
 
-        //          io_module->globalMemory = m3Alloc (m3reg_t, io_module->numGlobals);
+    // not a wasm access; hand it on. returning re-runs the faulting instruction under the restored action
+    if (s_previousSegvAction.sa_flags & SA_SIGINFO)
+        s_previousSegvAction.sa_sigaction (i_signal, i_info, i_context);
+    else if (s_previousSegvAction.sa_handler != SIG_DFL and s_previousSegvAction.sa_handler != SIG_IGN)
+        s_previousSegvAction.sa_handler (i_signal);
+    else
+        signal (i_signal, SIG_DFL);
+}
 
-        //          if (io_module->globalMemory)
-        {
-            for (u32 i = 0; i < io_module->numGlobals; ++i)
-            {
-                M3Global * g = & io_module->globals [i];                        m3log (runtime, "initializing global: %d", i);
 
-                if (g->initExpr)
-                {
-                    bytes_t start = g->initExpr;
-                    result = EvaluateExpression (io_module, & g->intValue, g->type, & start, g->initExpr + g->initExprSize);
+static
+M3Result  InstallMemoryFaultHandler  ()
+{
+    static volatile int installed = 0;
 
-                    if (not result)
-                    {
-                        // io_module->globalMemory [i] = initValue;
-                    }
-                    else break;
-                }
-                else
-                {                                                               m3log (runtime, "importing global");
+    if (not __sync_bool_compare_and_swap (& installed, 0, 1))
+        return m3Err_none;
 
-                }
-            }
-        }
-        //          else result = ErrorModule (m3Err_mallocFailed, io_module, "could allocate globals for module: '%s", io_module->name);
+    struct sigaction action;
+    M3_INIT (action);
+    action.sa_sigaction = MemoryFaultHandler;
+    sigemptyset (& action.sa_mask);
+    // SA_NODEFER: a guard page fault jumps out, and sigsetjmp () doesn't restore the signal mask. no SA_ONSTACK:
+    // these faults come from loads and stores, with the stack intact, and no alternate stack is set up for them
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+
+    if (sigaction (SIGSEGV, & action, & s_previousSegvAction))
+    {
+        installed = 0;
+        return "failed to install the memory fault handler";
     }
 
-    return result;
+    return m3Err_none;
 }
 
 
-M3Result  InitDataSegments  (M3Memory * io_memory, IM3Module io_module)
+// an unused entry, not yet visible to the handler: PublishDirtyPages () makes it so, once it's filled in
+static
+M3DirtyPages *  AcquireDirtyPages  ()
 {
-    M3Result result = m3Err_none;
+    for (M3DirtyPages * pages = s_dirtyPages; pages; pages = pages->next)
+    {
+        if (__sync_bool_compare_and_swap (& pages->inUse, 0, 1))
+            return pages;
+    }
 
-    for (u32 i = 0; i < io_module->numDataSegments; ++i)
+    M3DirtyPages * pages = m3_AllocStruct (M3DirtyPages);
+
+    if (pages)
     {
-        M3DataSegment * segment = & io_module->dataSegments [i];
+        pages->inUse = 1;
 
-        i32 segmentOffset;
-        bytes_t start = segment->initExpr;
-_       (EvaluateExpression (io_module, & segmentOffset, c_m3Type_i32, & start, segment->initExpr + segment->initExprSize));
+        do pages->next = s_dirtyPages;
+        while (not __sync_bool_compare_and_swap (& s_dirtyPages, pages->next, pages));
+    }
 
-        m3log (runtime, "loading data segment: %d; size: %d; offset: %d", i, segment->size, segmentOffset);
+    return pages;
+}
 
-        if (segmentOffset >= 0 && (size_t)(segmentOffset) + segment->size <= io_memory->mallocated->header.length)
-        {
+
+static
+void  PublishDirtyPages  (M3DirtyPages * io_pages, u8 * i_base)
+{
+    __atomic_store_n (& io_pages->base, i_base, __ATOMIC_SEQ_CST);
+}
+
+
+static
+void  ReleaseDirtyPages  (M3Memory * io_memory)
+{
+    M3DirtyPages * pages = io_memory->dirtyPages;
+
+    if (pages)
+    {
+        __atomic_store_n (& pages->base, NULL, __ATOMIC_SEQ_CST);
+
+        // a handler that came in before the base was cleared may still be reading the bits
+        while (__atomic_load_n (& s_numHandlersInWalk, __ATOMIC_SEQ_CST))
+            sched_yield ();
+
+        m3_Free (pages->bits);
+        pages->bits = NULL;
+        io_memory->dirtyPages = NULL;
+
+        __atomic_store_n (& pages->inUse, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+
+// whole pages of the file, copy-on-write, over the memory at o_dest; zero pages if i_fileDescriptor is negative. the
+// mapping replaces whatever was there, so it also survives memory.grow, which only changes protections
+static
+M3Result  MapFilePages  (M3Memory * io_memory, u8 * o_dest, size_t i_numBytes, int i_fileDescriptor, u64 i_fileOffset)
+{
+    int flags = MAP_PRIVATE | MAP_FIXED | (i_fileDescriptor < 0 ? MAP_ANONYMOUS : 0);
+
+    if (mmap (o_dest, i_numBytes, PROT_READ | PROT_WRITE, flags, i_fileDescriptor, (off_t) i_fileOffset) == MAP_FAILED)
+        return "failed to map the file";
+
+    if (i_fileDescriptor < 0 and io_memory->backing == c_m3MemoryBacking_thp)
+        madvise (o_dest, i_numBytes, MADV_HUGEPAGE);
+
+    M3DirtyPages * pages = io_memory->dirtyPages;
+
+    if (pages)
+        SetDirtyBits (pages, (o_dest - pages->base) / pages->pageSize, i_numBytes / pages->pageSize);
+
+    return m3Err_none;
+}
+
+
+// the address space for the largest the memory can get is reserved with the first pages. growing only makes
+// more of it accessible, so nothing is copied and the memory doesn't move
+static
+M3Result  ResizeReservedMemory  (IM3Runtime io_runtime, size_t i_numBytes)
+{
+    M3Result result = m3Err_none;
+
+    M3Memory * memory = & io_runtime->memory;
+    u8 * base = memory->mallocated->dataBuffer;
+    size_t allocated = base ? AllocatedMemorySize (memory->mallocated->header.length) : 0;
+
+    bool hugeTLB = (memory->backing == c_m3MemoryBacking_hugeTLB);
+    size_t pageSize = hugeTLB ? c_m3HugePageSize : (size_t) sysconf (_SC_PAGESIZE);
+    size_t pageMask = pageSize - 1;
+
+    size_t accessible = (allocated + pageMask) & ~pageMask;
+    size_t required = (i_numBytes + pageMask) & ~pageMask;
+
+    if (not base)
+    {
+        if (not i_numBytes)
+            return result;
+
+#   if d_m3UseGuardPages
+_       (InstallMemoryFaultHandler ());
+#   endif
+
+        size_t reservedBytes = (GetMemoryReservationSize (memory->maxPages, io_runtime->memoryLimit) + pageMask) & ~pageMask;
+        bool hugePages = (hugeTLB or memory->backing == c_m3MemoryBacking_thp);
+
+        base = ReserveAddressSpace (reservedBytes, hugePages ? c_m3HugePageSize : 0);
+        _throwifnull (base);
+
+        if (memory->backing == c_m3MemoryBacking_thp)
+            madvise (base, reservedBytes, MADV_HUGEPAGE);
+
+        memory->mallocated->dataBuffer = base;
+        memory->reservedBytes = reservedBytes;
+    }
+
+    _throwif (m3Err_mallocFailed, required > memory->reservedBytes);
+
+    if (required > accessible)
+    {
+        u8 * start = base + accessible;
+        size_t numBytes = required - accessible;
+
+        if (hugeTLB)
+        {
+            // the pool is checked here, rather than with a SIGBUS on first touch
+            void * mapped = mmap (start, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+            _throwif (m3Err_mallocFailed, mapped == MAP_FAILED);
+        }
+        else
+        {
+            _throwif (m3Err_mallocFailed, mprotect (start, numBytes, PROT_READ | PROT_WRITE));
+        }
+
+        if (memory->backing == c_m3MemoryBacking_prefault)
+            PrefaultPages (start, numBytes, pageSize);
+
+        // the pages grown into are zero, as they are wherever a checkpoint is applied; they start out clean
+        if (memory->dirtyPages)
+        {
+            mprotect (start, numBytes, PROT_READ);
+            memory->dirtyPages->numBytes = required;
+        }
+    }
+    else if (required < accessible)
+    {
+        u8 * start = base + required;
+        size_t numBytes = accessible - required;
+
+        // if they come back, they're zero
+        if (memory->dirtyPages)
+        {
+            memory->dirtyPages->numBytes = required;
+            SetDirtyBits (memory->dirtyPages, required / pageSize, numBytes / pageSize);
+        }
+
+        // a fresh mapping also drops huge TLB pages, and the snapshot or module file pages mapped over these; see
+        // m3_RestoreSnapshot () and MapDataSegment ()
+        mmap (start, numBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+
+        if (memory->backing == c_m3MemoryBacking_thp)
+            madvise (start, numBytes, MADV_HUGEPAGE);
+    }
+
+    // the rest of the last page stays accessible when the memory shrinks. growing into it again has to find zeros
+    if (i_numBytes < allocated)
+        memset (base + i_numBytes, 0x0, M3_MIN (allocated, required) - i_numBytes);
+
+    _catch: return result;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  shared memories
+//---------------------------------------------------------------------------------------------------------------------------------
+
+// reserved like a runtime's own memory, so it never moves and growing it only changes protections. each runtime that
+// uses it keeps its own view of the size, in its M3Memory and memory header; SyncSharedMemory () catches that up
+typedef struct M3SharedMemory
+{
+    u8 *                    base;
+    size_t                  reservedBytes;
+
+    u32 volatile            numPages;
+    u32                     maxPages;
+
+    i32 volatile            numReferences;
+    i32 volatile            lock;               // held while growing
+}
+M3SharedMemory;
+
+
+static
+void  LockSharedMemory  (M3SharedMemory * io_shared)
+{
+    while (__sync_lock_test_and_set (& io_shared->lock, 1))
+    {
+        while (io_shared->lock) {}
+    }
+}
+
+
+static
+void  UnlockSharedMemory  (M3SharedMemory * io_shared)
+{
+    __sync_lock_release (& io_shared->lock);
+}
+
+
+// makes it at least i_numPages long; the caller holds the lock
+static
+M3Result  ExtendSharedMemory  (M3SharedMemory * io_shared, u32 i_numPages)
+{
+    M3Result result = m3Err_none;
+
+    size_t pageMask = (size_t) sysconf (_SC_PAGESIZE) - 1;
+    size_t previousLength = (size_t) io_shared->numPages * d_m3MemPageSize;
+    size_t length = (size_t) i_numPages * d_m3MemPageSize;
+
+    size_t allocated = previousLength ? AllocatedMemorySize (previousLength) : 0;
+    size_t accessible = (allocated + pageMask) & ~pageMask;
+    size_t required = (AllocatedMemorySize (length) + pageMask) & ~pageMask;
+
+    if (length <= previousLength)
+        return result;
+
+    _throwif (m3Err_wasmMemoryOverflow, i_numPages > io_shared->maxPages);
+
+    if (required > accessible)
+        _throwif (m3Err_mallocFailed, mprotect (io_shared->base + accessible, required - accessible, PROT_READ | PROT_WRITE));
+
+#   if d_m3UseIndexMasking
+    // see ResizeMemory ()
+    if (allocated > previousLength)
+        memset (io_shared->base + previousLength, 0x0, M3_MIN (length, allocated) - previousLength);
+#   endif
+
+    // the pages are accessible before anyone can see the size
+    __sync_synchronize ();
+    io_shared->numPages = i_numPages;
+
+    _catch: return result;
+}
+
+
+static
+void  ReleaseSharedMemory  (M3SharedMemory * io_shared)
+{
+    if (io_shared and __sync_sub_and_fetch (& io_shared->numReferences, 1) == 0)
+    {
+        if (io_shared->base)
+            munmap (io_shared->base, io_shared->reservedBytes);
+
+        m3_Free (io_shared);
+    }
+}
+
+
+void  SyncSharedMemory  (IM3Runtime io_runtime)
+{
+    M3Memory * memory = & io_runtime->memory;
+    u32 numPages = memory->shared->numPages;
+
+    if (numPages != memory->numPages)
+    {
+        memory->numPages = numPages;
+        memory->mallocated->header.length = (size_t) numPages * d_m3MemPageSize;
+#   if d_m3UseIndexMasking
+        memory->mallocated->header.mask = MaskedMemorySize (memory->mallocated->header.length) - 1;
+#   endif
+    }
+}
+
+
+// memory.grow; returns the previous size in pages, or -1
+i32  GrowSharedMemory  (IM3Runtime io_runtime, u32 i_numPagesToGrow)
+{
+    M3SharedMemory * shared = io_runtime->memory.shared;
+    M3Result result = m3Err_wasmMemoryOverflow;
+
+    LockSharedMemory (shared);
+
+    u32 previous = shared->numPages;
+
+    if (i_numPagesToGrow <= shared->maxPages - previous)
+        result = ExtendSharedMemory (shared, previous + i_numPagesToGrow);
+
+    UnlockSharedMemory (shared);
+
+    SyncSharedMemory (io_runtime);
+
+    return result ? -1 : (i32) previous;
+}
+
+
+static
+void  ReleaseReservedMemory  (M3Memory * io_memory)
+{
+    ReleaseDirtyPages (io_memory);
+
+    if (io_memory->shared)
+    {
+        ReleaseSharedMemory (io_memory->shared);
+        io_memory->shared = NULL;
+    }
+    else if (not io_memory->isImported and io_memory->mallocated and io_memory->mallocated->dataBuffer)
+        munmap (io_memory->mallocated->dataBuffer, io_memory->reservedBytes);
+}
+
+#endif // d_m3UseReservedMemory
+
+
+void  Runtime_Release  (IM3Runtime i_runtime)
+{
+    ForEachModule (i_runtime, _FreeModule, NULL);                   d_m3Assert (i_runtime->numActiveCodePages == 0);
+
+    Environment_ReleaseCodePages (i_runtime->environment, i_runtime->pagesOpen);
+    Environment_ReleaseCodePages (i_runtime->environment, i_runtime->pagesFull);
+
+    m3_Free (i_runtime->stack);
+#if d_m3UseReservedMemory
+    ReleaseReservedMemory (& i_runtime->memory);
+#else
+    if (!i_runtime->memory.isImported
+        && (i_runtime->memory.mallocated && i_runtime->memory.mallocated->dataBuffer)) {
+        m3_Free (i_runtime->memory.mallocated->dataBuffer);
+    }
+#endif
+    m3_Free(i_runtime->memory.mallocated);
+}
+
+
+void  m3_FreeRuntime  (IM3Runtime i_runtime)
+{
+    if (i_runtime)
+    {
+        m3_PrintProfilerInfo ();
+
+        Runtime_Release (i_runtime);
+        m3_Free (i_runtime);
+    }
+}
+
+M3Result  EvaluateExpression  (IM3Module i_module, void * o_expressed, u8 i_type, bytes_t * io_bytes, cbytes_t i_end)
+{
+    M3Result result = m3Err_none;
+
+    // OPTZ: use a simplified interpreter for expressions
+
+    // create a temporary runtime context
+#if defined(d_m3PreferStaticAlloc)
+    static M3Runtime runtime;
+#else
+    M3Runtime runtime;
+#endif
+    M3_INIT (runtime);
+
+    runtime.environment = i_module->runtime->environment;
+    runtime.numStackSlots = i_module->runtime->numStackSlots;
+    runtime.stack = i_module->runtime->stack;
+
+    m3stack_t stack = (m3stack_t)runtime.stack;
+
+    IM3Runtime savedRuntime = i_module->runtime;
+    i_module->runtime = & runtime;
+
+    IM3Compilation o = & runtime.compilation;
+    o->runtime = & runtime;
+    o->module =  i_module;
+    o->wasm =    * io_bytes;
+    o->wasmEnd = i_end;
+    o->lastOpcodeStart = o->wasm;
+
+    o->block.depth = -1;  // so that root compilation depth = 0
+
+    //  OPTZ: this code page could be erased after use.  maybe have 'empty' list in addition to full and open?
+    o->page = AcquireCodePage (& runtime);  // AcquireUnusedCodePage (...)
+
+    if (o->page)
+    {
+        IM3FuncType ftype = runtime.environment->retFuncTypes[i_type];
+
+        pc_t m3code = GetPagePC (o->page);
+        result = CompileBlock (o, ftype, c_waOp_block);
+
+        if (not result && o->maxStackSlots >= runtime.numStackSlots) {
+            result = m3Err_trapStackOverflow;
+        }
+
+        if (not result)
+        {
+#if d_m3UseDispatchLoop
+            M3MemoryBuffer memory;      // every op hands its successor back to RunCode () through this header
+            M3_INIT (memory);
+            M3MemoryHeader * header = & memory.header;
+
+            m3ret_t r = RunCode (m3code, stack, header, d_m3OpDefaultArgs);
+#else
+            m3ret_t r = RunCode (m3code, stack, NULL, d_m3OpDefaultArgs);
+#endif
+
+            if (r == 0)
+            {                                                                               m3log (runtime, "expression result: %s", SPrintValue (stack, i_type));
+                if (SizeOfType (i_type) == sizeof (u32))
+                {
+                    * (u32 *) o_expressed = * ((u32 *) stack);
+                }
+                else
+                {
+                    * (u64 *) o_expressed = * ((u64 *) stack);
+                }
+            }
+        }
+
+        // TODO: EraseCodePage (...) see OPTZ above
+        ReleaseCodePage (& runtime, o->page);
+    }
+    else result = m3Err_mallocFailedCodePage;
+
+    runtime.stack = NULL;        // prevent free(stack) in ReleaseRuntime
+    Runtime_Release (& runtime);
+    i_module->runtime = savedRuntime;
+
+    * io_bytes = o->wasm;
+
+    return result;
+}
+
+
+M3Result  InitMemory  (IM3Runtime io_runtime, IM3Module i_module)
+{
+    M3Result result = m3Err_none;                                     //d_m3Assert (not io_runtime->memory.wasmPages);
+
+    if (not i_module->memoryImported)
+    {
+        u32 maxPages = i_module->memoryInfo.maxPages;
+#if d_m3UseReservedMemory
+        // the module gets it like an imported memory, which mustn't be able to outgrow the module's maximum
+        if (io_runtime->memory.shared)
+        {
+            if (maxPages and io_runtime->memory.maxPages > maxPages)
+                return "the shared memory's maximum is above the module's";
+        }
+        else
+#endif
+        io_runtime->memory.maxPages = maxPages ? maxPages : 65536;
+
+        result = ResizeMemory (io_runtime, i_module->memoryInfo.initPages);
+    }
+
+    return result;
+}
+
+
+// RunCode (), and the return_calls the function called hands back to be called from here; see TailCallFunction ()
+static
+M3Result  RunFunction  (IM3Runtime i_runtime, pc_t i_pc, m3stack_t i_sp)
+{
+    M3MemoryHeader * mem = & i_runtime->memory.mallocated->header;
+
+    m3ret_t r = RunCode (i_pc, i_sp, mem, d_m3OpDefaultArgs);
+
+#if !d_m3TrampolinedExecution
+    while (r == i_runtime)
+    {
+        mem = & i_runtime->memory.mallocated->header;
+        r = RunCode (i_runtime->tailCallPC, i_sp, mem, d_m3OpDefaultArgs);
+    }
+#endif
+
+    return (M3Result) r;
+}
+
+
+// runs wasm code on the runtime's stack. with guard pages, an out of bounds access lands back here as a trap
+static
+M3Result  ExecuteCode  (IM3Runtime i_runtime, pc_t i_pc)
+{
+#if d_m3UseReservedMemory
+    if (i_runtime->memory.shared)
+        SyncSharedMemory (i_runtime);
+#endif
+
+#if d_m3UseGuardPages
+    M3GuardedCall call;
+    call.previous = s_guardedCall;
+    call.runtime = i_runtime;
+    call.faultPC = NULL;
+
+    void * stack = i_runtime->stack;
+    volatile M3Result result = m3Err_none;
+
+    if (sigsetjmp (call.onFault, 0) == 0)
+    {
+        s_guardedCall = & call;
+        result = RunFunction (i_runtime, i_pc, (m3stack_t) stack);
+    }
+    else
+    {
+        i_runtime->stack = stack;       // the fault may have been in a host function that moved it
+        result = m3Err_trapOutOfBoundsMemoryAccess;
+#   if d_m3RecordBacktraces
+        // only the trapping frame; the callers' frames unwound with the jump
+        if (call.faultPC)
+        {
+            PushBacktraceFrame (i_runtime, call.faultPC - 1);
+            FillBacktraceFunctionInfo (i_runtime, FindFunctionAt (i_runtime, FindModuleOffset (i_runtime, call.faultPC - 1)));
+        }
+#   endif
+    }
+
+    s_guardedCall = call.previous;
+
+    return result;
+#else
+    return RunFunction (i_runtime, i_pc, (m3stack_t) i_runtime->stack);
+#endif
+}
+
+
+M3Result  ResizeMemory  (IM3Runtime io_runtime, u32 i_numPages)
+{
+    M3Result result = m3Err_none;
+
+    u32 numPagesToAlloc = i_numPages;
+
+    M3Memory * memory = & io_runtime->memory;
+
+#if d_m3UseReservedMemory
+    // it only grows, and may already be larger than asked for
+    if (memory->shared)
+    {
+        LockSharedMemory (memory->shared);
+        result = ExtendSharedMemory (memory->shared, i_numPages);
+        UnlockSharedMemory (memory->shared);
+
+        SyncSharedMemory (io_runtime);
+        memory->mallocated->header.runtime = io_runtime;
+        memory->mallocated->header.maxStack = (m3slot_t *) io_runtime->stack + io_runtime->numStackSlots;
+
+        return result;
+    }
+#endif
+
+#if 0 // Temporary fix for memory allocation
+    if (memory->mallocated) {
+        memory->numPages = i_numPages;
+        memory->mallocated->end = memory->wasmPages + (memory->numPages * c_m3MemPageSize);
+        return result;
+    }
+
+    i_numPagesToAlloc = 256;
+#endif
+
+    if (numPagesToAlloc <= memory->maxPages)
+    {
+        size_t numPageBytes = numPagesToAlloc * d_m3MemPageSize;
+
+#if d_m3MaxLinearMemoryPages > 0
+        _throwif("linear memory limitation exceeded", numPagesToAlloc > d_m3MaxLinearMemoryPages);
+#endif
+
+        // Limit the amount of memory that gets actually allocated
+        if (io_runtime->memoryLimit) {
+            numPageBytes = M3_MIN (numPageBytes, io_runtime->memoryLimit);
+#if d_m3UseGuardPages
+            // nothing is bounds checked, so the accessible pages have to end where the memory does
+            numPageBytes &= ~((size_t) sysconf (_SC_PAGESIZE) - 1);
+#endif
+        }
+
+        size_t numPreviousLength = memory->mallocated->header.length;
+        size_t numPreviousBytes = memory->mallocated->dataBuffer ? AllocatedMemorySize (numPreviousLength) : 0;
+        size_t numAllocBytes = AllocatedMemorySize (numPageBytes);
+
+#if d_m3UseReservedMemory
+_       (ResizeReservedMemory (io_runtime, numAllocBytes));
+        (void) numPreviousBytes;
+#else
+        if (numAllocBytes > 0) {
+            void* newMem = m3_Realloc ("Wasm Linear Memory", memory->mallocated->dataBuffer, numAllocBytes, numPreviousBytes);
+            _throwifnull(newMem);
+
+            memory->mallocated->dataBuffer = (uint8_t *)newMem;
+        } else {
+            if (memory->mallocated->dataBuffer) {
+                m3_Free (memory->mallocated->dataBuffer);
+            }
+        }
+#endif
+
+# if d_m3LogRuntime
+        void * oldMallocated = memory->mallocated->dataBuffer;
+# endif
+
+#if d_m3UseIndexMasking
+        // stores past the end wrapped around into the old capacity instead of trapping; the memory grown into has to be zeroed
+        if (numPageBytes > numPreviousLength and numPreviousBytes > numPreviousLength)
+            memset (memory->mallocated->dataBuffer + numPreviousLength, 0x0, M3_MIN (numPageBytes, numPreviousBytes) - numPreviousLength);
+
+        memory->mallocated->header.mask = MaskedMemorySize (numPageBytes) - 1;
+#else
+        (void) numPreviousLength;
+#endif
+
+        memory->numPages = numPagesToAlloc;
+
+        memory->mallocated->header.length =  numPageBytes;
+        memory->mallocated->header.runtime = io_runtime;
+        memory->mallocated->header.maxStack = (m3slot_t *) io_runtime->stack + io_runtime->numStackSlots;
+
+        m3log (runtime, "resized old: %p; mem: %p; length: %zu; pages: %d", oldMallocated, memory->mallocated->dataBuffer, memory->mallocated->header.length, memory->numPages);
+    }
+    else result = m3Err_wasmMemoryOverflow;
+
+    _catch: return result;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  snapshots
+//---------------------------------------------------------------------------------------------------------------------------------
+
+#if d_m3UseReservedMemory
+// an anonymous file for the snapshot's pages; -1 where there's no memfd_create (Android before API 30, old kernels).
+// called through syscall (), since glibc only wraps it from 2.27 on
+static
+int  CreateMemoryFile  (cstr_t i_name)
+{
+#   if defined(SYS_memfd_create)
+    return (int) syscall (SYS_memfd_create, i_name, 0x0001U /* MFD_CLOEXEC */);
+#   else
+    return -1;
+#   endif
+}
+#endif
+
+
+static
+M3Result  SnapshotMemory  (IM3Snapshot o_snapshot, M3Memory * i_memory)
+{
+    M3Result result = m3Err_none;
+
+    u8 * base = i_memory->mallocated->dataBuffer;
+    size_t length = i_memory->mallocated->header.length;
+
+    _throwif ("imported memories can't be snapshotted", i_memory->isImported);
+
+    o_snapshot->numPages = i_memory->numPages;
+    o_snapshot->length = length;
+
+    if (not length)
+        return result;
+
+#if d_m3UseReservedMemory
+    // huge pages and prefaulting would be undone by mapping the snapshot over them, so those are copied back instead,
+    // as is everything without a memory file
+    if (i_memory->backing == c_m3MemoryBacking_default)
+        o_snapshot->fd = CreateMemoryFile ("wasm3 snapshot");
+
+    if (o_snapshot->fd >= 0)
+    {
+        size_t pageMask = (size_t) sysconf (_SC_PAGESIZE) - 1;
+        size_t numBytes = (length + pageMask) & ~pageMask;
+
+        _throwif (m3Err_mallocFailed, ftruncate (o_snapshot->fd, numBytes));
+
+        void * mapped = mmap (NULL, numBytes, PROT_READ | PROT_WRITE, MAP_SHARED, o_snapshot->fd, 0);
+        _throwif (m3Err_mallocFailed, mapped == MAP_FAILED);
+
+        memcpy (mapped, base, length);
+        munmap (mapped, numBytes);
+
+        o_snapshot->fdBytes = numBytes;
+        return result;
+    }
+#endif
+
+    o_snapshot->data = m3_CopyMem (base, length);
+    _throwifnull (o_snapshot->data);
+
+    _catch: return result;
+}
+
+
+static
+M3Result  RestoreMemory  (IM3Runtime io_runtime, IM3Snapshot i_snapshot)
+{
+    M3Result result = m3Err_none;
+
+    M3Memory * memory = & io_runtime->memory;
+    size_t length = i_snapshot->length;
+    u8 * base;
+
+    if (memory->numPages != i_snapshot->numPages)
+_       (ResizeMemory (io_runtime, i_snapshot->numPages));
+
+    base = memory->mallocated->dataBuffer;
+
+    if (not base)
+        return result;
+
+#if d_m3UseReservedMemory
+    if (i_snapshot->fd >= 0)
+    {
+        // the pages written since the snapshot are dropped; the others are still shared with it
+        void * mapped = mmap (base, i_snapshot->fdBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, i_snapshot->fd, 0);
+        _throwif (m3Err_mallocFailed, mapped == MAP_FAILED);
+
+        if (memory->dirtyPages)
+            SetDirtyBits (memory->dirtyPages, 0, i_snapshot->fdBytes / memory->dirtyPages->pageSize);
+    }
+    else
+#endif
+    if (length)
+    {
+        memcpy (base, i_snapshot->data, length);
+    }
+
+#if d_m3UseIndexMasking
+    // wrapped stores can land past the end
+    memset (base + length, 0x0, AllocatedMemorySize (length) - length);
+#endif
+
+    _catch: return result;
+}
+
+
+static
+M3Result  SnapshotModule  (M3ModuleSnapshot * o_snapshot, IM3Module i_module)
+{
+    M3Result result = m3Err_none;
+
+    o_snapshot->module = i_module;
+    o_snapshot->startFunction = i_module->startFunction;
+
+    if (i_module->numGlobals)
+    {
+        o_snapshot->globals = m3_AllocArray (i64, i_module->numGlobals);
+        _throwifnull (o_snapshot->globals);
+        o_snapshot->numGlobals = i_module->numGlobals;
+
+        for (u32 i = 0; i < i_module->numGlobals; ++i)
+            o_snapshot->globals [i] = i_module->globals [i].intValue;
+    }
+
+    if (i_module->numTables)
+    {
+        o_snapshot->tables = m3_AllocArray (M3TableSnapshot, i_module->numTables);
+        _throwifnull (o_snapshot->tables);
+        o_snapshot->numTables = i_module->numTables;
+
+        for (u32 i = 0; i < i_module->numTables; ++i)
+        {
+            M3Table * table = & i_module->tables [i];
+            M3TableSnapshot * saved = & o_snapshot->tables [i];
+
+            saved->elements = table->elements;
+
+            if (table->elements and table->functions)
+            {
+                saved->functions = m3_CopyMem (table->functions, table->elements * sizeof (IM3Function));
+                _throwifnull (saved->functions);
+            }
+        }
+    }
+
+    _catch: return result;
+}
+
+
+static
+M3Result  RestoreModule  (M3ModuleSnapshot * i_snapshot)
+{
+    M3Result result = m3Err_none;
+
+    IM3Module module = i_snapshot->module;
+
+    module->startFunction = i_snapshot->startFunction;
+
+    for (u32 i = 0; i < i_snapshot->numGlobals; ++i)
+        module->globals [i].intValue = i_snapshot->globals [i];
+
+    for (u32 i = 0; i < i_snapshot->numTables; ++i)
+    {
+        M3Table * table = & module->tables [i];
+        M3TableSnapshot * saved = & i_snapshot->tables [i];
+
+        if (table->elements != saved->elements)
+        {
+            table->functions = m3_ReallocArray (IM3Function, table->functions, saved->elements, table->elements);
+            _throwif (m3Err_mallocFailed, saved->elements and not table->functions);
+            table->elements = saved->elements;
+        }
+
+        if (saved->functions)
+            memcpy (table->functions, saved->functions, saved->elements * sizeof (IM3Function));
+    }
+
+    _catch: return result;
+}
+
+
+M3Result  m3_TakeSnapshot  (IM3Runtime i_runtime, IM3Snapshot * o_snapshot)
+{
+    M3Result result = m3Err_none;
+
+    IM3Snapshot snapshot = m3_AllocStruct (M3Snapshot);
+    _throwifnull (snapshot);
+
+#if d_m3UseReservedMemory
+    snapshot->fd = -1;
+#endif
+    snapshot->runtime = i_runtime;
+    snapshot->lastCalled = i_runtime->lastCalled;
+
+_   (SnapshotMemory (snapshot, & i_runtime->memory));
+
+    for (IM3Module module = i_runtime->modules; module; module = module->next)
+        snapshot->numModules++;
+
+    if (snapshot->numModules)
+    {
+        snapshot->modules = m3_AllocArray (M3ModuleSnapshot, snapshot->numModules);
+        _throwifnull (snapshot->modules);
+
+        M3ModuleSnapshot * saved = snapshot->modules;
+
+        for (IM3Module module = i_runtime->modules; module; module = module->next)
+_           (SnapshotModule (saved++, module));
+    }
+
+    * o_snapshot = snapshot;
+    return result;
+
+    _catch:
+    m3_FreeSnapshot (snapshot);
+    return result;
+}
+
+
+M3Result  m3_RestoreSnapshot  (IM3Runtime io_runtime, IM3Snapshot i_snapshot)
+{
+    M3Result result = m3Err_none;
+    u32 numModules = 0;
+
+    _throwif ("the snapshot is of another runtime", i_snapshot->runtime != io_runtime);
+
+    // modules can only be added. this is checked up front, so a refused restore leaves the runtime alone
+
+    for (IM3Module module = io_runtime->modules; module; module = module->next)
+    {
+        _throwif ("modules were loaded since the snapshot", numModules >= i_snapshot->numModules or i_snapshot->modules [numModules].module != module);
+        ++numModules;
+    }
+
+_   (RestoreMemory (io_runtime, i_snapshot));
+
+    for (u32 i = 0; i < i_snapshot->numModules; ++i)
+_       (RestoreModule (& i_snapshot->modules [i]));
+
+    // nothing on the value stack is live between calls, but what the last one left shouldn't be seen by the next
+    memset (io_runtime->stack, 0x0, io_runtime->numStackSlots * sizeof (m3slot_t));
+
+    io_runtime->lastCalled = i_snapshot->lastCalled;
+    m3_ResetErrorInfo (io_runtime);
+
+    _catch: return result;
+}
+
+
+void  m3_FreeSnapshot  (IM3Snapshot i_snapshot)
+{
+    if (i_snapshot)
+    {
+        for (u32 i = 0; i < i_snapshot->numModules; ++i)
+        {
+            M3ModuleSnapshot * saved = & i_snapshot->modules [i];
+
+            for (u32 t = 0; t < saved->numTables; ++t)
+                m3_Free (saved->tables [t].functions);
+
+            m3_Free (saved->tables);
+            m3_Free (saved->globals);
+        }
+
+        m3_Free (i_snapshot->modules);
+        m3_Free (i_snapshot->data);
+
+#if d_m3UseReservedMemory
+        if (i_snapshot->fd >= 0)
+            close (i_snapshot->fd);
+#endif
+
+        m3_Free (i_snapshot);
+    }
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  file mappings
+//---------------------------------------------------------------------------------------------------------------------------------
+
+M3Result  m3_MapFileIntoMemory  (IM3Runtime io_runtime, uint32_t i_memoryOffset, uint32_t i_numBytes, int i_fileDescriptor, uint64_t i_fileOffset)
+{
+    M3Result result = m3Err_none;
+
+#if d_m3UseReservedMemory
+    M3Memory * memory = & io_runtime->memory;
+    u8 * base = memory->mallocated ? memory->mallocated->dataBuffer : NULL;
+
+    size_t pageSize = (size_t) sysconf (_SC_PAGESIZE);
+    size_t pageMask = pageSize - 1;
+
+    u8 * dest;
+    u64 fileBytes = 0;
+    size_t wholePages, fromFile, tail;
+
+    _throwif ("the runtime has no memory", not base);
+    _throwif ("the range is outside the memory", (u64) i_memoryOffset + i_numBytes > memory->mallocated->header.length);
+    _throwif ("imported memories can't be mapped into", memory->isImported);
+    _throwif ("huge TLB pages can't be mapped into", memory->backing == c_m3MemoryBacking_hugeTLB);
+    _throwif ("the offsets must be multiples of the page size", (i_memoryOffset & pageMask) or (i_fileOffset & pageMask));
+
+    if (i_fileDescriptor >= 0)
+    {
+        struct stat info;
+        _throwif ("failed to stat the file", fstat (i_fileDescriptor, & info));
+
+        if ((u64) info.st_size > i_fileOffset)
+            fileBytes = M3_MIN ((u64) info.st_size - i_fileOffset, (u64) i_numBytes);
+    }
+
+    dest = base + i_memoryOffset;
+    wholePages = i_numBytes & ~pageMask;
+
+    // a page wholly past the end of the file would fault with SIGBUS; those are zero pages instead
+    fromFile = M3_MIN (wholePages, (fileBytes + pageMask) & ~pageMask);
+
+    if (fromFile)
+_       (MapFilePages (memory, dest, fromFile, i_fileDescriptor, i_fileOffset));
+
+    if (wholePages > fromFile)
+_       (MapFilePages (memory, dest + fromFile, wholePages - fromFile, -1, 0));
+
+    // the partial page at the end holds memory past the range, so it's read rather than mapped
+    tail = i_numBytes - wholePages;
+
+    if (tail)
+    {
+        ssize_t numRead = 0;
+        m3_MarkMemoryDirty (io_runtime, dest + wholePages, (u32) tail);
+
+        if (fileBytes > wholePages)
+            numRead = pread (i_fileDescriptor, dest + wholePages, fileBytes - wholePages, (off_t) (i_fileOffset + wholePages));
+
+        _throwif ("failed to read the file", numRead < 0);
+        memset (dest + wholePages + numRead, 0x0, tail - numRead);
+    }
+#else
+    _throw ("file mappings need d_m3UseReservedMemory");
+#endif
+
+    _catch: return result;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  shared memories
+//---------------------------------------------------------------------------------------------------------------------------------
+
+M3Result  m3_NewSharedMemory  (IM3SharedMemory * o_memory, uint32_t i_numPages, uint32_t i_maxPages)
+{
+    M3Result result = m3Err_none;
+
+    * o_memory = NULL;
+
+#if d_m3UseReservedMemory
+    size_t pageMask = (size_t) sysconf (_SC_PAGESIZE) - 1;
+    M3SharedMemory * shared = NULL;
+
+    _throwif (m3Err_wasmMemoryOverflow, i_numPages > i_maxPages or i_maxPages > 65536);
+#   if d_m3MaxLinearMemoryPages > 0
+    _throwif ("linear memory limitation exceeded", i_maxPages > d_m3MaxLinearMemoryPages);
+#   endif
+
+#   if d_m3UseGuardPages
+_   (InstallMemoryFaultHandler ());
+#   endif
+
+    shared = m3_AllocStruct (M3SharedMemory);
+    _throwifnull (shared);
+
+    shared->maxPages = i_maxPages;
+    shared->numReferences = 1;
+    shared->reservedBytes = (GetMemoryReservationSize (i_maxPages, 0) + pageMask) & ~pageMask;
+
+    shared->base = ReserveAddressSpace (shared->reservedBytes, 0);
+    _throwifnull (shared->base);
+
+_   (ExtendSharedMemory (shared, i_numPages));
+
+    * o_memory = shared;
+    shared = NULL;
+
+    _catch:
+    ReleaseSharedMemory (shared);
+#else
+    _throw ("shared memories need d_m3UseReservedMemory");
+
+    _catch:
+#endif
+    return result;
+}
+
+
+void  m3_FreeSharedMemory  (IM3SharedMemory i_memory)
+{
+#if d_m3UseReservedMemory
+    ReleaseSharedMemory (i_memory);
+#else
+    (void) i_memory;
+#endif
+}
+
+
+M3Result  m3_SetSharedMemory  (IM3Runtime io_runtime, IM3SharedMemory i_memory)
+{
+    M3Result result = m3Err_none;
+
+#if d_m3UseReservedMemory
+    M3Memory * memory = & io_runtime->memory;
+
+    _throwif ("the memory is already allocated", memory->mallocated->dataBuffer);
+    _throwif ("shared memories have the default backing", memory->backing != c_m3MemoryBacking_default);
+
+    __sync_fetch_and_add (& i_memory->numReferences, 1);
+
+    memory->shared = i_memory;
+    memory->isImported = true;
+    memory->maxPages = i_memory->maxPages;
+    memory->mallocated->dataBuffer = i_memory->base;
+
+_   (ResizeMemory (io_runtime, 0));
+#else
+    (void) io_runtime; (void) i_memory;
+    _throw ("shared memories need d_m3UseReservedMemory");
+#endif
+
+    _catch: return result;
+}
+
+
+uint8_t *  m3_GetSharedMemory  (IM3SharedMemory i_memory, uint32_t * o_memorySizeInBytes)
+{
+#if d_m3UseReservedMemory
+    u32 numPages = i_memory->numPages;
+
+    if (o_memorySizeInBytes)
+        * o_memorySizeInBytes = numPages * d_m3MemPageSize;
+
+    return numPages ? i_memory->base : NULL;
+#else
+    (void) i_memory;
+
+    if (o_memorySizeInBytes)
+        * o_memorySizeInBytes = 0;
+
+    return NULL;
+#endif
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  dirty pages and checkpoints
+//---------------------------------------------------------------------------------------------------------------------------------
+
+M3Result  m3_TrackDirtyPages  (IM3Runtime io_runtime)
+{
+    M3Result result = m3Err_none;
+
+#if d_m3UseReservedMemory
+    M3Memory * memory = & io_runtime->memory;
+    u8 * base = memory->mallocated->dataBuffer;
+
+    size_t pageSize = (size_t) sysconf (_SC_PAGESIZE);
+    size_t numPages = memory->reservedBytes / pageSize;
+    size_t accessible = (AllocatedMemorySize (memory->mallocated->header.length) + pageSize - 1) & ~(pageSize - 1);
+
+    u8 * bits = NULL;
+    M3DirtyPages * pages;
+
+    _throwif ("the runtime has no memory", not base);
+    _throwif ("imported memories can't be tracked", memory->isImported);
+    _throwif ("huge TLB pages can't be tracked", memory->backing == c_m3MemoryBacking_hugeTLB);
+
+    if (memory->dirtyPages)
+        return result;
+
+_   (InstallMemoryFaultHandler ());
+
+    bits = m3_AllocArray (u8, (numPages + 7) / 8);
+    _throwifnull (bits);
+
+    pages = AcquireDirtyPages ();
+    _throwifnull (pages);
+
+    pages->pageSize = pageSize;
+    pages->bits = bits;
+    bits = NULL;
+
+    // every page starts out dirty, so the first checkpoint has all of them
+    SetDirtyBits (pages, 0, accessible / pageSize);
+    pages->numBytes = accessible;
+
+    PublishDirtyPages (pages, base);
+    memory->dirtyPages = pages;
+
+    _catch:
+    m3_Free (bits);
+#else
+    _throw ("dirty page tracking needs d_m3UseReservedMemory");
+
+    _catch:
+#endif
+    return result;
+}
+
+
+M3Result  m3_GetDirtyPages  (IM3Runtime i_runtime, const uint8_t ** o_bits, uint32_t * o_numPages, uint32_t * o_pageSize)
+{
+    M3Result result = m3Err_none;
+
+#if d_m3UseReservedMemory
+    M3DirtyPages * pages = i_runtime->memory.dirtyPages;
+    _throwif ("dirty pages aren't tracked", not pages);
+
+    * o_bits = pages->bits;
+    * o_numPages = (u32) (pages->numBytes / pages->pageSize);
+    * o_pageSize = (u32) pages->pageSize;
+#else
+    _throw ("dirty page tracking needs d_m3UseReservedMemory");
+#endif
+
+    _catch: return result;
+}
+
+
+M3Result  m3_ResetDirtyPages  (IM3Runtime io_runtime)
+{
+    M3Result result = m3Err_none;
+
+#if d_m3UseReservedMemory
+    M3DirtyPages * pages = io_runtime->memory.dirtyPages;
+    _throwif ("dirty pages aren't tracked", not pages);
+
+    for (size_t page = 0, numPages = pages->numBytes / pages->pageSize; page < numPages; ++page)
+    {
+        if (not IsPageDirty (pages, page))
+            continue;
+
+        size_t first = page;
+
+        while (page < numPages and IsPageDirty (pages, page))
+        {
+            __sync_fetch_and_and (& pages->bits [page / 8], (u8) ~(1 << (page % 8)));
+            ++page;
+        }
+
+        _throwif ("failed to write protect the memory", mprotect (pages->base + first * pages->pageSize, (page - first) * pages->pageSize, PROT_READ));
+    }
+#else
+    _throw ("dirty page tracking needs d_m3UseReservedMemory");
+#endif
+
+    _catch: return result;
+}
+
+
+void  m3_MarkMemoryDirty  (IM3Runtime io_runtime, const void * i_address, uint32_t i_numBytes)
+{
+#if d_m3UseReservedMemory
+    M3DirtyPages * pages = io_runtime->memory.dirtyPages;
+
+    if (pages and i_numBytes)
+    {
+        const u8 * address = (const u8 *) i_address;
+
+        if (address >= pages->base and address + i_numBytes <= pages->base + pages->numBytes)
+        {
+            size_t first = (address - pages->base) / pages->pageSize;
+            size_t last = (address + i_numBytes - 1 - pages->base) / pages->pageSize;
+
+            SetDirtyBits (pages, first, last - first + 1);
+            mprotect (pages->base + first * pages->pageSize, (last - first + 1) * pages->pageSize, PROT_READ | PROT_WRITE);
+        }
+    }
+#else
+    (void) io_runtime; (void) i_address; (void) i_numBytes;
+#endif
+}
+
+
+// a checkpoint, little-endian:
+//      u32 magic, u32 numPages (wasm pages), u32 pageSize, u32 numModules, u32 numRuns
+//      per module: i32 startFunction, u32 numGlobals, numGlobals x i64 (the raw M3Global value unions)
+//      per run of dirty pages: u32 firstPage, u32 numPages, the pages
+static const u32 c_m3CheckpointMagic = 0x7063336d;   // "m3cp"
+
+static
+u8 *  Write_u32  (u8 * o_bytes, u32 i_value)
+{
+    M3_BSWAP_u32 (i_value);
+    memcpy (o_bytes, & i_value, sizeof (u32));
+    return o_bytes + sizeof (u32);
+}
+
+
+static
+u8 *  Write_u64  (u8 * o_bytes, u64 i_value)
+{
+    M3_BSWAP_u64 (i_value);
+    memcpy (o_bytes, & i_value, sizeof (u64));
+    return o_bytes + sizeof (u64);
+}
+
+
+M3Result  m3_WriteCheckpoint  (IM3Runtime io_runtime, uint8_t ** o_bytes, uint32_t * o_numBytes)
+{
+    M3Result result = m3Err_none;
+
+    const u8 * bits;
+    u32 numPages, pageSize;
+
+    u8 * memory = io_runtime->memory.mallocated->dataBuffer;
+    u8 * bytes, * out;
+
+    u32 numModules = 0, numRuns = 0;
+    size_t numBytes = 5 * sizeof (u32);
+
+    * o_bytes = NULL;
+    * o_numBytes = 0;
+
+_   (m3_GetDirtyPages (io_runtime, & bits, & numPages, & pageSize));
+
+    for (IM3Module module = io_runtime->modules; module; module = module->next)
+    {
+        numModules++;
+        numBytes += 2 * sizeof (u32) + module->numGlobals * sizeof (u64);
+    }
+
+    for (u32 page = 0; page < numPages; ++page)
+    {
+        if (bits [page / 8] & (1 << (page % 8)))
+        {
+            if (page == 0 or not (bits [(page - 1) / 8] & (1 << ((page - 1) % 8))))
+            {
+                numRuns++;
+                numBytes += 2 * sizeof (u32);
+            }
+
+            numBytes += pageSize;
+        }
+    }
+
+    _throwif ("the checkpoint is too large", numBytes > UINT32_MAX);
+
+    // plain malloc: the caller free ()s it
+    bytes = malloc (numBytes);
+    _throwifnull (bytes);
+
+    out = bytes;
+
+    out = Write_u32 (out, c_m3CheckpointMagic);
+    out = Write_u32 (out, io_runtime->memory.numPages);
+    out = Write_u32 (out, pageSize);
+    out = Write_u32 (out, numModules);
+    out = Write_u32 (out, numRuns);
+
+    for (IM3Module module = io_runtime->modules; module; module = module->next)
+    {
+        out = Write_u32 (out, (u32) module->startFunction);
+        out = Write_u32 (out, module->numGlobals);
+
+        for (u32 i = 0; i < module->numGlobals; ++i)
+            out = Write_u64 (out, (u64) module->globals [i].intValue);
+    }
+
+    for (u32 page = 0; page < numPages; ++page)
+    {
+        if (not (bits [page / 8] & (1 << (page % 8))))
+            continue;
+
+        u32 first = page;
+
+        while (page < numPages and (bits [page / 8] & (1 << (page % 8))))
+            ++page;
+
+        out = Write_u32 (out, first);
+        out = Write_u32 (out, page - first);
+
+        memcpy (out, memory + (size_t) first * pageSize, (size_t) (page - first) * pageSize);
+        out += (size_t) (page - first) * pageSize;
+    }
+
+    result = m3_ResetDirtyPages (io_runtime);
+
+    if (result)
+    {
+        free (bytes);
+        _throw (result);
+    }
+
+    * o_bytes = bytes;
+    * o_numBytes = (u32) numBytes;
+
+    _catch: return result;
+}
+
+
+M3Result  m3_ApplyCheckpoint  (IM3Runtime io_runtime, const uint8_t * i_bytes, uint32_t i_numBytes)
+{
+    M3Result result = m3Err_none;
+
+    bytes_t pos = i_bytes;
+    cbytes_t end = i_bytes + i_numBytes;
+
+    u32 magic, numPages, pageSize, numModules, numRuns;
+    bytes_t globals;
+
+    u8 * memory;
+    size_t numMemoryBytes;
+
+_   (Read_u32 (& magic, & pos, end));
+    _throwif ("not a checkpoint", magic != c_m3CheckpointMagic);
+
+_   (Read_u32 (& numPages, & pos, end));
+_   (Read_u32 (& pageSize, & pos, end));
+_   (Read_u32 (& numModules, & pos, end));
+_   (Read_u32 (& numRuns, & pos, end));
+
+    // the globals are checked before anything changes
+    globals = pos;
+
+    for (IM3Module module = io_runtime->modules; module; module = module->next)
+    {
+        u32 startFunction, numGlobals;
+
+        _throwif ("the checkpoint is of other modules", numModules-- == 0);
+
+_       (Read_u32 (& startFunction, & pos, end));
+_       (Read_u32 (& numGlobals, & pos, end));
+        _throwif ("the checkpoint is of other modules", numGlobals != module->numGlobals);
+        _throwif (m3Err_wasmUnderrun, (size_t) (end - pos) < numGlobals * sizeof (u64));
+
+        pos += numGlobals * sizeof (u64);
+    }
+
+    _throwif ("the checkpoint is of other modules", numModules != 0);
+
+    if (io_runtime->memory.numPages != numPages)
+_       (ResizeMemory (io_runtime, numPages));
+
+    pos = globals;
+
+    for (IM3Module module = io_runtime->modules; module; module = module->next)
+    {
+        u32 startFunction, numGlobals;
+
+_       (Read_u32 (& startFunction, & pos, end));
+_       (Read_u32 (& numGlobals, & pos, end));
+
+        module->startFunction = (i32) startFunction;
+
+        for (u32 i = 0; i < numGlobals; ++i)
+        {
+            u64 value;
+_           (Read_u64 (& value, & pos, end));
+            module->globals [i].intValue = (i64) value;
+        }
+    }
+
+    memory = io_runtime->memory.mallocated->dataBuffer;
+    numMemoryBytes = memory ? AllocatedMemorySize (io_runtime->memory.mallocated->header.length) : 0;
+
+    for (u32 i = 0; i < numRuns; ++i)
+    {
+        u32 firstPage, numRunPages;
+
+_       (Read_u32 (& firstPage, & pos, end));
+_       (Read_u32 (& numRunPages, & pos, end));
+
+        size_t offset = (size_t) firstPage * pageSize;
+        size_t numBytes = (size_t) numRunPages * pageSize;
+
+        _throwif (m3Err_wasmUnderrun, (size_t) (end - pos) < numBytes);
+        _throwif ("the checkpoint doesn't fit the memory", offset > numMemoryBytes);
+
+        // a run's last page can reach past the memory's end
+        if (numBytes)
+            memcpy (memory + offset, pos, M3_MIN (numBytes, numMemoryBytes - offset));
+        pos += numBytes;
+    }
+
+    _catch: return result;
+}
+
+
+M3Result  InitGlobals  (IM3Module io_module)
+{
+    M3Result result = m3Err_none;
+
+    if (io_module->numGlobals)
+    {
+        // placing the globals in their structs isn't good for cache locality, but i don't really know what the global
+        // access patterns typically look like yet.
+
+        //          io_module->globalMemory = m3Alloc (m3reg_t, io_module->numGlobals);
+
+        //          if (io_module->globalMemory)
+        {
+            for (u32 i = 0; i < io_module->numGlobals; ++i)
+            {
+                M3Global * g = & io_module->globals [i];                        m3log (runtime, "initializing global: %d", i);
+
+                if (g->initExpr)
+                {
+                    bytes_t start = g->initExpr;
+                    result = EvaluateExpression (io_module, & g->intValue, g->type, & start, g->initExpr + g->initExprSize);
+
+                    if (not result)
+                    {
+                        // io_module->globalMemory [i] = initValue;
+                    }
+                    else break;
+                }
+                else
+                {                                                               m3log (runtime, "importing global");
+
+                }
+            }
+        }
+        //          else result = ErrorModule (m3Err_mallocFailed, io_module, "could allocate globals for module: '%s", io_module->name);
+    }
+
+    return result;
+}
+
+
+#if d_m3UseReservedMemory
+
+// the pages the segment covers are mapped copy-on-write from the module file, if the segment's file offset lines up
+// with its memory offset. the partial pages at its ends are copied
+static
+M3Result  MapDataSegment  (M3Memory * io_memory, IM3Module i_module, u8 * o_dest, bytes_t i_data, size_t i_size)
+{
+    M3Result result = m3Err_none;
+
+    size_t pageSize = (size_t) sysconf (_SC_PAGESIZE);
+    size_t pageMask = pageSize - 1;
+
+    u8 * base = io_memory->mallocated->dataBuffer;
+    u64 fileOffset = i_module->fileOffset + (i_data - i_module->wasmStart);
+
+    u8 * first = base + (((o_dest - base) + pageMask) & ~pageMask);
+    u8 * last = base + (((o_dest + i_size) - base) & ~pageMask);
+
+    // huge TLB pages can't be partly replaced
+    bool mappable = (io_memory->backing != c_m3MemoryBacking_hugeTLB and not io_memory->isImported
+                     and ((fileOffset - (o_dest - base)) & pageMask) == 0 and first < last);
+
+    if (not mappable)
+    {
+        memcpy (o_dest, i_data, i_size);
+        return result;
+    }
+
+    memcpy (o_dest, i_data, first - o_dest);
+    memcpy (last, i_data + (last - o_dest), (o_dest + i_size) - last);
+
+_   (MapFilePages (io_memory, first, last - first, i_module->fileDescriptor, fileOffset + (first - o_dest)));
+
+    _catch: return result;
+}
+
+#endif
+
+
+static
+M3Result  EvaluateSegmentOffset  (IM3Module i_module, M3DataSegment * i_segment, i32 * o_offset)
+{
+    bytes_t start = i_segment->initExpr;
+    return EvaluateExpression (i_module, o_offset, c_m3Type_i32, & start, i_segment->initExpr + i_segment->initExprSize);
+}
+
+
+// i_offsets are the segments' offsets, if they've already been evaluated
+M3Result  InitDataSegments  (M3Memory * io_memory, IM3Module io_module, const i32 * i_offsets)
+{
+    M3Result result = m3Err_none;
+
+    for (u32 i = 0; i < io_module->numDataSegments; ++i)
+    {
+        M3DataSegment * segment = & io_module->dataSegments [i];
+
+        i32 segmentOffset;
+
+        if (i_offsets)
+            segmentOffset = i_offsets [i];
+        else
+_           (EvaluateSegmentOffset (io_module, segment, & segmentOffset));
+
+        m3log (runtime, "loading data segment: %d; size: %d; offset: %d", i, segment->size, segmentOffset);
+
+        if (segmentOffset >= 0 && (size_t)(segmentOffset) + segment->size <= io_memory->mallocated->header.length)
+        {
             u8 * dest = m3MemData (io_memory->mallocated) + segmentOffset;
+#if d_m3UseReservedMemory
+            if (io_module->fileDescriptor >= 0)
+            {
+_               (MapDataSegment (io_memory, io_module, dest, segment->data, segment->size));
+            }
+            else
+#endif
             memcpy (dest, segment->data, segment->size);
         } else {
             _throw ("data segment out of bounds");
@@ -541,6 +2164,11 @@ M3Result  m3_CompileModule  (IM3Module io_module)
 {
     M3Result result = m3Err_none;
 
+#if d_m3CodeCache
+    // what it couldn't compile is left to the loop below, which reports the error
+    CodeCache_CompileModule (io_module);
+#endif
+
     for (u32 i = 0; i < io_module->numFunctions; ++i)
     {
         IM3Function f = & io_module->functions [i];
@@ -553,6 +2181,151 @@ _           (CompileFunction (f));
     _catch: return result;
 }
 
+
+#if d_m3ParallelCompilation
+
+// each worker compiles with its own compilation state and code pages, in a runtime of its own
+typedef struct M3CompileWorker
+{
+    IM3Module               module;
+    volatile u32 *          nextFunction;       // shared by the workers
+
+    IM3Runtime              runtime;
+    M3Environment           environment;        // the runtime's; it has no released pages to hand out
+    M3CallSites             calls;
+
+    M3Result                result;
+}
+M3CompileWorker;
+
+
+static
+void *  CompileFunctions  (void * io_worker)
+{
+    M3CompileWorker * worker = (M3CompileWorker *) io_worker;
+    IM3Module module = worker->module;
+
+    while (not worker->result)
+    {
+        u32 i = __sync_fetch_and_add (worker->nextFunction, 1);
+
+        if (i >= module->numFunctions)
+            break;
+
+        IM3Function f = & module->functions [i];
+
+        if (f->wasm and not f->compiled)
+            worker->result = CompileFunctionOn (worker->runtime, f, & worker->calls);
+    }
+
+    return NULL;
+}
+
+
+#endif
+
+
+// the calling thread is one of the i_numThreads. the calls between functions compiled on different threads are left
+// to op_Compile until they're all done, then resolved
+M3Result  m3_CompileModuleInParallel  (IM3Module io_module, uint32_t i_numThreads)
+{
+#if d_m3ParallelCompilation
+    M3Result result = m3Err_none;
+
+    IM3Runtime runtime = io_module->runtime;
+
+    volatile u32 nextFunction = 0;
+    u32 numStarted = 0;
+
+    M3CompileWorker * workers = NULL;
+    pthread_t * threads = NULL;
+
+    long numOnline = sysconf (_SC_NPROCESSORS_ONLN);
+    u32 numProcessors = (numOnline > 0) ? (u32) numOnline : 1;
+
+    // threads beyond the processors only take turns, so with one processor online it's the serial path
+    if (not i_numThreads or i_numThreads > numProcessors)
+        i_numThreads = numProcessors;
+
+    // the code cache is written from the one runtime m3_CompileModule () compiles into
+    if (i_numThreads <= 1 or (d_m3CodeCache and io_module->environment->codeCacheDirectory))
+        return m3_CompileModule (io_module);
+
+    _throwif ("the module must be loaded first", not runtime);
+
+    workers = m3_AllocArray (M3CompileWorker, i_numThreads);
+    threads = m3_AllocArray (pthread_t, i_numThreads);
+
+    if (workers and threads)
+    {
+        for (u32 i = 0; i < i_numThreads; ++i)
+        {
+            M3CompileWorker * worker = & workers [i];
+
+            worker->module = io_module;
+            worker->nextFunction = & nextFunction;
+            worker->runtime = m3_AllocStruct (M3Runtime);
+
+            if (not worker->runtime)
+            {
+                result = m3Err_mallocFailed;
+                break;
+            }
+
+            worker->runtime->environment = & worker->environment;
+
+            if (i > 0 and pthread_create (& threads [i], NULL, CompileFunctions, worker))
+                break;
+
+            ++numStarted;
+        }
+
+        // the threads that did start take whatever those that didn't would have
+        if (numStarted)
+            CompileFunctions (& workers [0]);
+
+        for (u32 i = 1; i < numStarted; ++i)
+            pthread_join (threads [i], NULL);
+
+        for (u32 i = 0; i < i_numThreads; ++i)
+        {
+            M3CompileWorker * worker = & workers [i];
+
+            if (not result)
+                result = worker->result;
+
+            if (worker->runtime)
+            {                                                           d_m3Assert (worker->runtime->numActiveCodePages == 0);
+                AppendCodePages (& runtime->pagesOpen, worker->runtime->pagesOpen);
+                AppendCodePages (& runtime->pagesFull, worker->runtime->pagesFull);
+                runtime->numCodePages += worker->runtime->numCodePages;
+
+                m3_Free (worker->runtime);
+            }
+        }
+
+        // on failure, the calls stay op_Compiles, which still compile their callee when they're first run
+        for (u32 i = 0; i < i_numThreads; ++i)
+        {
+            if (not result)
+                ResolveCallSites (& workers [i].calls);
+
+            m3_Free (workers [i].calls.calls);
+        }
+    }
+    else result = m3Err_mallocFailed;
+
+    m3_Free (threads);
+    m3_Free (workers);
+
+    _catch: return result;
+#else
+    (void) i_numThreads;
+    return m3_CompileModule (io_module);
+#endif
+}
+
+
 M3Result  m3_RunStart  (IM3Module io_module)
 {
 #ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
@@ -582,7 +2355,7 @@ _           (CompileFunction (function));
         startFunctionTmp = io_module->startFunction;
         io_module->startFunction = -1;
 
-        result = (M3Result) RunCode (function->compiled, (m3stack_t) runtime->stack, (M3MemoryHeader *)runtime->memory.mallocated, d_m3OpDefaultArgs);
+        result = ExecuteCode (runtime, function->compiled);
 
         if (result)
         {
@@ -609,14 +2382,19 @@ M3Result  m3_LoadModule  (IM3Runtime io_runtime, IM3Module io_module)
 
 _   (InitMemory (io_runtime, io_module));
 _   (InitGlobals (io_module));
-_   (InitDataSegments (memory, io_module));
+_   (InitDataSegments (memory, io_module, NULL));
 _   (InitElements (io_module));
 
+#if d_m3CodeCache
+    CodeCache_LoadModule (io_module);
+#endif
+
     // Start func might use imported functions, which are not liked here yet,
     // so it will be called before a function call is attempted (in m3_FindFunction)
 
 #ifdef DEBUG
     Module_GenerateNames(io_module);
+_   (Module_IndexNames (io_module));
 #endif
 
     io_module->next = io_runtime->modules;
@@ -628,6 +2406,207 @@ _catch:
     return result;
 }
 
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  compiled modules
+//---------------------------------------------------------------------------------------------------------------------------------
+
+void  ReleaseCompiledModule  (M3CompiledModule * io_compiled)
+{
+    if (io_compiled and __sync_sub_and_fetch (& io_compiled->numReferences, 1) == 0)
+    {
+        m3_FreeRuntime (io_compiled->module->runtime);      // and the template with it
+        m3_Free (io_compiled->segmentOffsets);
+        m3_Free (io_compiled->calls.calls);
+        m3_Free (io_compiled);
+    }
+}
+
+
+M3Result  m3_NewCompiledModule  (IM3CompiledModule * o_compiled, IM3Module io_module)
+{
+    M3Result result = m3Err_none;
+
+    * o_compiled = NULL;
+
+    IM3Runtime runtime = io_module->runtime;
+    M3CompiledModule * compiled = NULL;
+
+    _throwif ("the module must be loaded first", not runtime);
+    _throwif ("the module must be its runtime's only one", runtime->modules != io_module or io_module->next);
+    _throwif ("the module is already compiled", io_module->compiled);
+
+#if d_m3CodeCache
+    // that code reaches the template's globals and tables directly, which the instances' can't
+    CodeCache_DiscardCode (io_module);
+#endif
+
+    for (u32 i = 0; i < io_module->numFunctions; ++i)
+    {
+        IM3Function function = & io_module->functions [i];
+        _throwif ("the module's functions are already compiled", function->wasm and function->compiled);
+    }
+
+    compiled = m3_AllocStruct (M3CompiledModule);
+    _throwifnull (compiled);
+
+    compiled->module = io_module;
+    compiled->numReferences = 1;
+
+    // the instances get the template's globals, so their segments go where its did. evaluating them would take
+    // code pages from the environment, which the threads making instances share
+    if (io_module->numDataSegments)
+    {
+        compiled->segmentOffsets = m3_AllocArray (i32, io_module->numDataSegments);
+        _throwifnull (compiled->segmentOffsets);
+
+        for (u32 i = 0; i < io_module->numDataSegments; ++i)
+_           (EvaluateSegmentOffset (io_module, & io_module->dataSegments [i], & compiled->segmentOffsets [i]));
+    }
+
+    io_module->compiled = compiled;
+
+    result = m3_CompileModule (io_module);
+
+    if (result)
+    {
+        // what did compile can't be run outside of an instance. the module can still be compiled over again
+        for (u32 i = 0; i < io_module->numFunctions; ++i)
+        {
+            IM3Function function = & io_module->functions [i];
+
+            if (function->wasm)
+                function->compiled = NULL;
+        }
+
+        io_module->compiled = NULL;
+    }
+    else
+    {
+        ResolveCallSites (& compiled->calls);
+        * o_compiled = compiled;
+        compiled = NULL;
+    }
+
+    _catch:
+    if (compiled)
+    {
+        m3_Free (compiled->segmentOffsets);
+        m3_Free (compiled->calls.calls);
+        m3_Free (compiled);
+    }
+
+    return result;
+}
+
+
+void  m3_FreeCompiledModule  (IM3CompiledModule i_compiled)
+{
+    ReleaseCompiledModule (i_compiled);
+}
+
+
+// the instance is a copy of the template that shares its IM3Functions' code and everything it parsed. it gets its own
+// functions, to point at it, and its own globals and tables
+M3Result  m3_InstantiateModule  (IM3Runtime io_runtime, IM3CompiledModule i_compiled, IM3Module * o_instance)
+{
+    M3Result result = m3Err_none;
+
+    * o_instance = NULL;
+
+    IM3Module original = i_compiled->module;
+    IM3Module instance = NULL;
+    M3MemoryHeader * header = NULL;
+
+    _throwif ("the runtime already has an instance of a compiled module", io_runtime->codeRuntime);
+    _throwif ("the runtime is of another environment", io_runtime->environment != original->environment);
+
+    instance = m3_AllocStruct (M3Module);
+    _throwifnull (instance);
+
+    * instance = * original;
+
+    __sync_fetch_and_add (& i_compiled->numReferences, 1);
+
+    instance->runtime = NULL;
+    instance->functions = NULL;
+    instance->allFunctions = 0;
+    instance->globals = NULL;
+    instance->tables = NULL;
+    instance->numTables = 0;
+    instance->next = NULL;
+
+    if (original->numFunctions)
+    {
+        instance->functions = m3_AllocArray (M3Function, original->numFunctions);
+        _throwifnull (instance->functions);
+
+        memcpy (instance->functions, original->functions, original->numFunctions * sizeof (M3Function));
+        instance->allFunctions = original->numFunctions;
+
+        for (u32 i = 0; i < instance->numFunctions; ++i)
+            instance->functions [i].module = instance;
+    }
+
+    if (original->numGlobals)
+    {
+        instance->globals = m3_AllocArray (M3Global, original->numGlobals);
+        _throwifnull (instance->globals);
+
+        memcpy (instance->globals, original->globals, original->numGlobals * sizeof (M3Global));
+    }
+
+    if (original->numTables)
+    {
+        instance->tables = m3_AllocArray (M3Table, original->numTables);
+        _throwifnull (instance->tables);
+
+        for (u32 t = 0; t < original->numTables; ++t)
+        {
+            M3Table * from = & original->tables [t];
+            M3Table * table = & instance->tables [t];
+
+            * table = * from;
+            table->functions = NULL;
+            ++instance->numTables;
+
+            if (from->elements)
+            {
+                table->functions = m3_AllocArray (IM3Function, from->elements);
+                _throwifnull (table->functions);
+
+                for (u32 e = 0; e < from->elements; ++e)
+                {
+                    IM3Function function = from->functions [e];
+                    table->functions [e] = function ? instance->functions + (function - original->functions) : NULL;
+                }
+            }
+        }
+    }
+
+    instance->runtime = io_runtime;
+
+_   (InitMemory (io_runtime, instance));
+_   (InitDataSegments (& io_runtime->memory, instance, i_compiled->segmentOffsets));
+
+    header = & io_runtime->memory.mallocated->header;
+    header->instance = instance;
+    header->globals = instance->globals;
+
+    io_runtime->codeRuntime = original->runtime;
+
+    instance->next = io_runtime->modules;
+    io_runtime->modules = instance;
+
+    * o_instance = instance;
+    instance = NULL;
+
+    _catch:
+    m3_FreeModule (instance);
+
+    return result;
+}
+
 IM3Global  m3_FindGlobal  (IM3Module               io_module,
                            const char * const      i_globalName)
 {
@@ -705,19 +2684,19 @@ M3ValueType  m3_GetGlobalType  (IM3Global          i_global)
 
 void *  v_FindFunction  (IM3Module i_module, const char * const i_name)
 {
-    for (u32 i = 0; i < i_module->numFunctions; ++i)
-    {
-        IM3Function f = & i_module->functions [i];
-
-        bool isImported = f->import.moduleUtf8 or f->import.fieldUtf8;
-
-        if (isImported)
-            continue;
+    const M3NameIndex * exports = & i_module->exports;
 
-        for (int j = 0; j < f->numNames; j++)
+    if (exports->slots)
+    {
+        for (u32 s = HashName (i_name) & exports->mask; exports->slots [s]; s = (s + 1) & exports->mask)
         {
-            if (f->names [j] and strcmp (f->names [j], i_name) == 0)
-                return f;
+            IM3Function f = & i_module->functions [exports->slots [s] - 1];
+
+            for (int j = 0; j < f->numNames; j++)
+            {
+                if (f->names [j] and strcmp (f->names [j], i_name) == 0)
+                    return f;
+            }
         }
     }
 
@@ -877,7 +2856,7 @@ M3Result  m3_CallVL  (IM3Function i_function, va_list i_args)
 
 _   (checkStartFunction(i_function->module))
 
-    result = (M3Result) RunCode (i_function->compiled, (m3stack_t)(runtime->stack), runtime->memory.mallocated, d_m3OpDefaultArgs);
+    result = ExecuteCode (runtime, i_function->compiled);
     ReportNativeStackUsage ();
 
     runtime->lastCalled = result ? NULL : i_function;
@@ -921,7 +2900,7 @@ M3Result  m3_Call  (IM3Function i_function, uint32_t i_argc, const void * i_argp
 
 _   (checkStartFunction(i_function->module))
 
-    result = (M3Result) RunCode (i_function->compiled, (m3stack_t)(runtime->stack), runtime->memory.mallocated, d_m3OpDefaultArgs);
+    result = ExecuteCode (runtime, i_function->compiled);
     ReportNativeStackUsage ();
 
     runtime->lastCalled = result ? NULL : i_function;
@@ -965,7 +2944,7 @@ M3Result  m3_CallArgv  (IM3Function i_function, uint32_t i_argc, const char * i_
 
 _   (checkStartFunction(i_function->module))
 
-    result = (M3Result) RunCode (i_function->compiled, (m3stack_t)(runtime->stack), runtime->memory.mallocated, d_m3OpDefaultArgs);
+    result = ExecuteCode (runtime, i_function->compiled);
     ReportNativeStackUsage ();
 
     runtime->lastCalled = result ? NULL : i_function;
@@ -32,6 +32,12 @@ typedef struct M3Memory
 
     u32                     numPages;
     u32                     maxPages;
+#if d_m3UseReservedMemory
+    size_t                  reservedBytes;      // address space behind mallocated->dataBuffer; see ResizeReservedMemory ()
+    M3MemoryBacking         backing;
+    struct M3DirtyPages *   dirtyPages;         // see m3_TrackDirtyPages ()
+    struct M3SharedMemory * shared;             // see m3_SetSharedMemory (); isImported is set with it
+#endif
     
     bool                    isImported;  // 该参数为 true 时，代表 mallocated->dataBuffer 指向的内存为 M3 外部分配
     IM3MemToGrowCallback    memToGrowCallback;
@@ -89,6 +95,22 @@ typedef struct M3Global
 M3Global;
 
 
+//---------------------------------------------------------------------------------------------------------------------------------
+
+// an open addressed hash table of indices, keyed by a name each (see HashName ()). the indices with a given hash are
+// in the slots from hash & mask on, up to an empty one, in the order they were inserted
+typedef struct M3NameIndex
+{
+    u32 *                   slots;                  // an index + 1, or 0 for an empty slot. NULL with no indices
+    u32                     mask;                   // the number of slots - 1
+}
+M3NameIndex;
+
+M3Result                    NameIndex_Init              (M3NameIndex * o_index, u32 i_numIndices);
+void                        NameIndex_Insert            (M3NameIndex * io_index, cstr_t i_name, u32 i_index);
+void                        NameIndex_Release           (M3NameIndex * io_index);
+
+
 //---------------------------------------------------------------------------------------------------------------------------------
 typedef struct M3Module
 {
@@ -98,6 +120,9 @@ typedef struct M3Module
     bytes_t                 wasmStart;
     bytes_t                 wasmEnd;
 
+    int                     fileDescriptor;         // the file wasmStart is mapped from, or -1; see m3_SetModuleFile ()
+    u64                     fileOffset;
+
     cstr_t                  name;
 
     u32                     numFuncTypes;
@@ -127,12 +152,40 @@ typedef struct M3Module
     M3Table *               tables;
     u32                     numTables;
 
-    //bool                    hasWasmCodeCopy;
+    bool                    hasWasmCodeCopy;        // wasmStart is the module's to free; see m3_NewModuleStream ()
+    bool                    codeFromCache;          // the functions' code was read from the code cache; see m3_SetCodeCacheDirectory ()
+
+    struct M3CompiledModule * compiled;             // the compiled module this is the template or an instance of; see m3_NewCompiledModule ()
+
+    M3NameIndex             exports;                // the functions by their names, but the imported ones; see Module_IndexNames ()
+    M3NameIndex             imports;                // the imported functions by their field names. both are the template's in an instance
 
     struct M3Module *       next;
 }
 M3Module;
 
+// the module compiled in its own runtime, whose code and IM3Functions its instances share. the compiler leaves
+// the globals and tables to be found through the running instance; see m3_NewCompiledModule ()
+typedef struct M3CompiledModule
+{
+    IM3Module               module;                 // the template; it and its runtime are never run
+    volatile u32            numReferences;          // one, plus one for each instance; instances can be made on any thread
+
+    i32 *                   segmentOffsets;         // the data segments' offsets in the memory
+
+    M3CallSites             calls;                  // the op_Compile calls to resolve once every function is compiled
+}
+M3CompiledModule;
+
+void                        ReleaseCompiledModule       (M3CompiledModule * io_compiled);
+
+# if d_m3CodeCache
+// m3_cache.c. both only do anything with a cache directory set, and leave the module as it was when they can't
+void                        CodeCache_CompileModule     (IM3Module io_module);
+void                        CodeCache_LoadModule        (IM3Module io_module);
+void                        CodeCache_DiscardCode       (IM3Module io_module);
+# endif
+
 M3Result                    Module_AddGlobal            (IM3Module io_module, IM3Global * o_global, u8 i_type, bool i_mutable, bool i_isImported);
 
 M3Result                    Module_PreallocFunctions    (IM3Module io_module, u32 i_totalFunctions);
@@ -140,6 +193,7 @@ M3Result                    Module_AddFunction          (IM3Module io_module, u3
 IM3Function                 Module_GetFunction          (IM3Module i_module, u32 i_functionIndex);
 
 void                        Module_GenerateNames        (IM3Module i_module);
+M3Result                    Module_IndexNames           (IM3Module io_module);
 
 void                        FreeImportInfo              (M3ImportInfo * i_info);
 
@@ -156,6 +210,8 @@ typedef struct M3Environment
     M3CodePage *            pagesReleased;
 
     M3SectionHandler        customSectionHandler;
+
+    cstr_t                  codeCacheDirectory;                 // see m3_SetCodeCacheDirectory ()
 }
 M3Environment;
 
@@ -179,6 +235,11 @@ typedef struct M3Runtime
     u32                     numActiveCodePages;
 
     IM3Module               modules;        // linked list of imported modules
+    struct M3Runtime *      codeRuntime;    // holds the code of an instantiated compiled module; see m3_InstantiateModule ()
+    M3CodeWords *           codeWords;      // set on the runtime a module is compiled into for the code cache; see m3_cache.c
+#if !d_m3TrampolinedExecution
+    pc_t                    tailCallPC;     // the callee of a return_call on its way out to be called; see TailCallFunction ()
+#endif
 
     void *                  stack;
     u32                     stackSize;
@@ -207,11 +268,58 @@ typedef struct M3Runtime
 }
 M3Runtime;
 
+//---------------------------------------------------------------------------------------------------------------------------------
+
+typedef struct M3TableSnapshot
+{
+    u32                     elements;
+    IM3Function *           functions;
+}
+M3TableSnapshot;
+
+typedef struct M3ModuleSnapshot
+{
+    IM3Module               module;
+    i32                     startFunction;
+
+    u32                     numGlobals;
+    i64 *                   globals;            // the raw M3Global value unions
+
+    u32                     numTables;
+    M3TableSnapshot *       tables;
+}
+M3ModuleSnapshot;
+
+typedef struct M3Snapshot
+{
+    IM3Runtime              runtime;
+    IM3Function             lastCalled;
+
+    u32                     numPages;
+    size_t                  length;
+    u8 *                    data;               // a copy of the memory. or:
+#if d_m3UseReservedMemory
+    int                     fd;                 // a memfd with the memory, which m3_RestoreSnapshot () maps copy-on-write
+    size_t                  fdBytes;
+#endif
+
+    u32                     numModules;
+    M3ModuleSnapshot *      modules;
+}
+M3Snapshot;
+
+//---------------------------------------------------------------------------------------------------------------------------------
+
 void                        InitRuntime                 (IM3Runtime io_runtime, u32 i_stackSizeInBytes);
 void                        Runtime_Release             (IM3Runtime io_runtime);
 
 M3Result                    ResizeMemory                (IM3Runtime io_runtime, u32 i_numPages);
 
+#if d_m3UseReservedMemory
+void                        SyncSharedMemory            (IM3Runtime io_runtime);
+i32                         GrowSharedMemory            (IM3Runtime io_runtime, u32 i_numPagesToGrow);
+#endif
+
 typedef void *              (* ModuleVisitor)           (IM3Module i_module, void * i_info);
 void *                      ForEachModule               (IM3Runtime i_runtime, ModuleVisitor i_visitor, void * i_info);
 
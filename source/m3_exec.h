@@ -16,7 +16,9 @@
 // About the naming convention of these operations/macros (_rs, _sr_, _ss, _srs, etc.)
 //------------------------------------------------------------------------------------------------------
 //   - 'r' means register and 's' means slot
-//   - the first letter is the top of the stack
+//   - 'i' means an immediate, embedded in the code stream (e.g. the constant addend of a _si load address)
+//   - the first letter is the top of the stack, except for an immediate, which always comes last
+//     (_ri/_si: the first operand is in a register/slot and the top of the stack was a constant)
 //
 //  so, for example, _rs means the first operand (the first thing pushed to the stack) is in a slot
 //  and the second operand (the top of the stack) is in a register
@@ -44,6 +46,9 @@ d_m3BeginExternC
 # define slot(TYPE)                 * (TYPE *) (_sp + immediate (i32))
 # define slot_ptr(TYPE)             (TYPE *) (_sp + immediate (i32))
 
+// a 64-bit immediate takes up two code words on 32-bit platforms
+# define immediateNumWords(TYPE)    ((sizeof (TYPE) + sizeof (void *) - 1) / sizeof (void *))
+
 
 # if d_m3EnableOpProfiling
                                     d_m3RetSig  profileOp   (d_m3OpSig, cstr_t i_operationName);
@@ -57,6 +62,14 @@ d_m3BeginExternC
 
 #define jumpOp(PC)                  jumpOpDirect(PC)
 
+# if d_m3TrampolinedExecution
+#   define returnOp()               trampoline (NULL, _sp)
+#   define continueLoop(PC)         trampoline ((pc_t) (PC), _sp)
+# else
+#   define returnOp()               return m3Err_none
+#   define continueLoop(PC)         return (PC)
+# endif
+
 #if d_m3RecordBacktraces
     #define pushBacktraceFrame()            (PushBacktraceFrame (_mem->runtime, _pc - 1))
     #define fillBacktraceFrame(FUNCTION)    (FillBacktraceFunctionInfo (_mem->runtime, function))
@@ -108,15 +121,69 @@ d_m3BeginExternC
 
 #endif
 
+#if d_m3UseGuardPages && d_m3RecordBacktraces
+// a guard page fault can't tell which op it came from, so the ops that can fault leave their _pc first
+#   define d_m3RecordAccessPC           _mem->accessPC = _pc;
+#else
+#   define d_m3RecordAccessPC
+#endif
+
 
 d_m3RetSig  Call  (d_m3OpSig)
 {
     m3ret_t possible_trap = m3_Yield ();
     if (M3_UNLIKELY(possible_trap)) return possible_trap;
 
-    nextOpDirect();
+#if d_m3TrampolinedExecution
+    return nextOpImpl ();
+#else
+    IM3Runtime runtime = m3MemRuntime (_mem);
+
+    m3ret_t r = nextOpImpl ();
+
+    // the function called made a return_call: its callee is called from here instead. see TailCallFunction ()
+    while (M3_UNLIKELY(r == runtime))
+    {
+        _pc = runtime->tailCallPC;
+        _mem = & runtime->memory.mallocated->header;
+
+        r = nextOpImpl ();
+    }
+
+    return r;
+#endif
 }
 
+#if d_m3TrampolinedExecution
+d_m3Op  (Entry);
+d_m3Op  (Entry_LocalRanges);
+
+// imported functions start with op_CallRawFunction instead and are still called natively
+static inline
+bool  IsWasmFunctionCode  (pc_t i_pc)
+{
+    IM3Operation op = (IM3Operation) (* i_pc);
+    return (op == op_Entry or op == op_Entry_LocalRanges);
+}
+
+// leaves the caller's resume point in a record just below the callee's frame and has RunCode () enter the callee
+d_m3RetSig  PushCall  (d_m3OpSig, pc_t i_callPC, m3stack_t i_sp)
+{
+    m3ret_t possible_trap = m3_Yield ();
+    if (M3_UNLIKELY(possible_trap)) return possible_trap;
+
+    M3CallRecord * record = (M3CallRecord *) i_sp - 1;
+    record->pc = _pc;
+    record->sp = _sp;
+    record->r0 = _r0;
+#   if d_m3HasFloat
+    record->fp0 = _fp0;
+#   endif
+
+    trampoline (i_callPC, i_sp);
+}
+#endif
+
 // TODO: OK, this needs some explanation here ;0
 
 #define d_m3CommutativeOpMacro(RES, REG, TYPE, NAME, OP, ...) \
@@ -143,9 +210,29 @@ d_m3Op(TYPE##_##NAME##_sr)                              \
 }                                                       \
 d_m3CommutativeOpMacro(RES, REG, TYPE,NAME, OP, ##__VA_ARGS__)
 
+// the top operand was a constant, so it's read from the code stream instead of the constant table
+#define d_m3ImmediateOpMacro(RES, REG, TYPE, NAME, OP, ...) \
+d_m3Op(TYPE##_##NAME##_ri)                              \
+{                                                       \
+    TYPE operand = * (TYPE *) _pc;                      \
+    _pc += immediateNumWords (TYPE);                    \
+    OP((RES), ((TYPE) REG), operand, ##__VA_ARGS__);    \
+    nextOp ();                                          \
+}                                                       \
+d_m3Op(TYPE##_##NAME##_si)                              \
+{                                                       \
+    TYPE operand1 = slot (TYPE);                        \
+    TYPE operand2 = * (TYPE *) _pc;                     \
+    _pc += immediateNumWords (TYPE);                    \
+    OP((RES), operand1, operand2, ##__VA_ARGS__);       \
+    nextOp ();                                          \
+}
+
 // Accept macros
-#define d_m3CommutativeOpMacro_i(TYPE, NAME, MACRO, ...)    d_m3CommutativeOpMacro  ( _r0,  _r0, TYPE, NAME, MACRO, ##__VA_ARGS__)
-#define d_m3OpMacro_i(TYPE, NAME, MACRO, ...)               d_m3OpMacro             ( _r0,  _r0, TYPE, NAME, MACRO, ##__VA_ARGS__)
+#define d_m3CommutativeOpMacro_i(TYPE, NAME, MACRO, ...)    d_m3CommutativeOpMacro  ( _r0,  _r0, TYPE, NAME, MACRO, ##__VA_ARGS__) \
+                                                            d_m3ImmediateOpMacro    ( _r0,  _r0, TYPE, NAME, MACRO, ##__VA_ARGS__)
+#define d_m3OpMacro_i(TYPE, NAME, MACRO, ...)               d_m3OpMacro             ( _r0,  _r0, TYPE, NAME, MACRO, ##__VA_ARGS__) \
+                                                            d_m3ImmediateOpMacro    ( _r0,  _r0, TYPE, NAME, MACRO, ##__VA_ARGS__)
 #define d_m3CommutativeOpMacro_f(TYPE, NAME, MACRO, ...)    d_m3CommutativeOpMacro  (_fp0, _fp0, TYPE, NAME, MACRO, ##__VA_ARGS__)
 #define d_m3OpMacro_f(TYPE, NAME, MACRO, ...)               d_m3OpMacro             (_fp0, _fp0, TYPE, NAME, MACRO, ##__VA_ARGS__)
 
@@ -222,6 +309,38 @@ d_m3Op_f (f32, Subtract,                    -)      d_m3Op_f (f64, Subtract,
 d_m3Op_f (f32, Divide,                      /)      d_m3Op_f (f64, Divide,                      /)
 #endif
 
+// Three-address operations: slot = slot OP slot
+// these cover 'local.get a; local.get b; OP; local.set c' without passing through a register
+
+#define d_m3ThreeAddressOpMacro(TYPE, NAME, OP, ...)    \
+d_m3Op(TYPE##_##NAME##_s_ss)                            \
+{                                                       \
+    TYPE * dest = slot_ptr (TYPE);                      \
+    TYPE operand2 = slot (TYPE);                        \
+    TYPE operand1 = slot (TYPE);                        \
+    OP((* dest), operand1, operand2, ##__VA_ARGS__);    \
+    nextOp ();                                          \
+}
+
+#define d_m3ThreeAddressOp(TYPE, NAME, OP)          d_m3ThreeAddressOpMacro (TYPE, NAME, M3_OPER, OP)
+#define d_m3ThreeAddressOpFunc(TYPE, NAME, OP)      d_m3ThreeAddressOpMacro (TYPE, NAME, M3_FUNC, OP)
+
+d_m3ThreeAddressOp (i32, Add,               +)      d_m3ThreeAddressOp (i64, Add,               +)
+d_m3ThreeAddressOp (i32, Subtract,          -)      d_m3ThreeAddressOp (i64, Subtract,          -)
+d_m3ThreeAddressOp (i32, Multiply,          *)      d_m3ThreeAddressOp (i64, Multiply,          *)
+d_m3ThreeAddressOp (u32, And,               &)      d_m3ThreeAddressOp (u64, And,               &)
+d_m3ThreeAddressOp (u32, Or,                |)      d_m3ThreeAddressOp (u64, Or,                |)
+d_m3ThreeAddressOp (u32, Xor,               ^)      d_m3ThreeAddressOp (u64, Xor,               ^)
+
+d_m3ThreeAddressOpFunc (u32, ShiftLeft,     OP_SHL_32)      d_m3ThreeAddressOpFunc (u64, ShiftLeft,     OP_SHL_64)
+d_m3ThreeAddressOpFunc (i32, ShiftRight,    OP_SHR_32)      d_m3ThreeAddressOpFunc (i64, ShiftRight,    OP_SHR_64)
+d_m3ThreeAddressOpFunc (u32, ShiftRight,    OP_SHR_32)      d_m3ThreeAddressOpFunc (u64, ShiftRight,    OP_SHR_64)
+
+#if d_m3HasFloat
+d_m3ThreeAddressOp (f64, Add,               +)
+d_m3ThreeAddressOp (f64, Multiply,          *)
+#endif
+
 d_m3OpFunc_i(u32, Rotl, rotl32)
 d_m3OpFunc_i(u32, Rotr, rotr32)
 d_m3OpFunc_i(u64, Rotl, rotl64)
@@ -537,6 +656,11 @@ d_m3Op  (Call)
 
     m3stack_t sp = _sp + stackOffset;
 
+#if d_m3TrampolinedExecution
+    if (IsWasmFunctionCode (callPC))
+        return PushCall (d_m3OpAllArgs, callPC, sp);
+#endif
+
     m3ret_t r = Call (callPC, sp, _mem, d_m3OpDefaultArgs);
     _mem = memory->mallocated;
 
@@ -559,6 +683,9 @@ d_m3Op  (CallIndirect)
     i32 stackOffset             = immediate (i32);
     IM3Memory memory            = m3MemInfo (_mem);
 
+    if (not module)             // shared code; the tables are the instance's
+        module = m3MemInstance (_mem);
+
     m3stack_t sp = _sp + stackOffset;
 
     m3ret_t r = m3Err_none;
@@ -578,6 +705,10 @@ d_m3Op  (CallIndirect)
 
                     if (M3_LIKELY(not r))
                     {
+#if d_m3TrampolinedExecution
+                        if (IsWasmFunctionCode (function->compiled))
+                            return PushCall (d_m3OpAllArgs, function->compiled, sp);
+#endif
                         r = Call (function->compiled, sp, _mem, d_m3OpDefaultArgs);
                         _mem = memory->mallocated;
 
@@ -652,6 +783,7 @@ d_m3Op  (CallRawFunction)
     // I.e. exported/table function can be called from an impoted function.
     void* stack_backup = runtime->stack;
     runtime->stack = sp;
+    d_m3RecordAccessPC
     m3ret_t possible_trap = call (runtime, &ctx, sp, m3MemData(_mem));
     runtime->stack = stack_backup;
 
@@ -681,6 +813,12 @@ d_m3Op  (MemSize)
 {
     IM3Memory memory            = m3MemInfo (_mem);
 
+#if d_m3UseReservedMemory
+    // another runtime may have grown it
+    if (M3_UNLIKELY(memory->shared))
+        SyncSharedMemory (m3MemRuntime (_mem));
+#endif
+
     _r0 = memory->numPages;
 
     nextOp ();
@@ -695,6 +833,14 @@ d_m3Op  (MemGrow)
     u32 numPagesToGrow = (u32) _r0;
     _r0 = memory->numPages;
 
+#if d_m3UseReservedMemory
+    if (memory->shared)
+    {
+        _r0 = GrowSharedMemory (runtime, numPagesToGrow);
+        _mem = & memory->mallocated->header;
+    }
+    else
+#endif
     if (M3_LIKELY(numPagesToGrow))
     {
         u32 requiredPages = memory->numPages + numPagesToGrow;
@@ -788,14 +934,44 @@ d_m3Op  (Compile)
 
 
 
-d_m3Op  (Entry)
+// op_Entry zeroes all the locals; op_Entry_LocalRanges only those that can be read before they're set.
+// see ResolveLocalInitRanges () in m3_compile.c
+static inline
+void  InitializeLocals  (IM3Function i_function, m3stack_t i_sp, bool i_zeroAllLocals)
+{
+    u8 * stack = (u8 *) ((m3slot_t *) i_sp + i_function->numRetAndArgSlots);
+
+    if (i_zeroAllLocals)
+    {
+        memset (stack, 0x0, i_function->numLocalBytes);
+    }
+    else
+    {
+        u16 * range = i_function->localInitRanges;
+
+        for (u16 i = 0; i < i_function->numLocalInitRanges; ++i, range += 2)
+        {
+            m3slot_t * slot = (m3slot_t *) stack + range [0];
+
+            for (u16 n = range [1]; n; --n)
+                * slot++ = 0;
+        }
+    }
+    stack += i_function->numLocalBytes;
+
+    if (i_function->constants)
+    {
+        memcpy (stack, i_function->constants, i_function->numConstantBytes);
+    }
+}
+
+d_m3RetSig  EnterFunction  (d_m3OpSig, bool i_zeroAllLocals)
 {
     d_m3ClearRegisters
 
     d_m3TracePrepare
 
     IM3Function function = immediate (IM3Function);
-    IM3Memory memory = m3MemInfo (_mem);
 
 #if d_m3SkipStackCheck
     if (true)
@@ -806,15 +982,14 @@ d_m3Op  (Entry)
 #if defined(DEBUG)
         function->hits++;
 #endif
-        u8 * stack = (u8 *) ((m3slot_t *) _sp + function->numRetAndArgSlots);
-
-        memset (stack, 0x0, function->numLocalBytes);
-        stack += function->numLocalBytes;
+        InitializeLocals (function, _sp, i_zeroAllLocals);
 
-        if (function->constants)
-        {
-            memcpy (stack, function->constants, function->numConstantBytes);
-        }
+#if d_m3TrampolinedExecution
+        // nothing to wait for; op_Return hands the frame back to RunCode ()
+        nextOp ();
+#else
+        IM3Runtime runtime = m3MemRuntime (_mem);
+        IM3Memory memory = & runtime->memory;
 
 #if d_m3EnableStrace >= 2
         d_m3TracePrint("%s %s {", m3_GetFunctionName(function), SPrintFunctionArgList (function, _sp + function->numRetSlots));
@@ -823,10 +998,12 @@ d_m3Op  (Entry)
 
         m3ret_t r = nextOpImpl ();
 
+        bool isTrap = r and r != runtime;      // or a return_call on its way out; see TailCallFunction ()
+
 #if d_m3EnableStrace >= 2
         trace_rt->callDepth--;
 
-        if (r) {
+        if (isTrap) {
             d_m3TracePrint("} !trap = %s", (char*)r);
         } else {
             int rettype = GetSingleRetType(function->funcType);
@@ -840,18 +1017,125 @@ d_m3Op  (Entry)
         }
 #endif
 
-        if (M3_UNLIKELY(r)) {
+        if (M3_UNLIKELY(isTrap)) {
             _mem = memory->mallocated;
             fillBacktraceFrame ();
         }
         forwardTrap (r);
+#endif
     }
     else newTrap (m3Err_trapStackOverflow);
 }
 
+d_m3Op  (Entry)
+{
+    return EnterFunction (d_m3OpAllArgs, true);
+}
+
+d_m3Op  (Entry_LocalRanges)
+{
+    return EnterFunction (d_m3OpAllArgs, false);
+}
+
+
+// return_call: the callee takes over the caller's frame, its arguments moved down over the caller's, and hands its
+// results straight to the caller's caller. with d_m3TrampolinedExecution, RunCode () enters it in that frame. otherwise
+// the caller's native frame has to go first, and those of the loops it's in: the callee's pc is left in the runtime
+// and the runtime handed back, out to the Call () or RunCode () that called the caller, which calls the callee
+d_m3RetSig  TailCallFunction  (d_m3OpSig, IM3Function i_function, m3stack_t i_args)
+{
+    IM3FuncType type = i_function->funcType;
+    u32 numRetSlots = type->numRets * c_ioSlotCount;
+
+    memmove (_sp + numRetSlots, i_args + numRetSlots, type->numArgs * c_ioSlotCount * sizeof (m3slot_t));
+
+#if d_m3TrampolinedExecution
+    if (IsWasmFunctionCode (i_function->compiled))
+        jumpOp (i_function->compiled);
+
+    // an imported function can't come back through RunCode (); it's called from the caller's frame
+    m3ret_t r = Call (i_function->compiled, _sp, _mem, d_m3OpDefaultArgs);
+
+    if (M3_UNLIKELY(r))
+    {
+        pushBacktraceFrame ();
+        forwardTrap (r);
+    }
+
+    returnOp ();
+#else
+    IM3Runtime runtime = m3MemRuntime (_mem);
+    runtime->tailCallPC = i_function->compiled;
+
+    return runtime;
+#endif
+}
+
+
+d_m3Op  (TailCall)
+{
+    IM3Function function        = immediate (IM3Function);
+    i32 stackOffset             = immediate (i32);
+
+    if (M3_UNLIKELY(not function->compiled))
+    {
+        m3ret_t r = CompileFunction (function);
+
+        if (r)
+            newTrap (r);
+    }
+
+    return TailCallFunction (d_m3OpAllArgs, function, _sp + stackOffset);
+}
+
+
+d_m3Op  (TailCallIndirect)
+{
+    u32 tableIndex              = immediate (u32);
+    u32 index                   = slot (u32);
+    IM3Module module            = immediate (IM3Module);
+    IM3FuncType type            = immediate (IM3FuncType);
+    i32 stackOffset             = immediate (i32);
+
+    if (not module)             // shared code; the tables are the instance's
+        module = m3MemInstance (_mem);
+
+    m3ret_t r = m3Err_none;
+
+    if (M3_LIKELY(tableIndex < module->numTables))
+    {
+        IM3Table table = &module->tables[tableIndex];
+        if (M3_LIKELY(index < table->elements))
+        {
+            IM3Function function = table->functions[index];
+
+            if (M3_LIKELY(function)) {
+                if (M3_LIKELY(type == function->funcType))
+                {
+                    if (M3_UNLIKELY(not function->compiled))
+                        r = CompileFunction (function);
+
+                    if (M3_LIKELY(not r))
+                        return TailCallFunction (d_m3OpAllArgs, function, _sp + stackOffset);
+                }
+                else r = m3Err_trapIndirectCallTypeMismatch;
+            }
+            else r = m3Err_trapTableElementIsNull;
+        }
+        else r = m3Err_trapElementIndexOutOfRange;
+    }
+    else r = m3Err_trapTableIndexOutOfRange;
+
+    newTrap (r);
+}
+
 
 d_m3Op  (Loop)
 {
+#if d_m3TrampolinedExecution
+    // op_ContinueLoop hands this pc back to RunCode () for every iteration
+    nextOp ();
+#else
     d_m3TracePrepare
 
     // regs are unused coming into a loop anyway
@@ -881,6 +1165,7 @@ d_m3Op  (Loop)
     while (r == _pc);
 
     forwardTrap (r);
+#endif
 }
 
 
@@ -1143,7 +1428,7 @@ d_m3Select_f (f64, _fp0, s, slot (i32))
 d_m3Op  (Return)
 {
     m3StackCheck();
-    return m3Err_none;
+    returnOp ();
 }
 
 
@@ -1210,7 +1495,7 @@ d_m3Op  (ContinueLoop)
     // has the potential to increase its native-stack usage. (don't forget ContinueLoopIf too.)
 
     void * loopId = immediate (void *);
-    return loopId;
+    continueLoop (loopId);
 }
 
 
@@ -1221,12 +1506,113 @@ d_m3Op  (ContinueLoopIf)
 
     if (condition)
     {
-        return loopId;
+        continueLoop (loopId);
     }
     else nextOp ();
 }
 
 
+// Fused compare & branch operations
+//------------------------------------------------------------------------------------------------------
+//   - BranchIf_*:          jumps to the immediate pc if the comparison holds (br_if)
+//   - BranchIfNot_*:       jumps if it doesn't. 'if' uses these for fp compares, which can't simply be
+//                          inverted because of NaN. integer 'if' uses the BranchIf_ of the inverse compare
+//   - ContinueLoopIf_*:    continues the enclosing loop if the comparison holds (br_if to a loop)
+//------------------------------------------------------------------------------------------------------
+
+#define M3_BRANCH_IF(COND, TARGET)              if (COND) { jumpOp (TARGET); }
+#define M3_BRANCH_IF_NOT(COND, TARGET)          if (not (COND)) { jumpOp (TARGET); }
+#define M3_CONTINUE_LOOP_IF(COND, TARGET)       if (COND) { continueLoop (TARGET); }
+
+#define d_m3CommutativeCmpBranchMacro(PREFIX, BRANCH, REG, TYPE, NAME, OP) \
+d_m3Op(PREFIX##_##TYPE##_##NAME##_rs)                   \
+{                                                       \
+    TYPE operand = slot (TYPE);                         \
+    pc_t target = immediate (pc_t);                     \
+    BRANCH ((operand OP ((TYPE) REG)), target)          \
+    nextOp ();                                          \
+}                                                       \
+d_m3Op(PREFIX##_##TYPE##_##NAME##_ss)                   \
+{                                                       \
+    TYPE operand2 = slot (TYPE);                        \
+    TYPE operand1 = slot (TYPE);                        \
+    pc_t target = immediate (pc_t);                     \
+    BRANCH ((operand1 OP operand2), target)             \
+    nextOp ();                                          \
+}
+
+#define d_m3CmpBranchMacro(PREFIX, BRANCH, REG, TYPE, NAME, OP) \
+d_m3Op(PREFIX##_##TYPE##_##NAME##_sr)                   \
+{                                                       \
+    TYPE operand = slot (TYPE);                         \
+    pc_t target = immediate (pc_t);                     \
+    BRANCH ((((TYPE) REG) OP operand), target)          \
+    nextOp ();                                          \
+}                                                       \
+d_m3CommutativeCmpBranchMacro(PREFIX, BRANCH, REG, TYPE, NAME, OP)
+
+#define d_m3UnaryCmpBranchMacro(PREFIX, BRANCH, REG, TYPE, NAME, OP) \
+d_m3Op(PREFIX##_##TYPE##_##NAME##_r)                    \
+{                                                       \
+    pc_t target = immediate (pc_t);                     \
+    BRANCH (OP ((TYPE) REG), target)                    \
+    nextOp ();                                          \
+}                                                       \
+d_m3Op(PREFIX##_##TYPE##_##NAME##_s)                    \
+{                                                       \
+    TYPE operand = slot (TYPE);                         \
+    pc_t target = immediate (pc_t);                     \
+    BRANCH (OP (operand), target)                       \
+    nextOp ();                                          \
+}
+
+#define d_m3CommutativeCmpBranch_i(TYPE, NAME, OP)                                          \
+        d_m3CommutativeCmpBranchMacro (BranchIf,        M3_BRANCH_IF,         _r0, TYPE, NAME, OP) \
+        d_m3CommutativeCmpBranchMacro (ContinueLoopIf,  M3_CONTINUE_LOOP_IF,  _r0, TYPE, NAME, OP)
+#define d_m3CmpBranch_i(TYPE, NAME, OP)                                                     \
+        d_m3CmpBranchMacro            (BranchIf,        M3_BRANCH_IF,         _r0, TYPE, NAME, OP) \
+        d_m3CmpBranchMacro            (ContinueLoopIf,  M3_CONTINUE_LOOP_IF,  _r0, TYPE, NAME, OP)
+#define d_m3UnaryCmpBranch_i(TYPE, NAME, OP)                                                \
+        d_m3UnaryCmpBranchMacro       (BranchIf,        M3_BRANCH_IF,         _r0, TYPE, NAME, OP) \
+        d_m3UnaryCmpBranchMacro       (ContinueLoopIf,  M3_CONTINUE_LOOP_IF,  _r0, TYPE, NAME, OP)
+
+#define d_m3CommutativeCmpBranch_f(TYPE, NAME, OP)                                          \
+        d_m3CommutativeCmpBranchMacro (BranchIf,        M3_BRANCH_IF,        _fp0, TYPE, NAME, OP) \
+        d_m3CommutativeCmpBranchMacro (BranchIfNot,     M3_BRANCH_IF_NOT,    _fp0, TYPE, NAME, OP) \
+        d_m3CommutativeCmpBranchMacro (ContinueLoopIf,  M3_CONTINUE_LOOP_IF, _fp0, TYPE, NAME, OP)
+#define d_m3CmpBranch_f(TYPE, NAME, OP)                                                     \
+        d_m3CmpBranchMacro            (BranchIf,        M3_BRANCH_IF,        _fp0, TYPE, NAME, OP) \
+        d_m3CmpBranchMacro            (BranchIfNot,     M3_BRANCH_IF_NOT,    _fp0, TYPE, NAME, OP) \
+        d_m3CmpBranchMacro            (ContinueLoopIf,  M3_CONTINUE_LOOP_IF, _fp0, TYPE, NAME, OP)
+
+#define OP_NEZ(x) ((x) != 0)
+
+d_m3UnaryCmpBranch_i (i32, EqualToZero,     OP_EQZ)     d_m3UnaryCmpBranch_i (i64, EqualToZero,     OP_EQZ)
+d_m3UnaryCmpBranch_i (i32, NotEqualToZero,  OP_NEZ)     d_m3UnaryCmpBranch_i (i64, NotEqualToZero,  OP_NEZ)
+
+d_m3CommutativeCmpBranch_i (i32, Equal,     ==)         d_m3CommutativeCmpBranch_i (i64, Equal,     ==)
+d_m3CommutativeCmpBranch_i (i32, NotEqual,  !=)         d_m3CommutativeCmpBranch_i (i64, NotEqual,  !=)
+
+d_m3CmpBranch_i (i32, LessThan,             < )         d_m3CmpBranch_i (i64, LessThan,             < )
+d_m3CmpBranch_i (i32, GreaterThan,          > )         d_m3CmpBranch_i (i64, GreaterThan,          > )
+d_m3CmpBranch_i (i32, LessThanOrEqual,      <=)         d_m3CmpBranch_i (i64, LessThanOrEqual,      <=)
+d_m3CmpBranch_i (i32, GreaterThanOrEqual,   >=)         d_m3CmpBranch_i (i64, GreaterThanOrEqual,   >=)
+
+d_m3CmpBranch_i (u32, LessThan,             < )         d_m3CmpBranch_i (u64, LessThan,             < )
+d_m3CmpBranch_i (u32, GreaterThan,          > )         d_m3CmpBranch_i (u64, GreaterThan,          > )
+d_m3CmpBranch_i (u32, LessThanOrEqual,      <=)         d_m3CmpBranch_i (u64, LessThanOrEqual,      <=)
+d_m3CmpBranch_i (u32, GreaterThanOrEqual,   >=)         d_m3CmpBranch_i (u64, GreaterThanOrEqual,   >=)
+
+#if d_m3HasFloat
+d_m3CommutativeCmpBranch_f (f32, Equal,     ==)         d_m3CommutativeCmpBranch_f (f64, Equal,     ==)
+d_m3CommutativeCmpBranch_f (f32, NotEqual,  !=)         d_m3CommutativeCmpBranch_f (f64, NotEqual,  !=)
+d_m3CmpBranch_f (f32, LessThan,             < )         d_m3CmpBranch_f (f64, LessThan,             < )
+d_m3CmpBranch_f (f32, GreaterThan,          > )         d_m3CmpBranch_f (f64, GreaterThan,          > )
+d_m3CmpBranch_f (f32, LessThanOrEqual,      <=)         d_m3CmpBranch_f (f64, LessThanOrEqual,      <=)
+d_m3CmpBranch_f (f32, GreaterThanOrEqual,   >=)         d_m3CmpBranch_f (f64, GreaterThanOrEqual,   >=)
+#endif
+
+
 d_m3Op  (Const32)
 {
     u32 value = * (u32 *)_pc++;
@@ -1299,21 +1685,110 @@ d_m3Op  (SetGlobal_f64)
 #endif
 
 
-#if d_m3SkipMemoryBoundsCheck
+// code shared by the instances of a compiled module can't point at one instance's globals. it indexes the globals
+// of the instance running it instead; see m3_NewCompiledModule () in m3_env.c. 32-bit values are the first 4 bytes
+// of the value union, as for the globals the other global ops point at
+#define d_m3InstanceGlobal()            (m3MemGlobals (_mem) + immediate (u32))
+
+d_m3Op  (GetInstanceGlobal_s32)
+{
+    IM3Global global = d_m3InstanceGlobal ();
+    memcpy (& slot (u32), & global->intValue, sizeof (u32));
+
+    nextOp ();
+}
+
+
+d_m3Op  (GetInstanceGlobal_s64)
+{
+    IM3Global global = d_m3InstanceGlobal ();
+    slot (i64) = global->intValue;
+
+    nextOp ();
+}
+
+
+d_m3Op  (SetInstanceGlobal_i32)
+{
+    IM3Global global = d_m3InstanceGlobal ();
+    u32 value = (u32) _r0;
+    memcpy (& global->intValue, & value, sizeof (u32));
+
+    nextOp ();
+}
+
+
+d_m3Op  (SetInstanceGlobal_i64)
+{
+    IM3Global global = d_m3InstanceGlobal ();
+    global->intValue = (i64) _r0;
+
+    nextOp ();
+}
+
+
+d_m3Op  (SetInstanceGlobal_s32)
+{
+    IM3Global global = d_m3InstanceGlobal ();
+    memcpy (& global->intValue, & slot (u32), sizeof (u32));
+
+    nextOp ();
+}
+
+
+d_m3Op  (SetInstanceGlobal_s64)
+{
+    IM3Global global = d_m3InstanceGlobal ();
+    global->intValue = slot (i64);
+
+    nextOp ();
+}
+
+#if d_m3HasFloat
+d_m3Op  (SetInstanceGlobal_f32)
+{
+    IM3Global global = d_m3InstanceGlobal ();
+    global->f32Value = _fp0;
+
+    nextOp ();
+}
+
+
+d_m3Op  (SetInstanceGlobal_f64)
+{
+    IM3Global global = d_m3InstanceGlobal ();
+    global->f64Value = _fp0;
+
+    nextOp ();
+}
+#endif
+
+
+#if d_m3SkipMemoryBoundsCheck || d_m3UseGuardPages || d_m3UseIndexMasking
+// with guard pages, an access past the end faults instead; see HandleGuardPageFault () in m3_env.c
 #  define m3MemCheck(x) true
 #else
 #  define m3MemCheck(x) M3_LIKELY(x)
 #endif
 
+#if d_m3UseIndexMasking
+// the address wraps around within the capacity, which has room for the widest access past its end
+#  define m3MaskAddress(x) ((x) & _mem->mask)
+#else
+#  define m3MaskAddress(x) (x)
+#endif
+
 // memcpy here is to support non-aligned access on some platforms.
 
 #define d_m3Load(REG,DEST_TYPE,SRC_TYPE)                \
 d_m3Op(DEST_TYPE##_Load_##SRC_TYPE##_r)                 \
 {                                                       \
     d_m3TracePrepare                                    \
+    d_m3RecordAccessPC                                  \
     u32 offset = immediate (u32);                       \
     u64 operand = (u32) _r0;                            \
     operand += offset;                                  \
+    operand = m3MaskAddress (operand);                  \
                                                         \
     if (m3MemCheck(                                     \
         operand + sizeof (SRC_TYPE) <= _mem->length     \
@@ -1330,9 +1805,34 @@ d_m3Op(DEST_TYPE##_Load_##SRC_TYPE##_r)                 \
 d_m3Op(DEST_TYPE##_Load_##SRC_TYPE##_s)                 \
 {                                                       \
     d_m3TracePrepare                                    \
+    d_m3RecordAccessPC                                  \
     u64 operand = slot (u32);                           \
     u32 offset = immediate (u32);                       \
     operand += offset;                                  \
+    operand = m3MaskAddress (operand);                  \
+                                                        \
+    if (m3MemCheck(                                     \
+        operand + sizeof (SRC_TYPE) <= _mem->length     \
+    )) {                                                \
+        u8* src8 = m3MemData(_mem) + operand;           \
+        SRC_TYPE value;                                 \
+        memcpy(&value, src8, sizeof(value));            \
+        M3_BSWAP_##SRC_TYPE(value);                     \
+        REG = (DEST_TYPE)value;                         \
+        d_m3TraceLoad(DEST_TYPE, operand, REG);         \
+        nextOp ();                                      \
+    } else d_outOfBounds;                               \
+}                                                       \
+d_m3Op(DEST_TYPE##_Load_##SRC_TYPE##_si)                \
+{                                                       \
+    d_m3TracePrepare                                    \
+    d_m3RecordAccessPC                                  \
+    u32 base = slot (u32);                              \
+    u32 addend = immediate (u32);                       \
+    u32 offset = immediate (u32);                       \
+    u64 operand = (u32) (base + addend);                \
+    operand += offset;                                  \
+    operand = m3MaskAddress (operand);                  \
                                                         \
     if (m3MemCheck(                                     \
         operand + sizeof (SRC_TYPE) <= _mem->length     \
@@ -1376,9 +1876,11 @@ d_m3Load_i (i64, i64);
 d_m3Op  (SRC_TYPE##_Store_##DEST_TYPE##_rs)             \
 {                                                       \
     d_m3TracePrepare                                    \
+    d_m3RecordAccessPC                                  \
     u64 operand = slot (u32);                           \
     u32 offset = immediate (u32);                       \
     operand += offset;                                  \
+    operand = m3MaskAddress (operand);                  \
                                                         \
     if (m3MemCheck(                                     \
         operand + sizeof (DEST_TYPE) <= _mem->length    \
@@ -1394,10 +1896,12 @@ d_m3Op  (SRC_TYPE##_Store_##DEST_TYPE##_rs)             \
 d_m3Op  (SRC_TYPE##_Store_##DEST_TYPE##_sr)             \
 {                                                       \
     d_m3TracePrepare                                    \
+    d_m3RecordAccessPC                                  \
     const SRC_TYPE value = slot (SRC_TYPE);             \
     u64 operand = (u32) _r0;                            \
     u32 offset = immediate (u32);                       \
     operand += offset;                                  \
+    operand = m3MaskAddress (operand);                  \
                                                         \
     if (m3MemCheck(                                     \
         operand + sizeof (DEST_TYPE) <= _mem->length    \
@@ -1413,10 +1917,12 @@ d_m3Op  (SRC_TYPE##_Store_##DEST_TYPE##_sr)             \
 d_m3Op  (SRC_TYPE##_Store_##DEST_TYPE##_ss)             \
 {                                                       \
     d_m3TracePrepare                                    \
+    d_m3RecordAccessPC                                  \
     const SRC_TYPE value = slot (SRC_TYPE);             \
     u64 operand = slot (u32);                           \
     u32 offset = immediate (u32);                       \
     operand += offset;                                  \
+    operand = m3MaskAddress (operand);                  \
                                                         \
     if (m3MemCheck(                                     \
         operand + sizeof (DEST_TYPE) <= _mem->length    \
@@ -1435,9 +1941,11 @@ d_m3Op  (SRC_TYPE##_Store_##DEST_TYPE##_ss)             \
 d_m3Op  (TYPE##_Store_##TYPE##_rr)                      \
 {                                                       \
     d_m3TracePrepare                                    \
+    d_m3RecordAccessPC                                  \
     u64 operand = (u32) _r0;                            \
     u32 offset = immediate (u32);                       \
     operand += offset;                                  \
+    operand = m3MaskAddress (operand);                  \
                                                         \
     if (m3MemCheck(                                     \
         operand + sizeof (TYPE) <= _mem->length         \
@@ -1470,6 +1978,7 @@ d_m3Store_i (i64, i32)
 d_m3Store_i (i64, i64)
 
 #undef m3MemCheck
+#undef m3MaskAddress
 
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -15,6 +15,8 @@ d_m3BeginExternC
 # define m3MemData(mem)                 (((M3MemoryBuffer *)mem)->dataBuffer)
 # define m3MemRuntime(mem)              (((M3MemoryHeader*)(mem))->runtime)
 # define m3MemInfo(mem)                 (&(((M3MemoryHeader*)(mem))->runtime->memory))
+# define m3MemInstance(mem)             (((M3MemoryHeader*)(mem))->instance)
+# define m3MemGlobals(mem)              (((M3MemoryHeader*)(mem))->globals)
 
 # define d_m3BaseOpSig                  pc_t _pc, m3stack_t _sp, M3MemoryHeader * _mem, m3reg_t _r0
 # define d_m3BaseOpArgs                 _sp, _mem, _r0
@@ -50,14 +52,94 @@ typedef m3ret_t (vectorcall * IM3Operation) (d_m3OpSig);
 #define nextOpImpl()                ((IM3Operation)(* _pc))(_pc + 1, d_m3OpArgs)
 #define jumpOpImpl(PC)              ((IM3Operation)(*  PC))( PC + 1, d_m3OpArgs)
 
-#define nextOpDirect()              return nextOpImpl()
-#define jumpOpDirect(PC)            return jumpOpImpl((pc_t)(PC))
+# if d_m3UseDispatchLoop
+// the registers can't ride along in the native ones through RunCode (), so they're kept with the resume point
+#   if d_m3HasFloat
+#       define d_m3SaveRegisters    _mem->resumeR0 = _r0; _mem->resumeFP0 = _fp0;
+#   else
+#       define d_m3SaveRegisters    _mem->resumeR0 = _r0;
+#   endif
+#   define trampoline(PC, SP)       do { _mem->resumePC = (pc_t) (PC); _mem->resumeSP = (SP); d_m3SaveRegisters return _mem; } while (0)
+
+#   define nextOpDirect()           trampoline (_pc, _sp)
+#   define jumpOpDirect(PC)         trampoline (PC, _sp)
+# else
+#   if d_m3TrampolinedExecution
+#       define trampoline(PC, SP)   do { _mem->resumePC = (pc_t) (PC); _mem->resumeSP = (SP); return _mem; } while (0)
+#   endif
+
+#   define nextOpDirect()           return nextOpImpl()
+#   define jumpOpDirect(PC)         return jumpOpImpl((pc_t)(PC))
+# endif
+
+# if d_m3TrampolinedExecution
+
+// op_Call pushes this just below the callee's frame. the caller's registers can be live across a call
+typedef struct M3CallRecord
+{
+    pc_t                    pc;
+    m3stack_t               sp;
+    m3reg_t                 r0;
+#   if d_m3HasFloat
+    f64                     fp0;
+#   endif
+}
+M3CallRecord;
+
+// ops that enter a function, return from one, or continue a loop don't recurse on the native stack. they
+// store where execution resumes in the memory header and hand the header back to this loop. a null pc is a
+// return: the caller is found in the record under the returning frame, unless it's the frame entered here.
+// with d_m3UseDispatchLoop, every op comes back here with its successor: a call-threaded fallback for when the
+// compiler won't turn nextOp () into a jump, not a switch or computed-goto interpreter.
+d_m3RetSig  RunCode  (d_m3OpSig)
+{
+    m3stack_t entrySP = _sp;
+
+    m3ret_t r = nextOpImpl ();
+
+    while (_mem and r == _mem)
+    {
+        _pc = _mem->resumePC;
+        _sp = _mem->resumeSP;
+
+        if (not _pc)
+        {
+            if (_sp == entrySP)
+                return m3Err_none;
+
+            M3CallRecord * record = (M3CallRecord *) _sp - 1;
+            _pc = record->pc;
+            _sp = record->sp;
+            _r0 = record->r0;
+#   if d_m3HasFloat
+            _fp0 = record->fp0;
+#   endif
+        }
+#   if d_m3UseDispatchLoop
+        else
+        {
+            _r0 = _mem->resumeR0;
+#       if d_m3HasFloat
+            _fp0 = _mem->resumeFP0;
+#       endif
+        }
+#   endif
+
+        r = nextOpImpl ();
+    }
+
+    return r;
+}
+
+# else
 
 d_m3RetSig  RunCode  (d_m3OpSig)
 {
     nextOpDirect();
 }
 
+# endif
+
 d_m3EndExternC
 
 #endif // m3_exec_defs_h
@@ -84,6 +84,7 @@ void FreeImportInfo (M3ImportInfo * i_info)
 void  Function_Release  (IM3Function i_function)
 {
     m3_Free (i_function->constants);
+    m3_Free (i_function->localInitRanges);
 
     for (int i = 0; i < i_function->numNames; i++)
     {
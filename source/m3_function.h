@@ -76,6 +76,9 @@ typedef struct M3Function
 
     u16                     numConstantBytes;
     void *                  constants;
+
+    u16                     numLocalInitRanges;                     // used by op_Entry_LocalRanges instead of zeroing all numLocalBytes
+    u16 *                   localInitRanges;                        // [first slot, num slots] pairs, relative to the first local
 }
 M3Function;
 
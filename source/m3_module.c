@@ -19,15 +19,39 @@ void Module_FreeFunctions (IM3Module i_module)
 }
 
 
+// an instance of a compiled module only owns its copies of these; everything else is the compiled module's
+static
+void  FreeInstance  (IM3Module i_module)
+{
+    for (u32 i = 0; i < i_module->numTables; ++i)
+        m3_Free (i_module->tables [i].functions);
+
+    m3_Free (i_module->tables);
+    m3_Free (i_module->globals);
+    m3_Free (i_module->functions);
+
+    ReleaseCompiledModule (i_module->compiled);
+
+    m3_Free (i_module);
+}
+
+
 void  m3_FreeModule  (IM3Module i_module)
 {
-    if (i_module)
+    if (i_module and i_module->compiled and i_module->compiled->module != i_module)
+    {
+        FreeInstance (i_module);
+    }
+    else if (i_module)
     {
         m3log (module, "freeing module: %s (funcs: %d; segments: %d)",
                i_module->name, i_module->numFunctions, i_module->numDataSegments);
 
         Module_FreeFunctions (i_module);
 
+        NameIndex_Release (& i_module->exports);
+        NameIndex_Release (& i_module->imports);
+
         m3_Free (i_module->functions);
         //m3_Free (i_module->imports);
         m3_Free (i_module->funcTypes);
@@ -49,6 +73,9 @@ void  m3_FreeModule  (IM3Module i_module)
         m3_Free (i_module->tables);
         FreeImportInfo(&(i_module->memoryInfo.import));
 
+        if (i_module->hasWasmCodeCopy)
+            m3_Free (i_module->wasmStart);
+
         m3_Free (i_module);
     }
 }
@@ -145,6 +172,97 @@ void  Module_GenerateNames  (IM3Module i_module)
 }
 #endif
 
+
+M3Result  NameIndex_Init  (M3NameIndex * o_index, u32 i_numIndices)
+{
+    M3Result result = m3Err_none;
+
+    o_index->slots = NULL;
+    o_index->mask = 0;
+
+    if (i_numIndices)
+    {
+        u32 numSlots = 8;
+        while (numSlots < i_numIndices * 2)     // at most half full
+            numSlots *= 2;
+
+        o_index->slots = m3_AllocArray (u32, numSlots);
+        _throwifnull (o_index->slots);
+
+        o_index->mask = numSlots - 1;
+    }
+
+    _catch: return result;
+}
+
+
+void  NameIndex_Insert  (M3NameIndex * io_index, cstr_t i_name, u32 i_index)
+{
+    u32 slot = HashName (i_name) & io_index->mask;
+
+    while (io_index->slots [slot])
+        slot = (slot + 1) & io_index->mask;
+
+    io_index->slots [slot] = i_index + 1;
+}
+
+
+void  NameIndex_Release  (M3NameIndex * io_index)
+{
+    m3_Free (io_index->slots);
+    io_index->mask = 0;
+}
+
+
+// (re)builds the exports and imports indices, for v_FindFunction () and the linking in m3_bind.c. a module's names
+// are all known once it's parsed, but the ones Module_GenerateNames () makes up
+M3Result  Module_IndexNames  (IM3Module io_module)
+{
+_try {
+    NameIndex_Release (& io_module->exports);
+    NameIndex_Release (& io_module->imports);
+
+    u32 numExportNames = 0, numImports = 0;
+
+    for (u32 i = 0; i < io_module->numFunctions; ++i)
+    {
+        IM3Function f = & io_module->functions [i];
+
+        if (f->import.moduleUtf8 or f->import.fieldUtf8)
+        {
+            if (f->import.moduleUtf8 and f->import.fieldUtf8)
+                ++numImports;
+        }
+        else numExportNames += f->numNames;
+    }
+
+_   (NameIndex_Init (& io_module->exports, numExportNames));
+_   (NameIndex_Init (& io_module->imports, numImports));
+
+    for (u32 i = 0; i < io_module->numFunctions; ++i)
+    {
+        IM3Function f = & io_module->functions [i];
+
+        if (f->import.moduleUtf8 or f->import.fieldUtf8)
+        {
+            if (f->import.moduleUtf8 and f->import.fieldUtf8)
+                NameIndex_Insert (& io_module->imports, f->import.fieldUtf8, i);
+        }
+        else
+        {
+            for (u32 j = 0; j < f->numNames; ++j)
+            {
+                if (f->names [j])
+                    NameIndex_Insert (& io_module->exports, f->names [j], i);
+            }
+        }
+    }
+
+} _catch:
+    return result;
+}
+
+
 IM3Function  Module_GetFunction  (IM3Module i_module, u32 i_functionIndex)
 {
     IM3Function func = NULL;
@@ -172,6 +290,15 @@ void  m3_SetModuleName  (IM3Module i_module, const char* name)
     if (i_module) i_module->name = name;
 }
 
+void  m3_SetModuleFile  (IM3Module i_module, int i_fileDescriptor, uint64_t i_fileOffset)
+{
+    if (i_module)
+    {
+        i_module->fileDescriptor = i_fileDescriptor;
+        i_module->fileOffset = i_fileOffset;
+    }
+}
+
 IM3Runtime  m3_GetModuleRuntime  (IM3Module i_module)
 {
     return i_module ? i_module->runtime : NULL;
@@ -648,45 +648,78 @@ M3Result  ParseModuleSection  (M3Module * o_module, u8 i_sectionType, bytes_t i_
 }
 
 
-M3Result  m3_ParseModule  (IM3Environment i_environment, IM3Module * o_module, cbytes_t i_bytes, u32 i_numBytes)
+static
+M3Result  NewModule  (IM3Environment i_environment, IM3Module * o_module)
 {
-    IM3Module module;                                                               m3log (parse, "load module: %d bytes", i_numBytes);
 _try {
-    module = m3_AllocStruct (M3Module);
+    IM3Module module = m3_AllocStruct (M3Module);
     _throwifnull (module);
-    module->name = ".unnamed";                                                      m3log (parse, "load module: %d bytes", i_numBytes);
+    module->name = ".unnamed";
     module->startFunction = -1;
+    module->fileDescriptor = -1;
     //module->hasWasmCodeCopy = false;
     module->environment = i_environment;
     module->numTables = 0;
 
-    const u8 * pos = i_bytes;
-    const u8 * end = pos + i_numBytes;
+    * o_module = module;
+
+} _catch: return result;
+}
 
-    module->wasmStart = pos;
-    module->wasmEnd = end;
 
+static
+M3Result  ParseHeader  (bytes_t * io_bytes, cbytes_t i_end)
+{
+_try {
     u32 magic, version;
-_   (Read_u32 (& magic, & pos, end));
-_   (Read_u32 (& version, & pos, end));
+_   (Read_u32 (& magic, io_bytes, i_end));
+_   (Read_u32 (& version, io_bytes, i_end));
 
     _throwif (m3Err_wasmMalformed, magic != 0x6d736100);
     _throwif (m3Err_incompatibleWasmVersion, version != 1);
 
+} _catch: return result;
+}
+
+
+// sections appear only once and in order; custom sections anywhere
+static
+M3Result  CheckSectionOrder  (u8 * io_expectedSection, u8 i_section)
+{
     static const u8 sectionsOrder[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 12, 10, 11, 0 }; // 0 is a placeholder
+
+    if (i_section != 0) {
+        while (sectionsOrder[(* io_expectedSection)++] != i_section) {
+            if (* io_expectedSection >= 12)
+                return m3Err_misorderedWasmSection;
+        }
+    }
+
+    return m3Err_none;
+}
+
+
+M3Result  m3_ParseModule  (IM3Environment i_environment, IM3Module * o_module, cbytes_t i_bytes, u32 i_numBytes)
+{
+    IM3Module module = NULL;                                                        m3log (parse, "load module: %d bytes", i_numBytes);
+_try {
+_   (NewModule (i_environment, & module));
+
+    const u8 * pos = i_bytes;
+    const u8 * end = pos + i_numBytes;
+
+    module->wasmStart = pos;
+    module->wasmEnd = end;
+
+_   (ParseHeader (& pos, end));
+
     u8 expectedSection = 0;
 
     while (pos < end)
     {
         u8 section;
 _       (ReadLEB_u7 (& section, & pos, end));
-
-        if (section != 0) {
-            // Ensure sections appear only once and in order
-            while (sectionsOrder[expectedSection++] != section) {
-                _throwif(m3Err_misorderedWasmSection, expectedSection >= 12);
-            }
-        }
+_       (CheckSectionOrder (& expectedSection, section));
 
         u32 sectionLength;
 _       (ReadLEB_u32 (& sectionLength, & pos, end));
@@ -697,6 +730,8 @@ _       (ParseModuleSection (module, section, pos, sectionLength));
         pos += sectionLength;
     }
 
+_   (Module_IndexNames (module));
+
 } _catch:
 
     if (result)
@@ -709,3 +744,293 @@ _       (ParseModuleSection (module, section, pos, sectionLength));
 
     return result;
 }
+
+
+//---------------------------------------------------------------------------------------------------------------------------------
+//  module streams
+//---------------------------------------------------------------------------------------------------------------------------------
+
+// a module parsed as its bytes arrive. Its sections are parsed as each one completes, except the code section, whose
+// function bodies are compiled as each one completes. The module owns the bytes it has received
+typedef struct M3ModuleStream
+{
+    IM3Runtime              runtime;                // the code is compiled into, and the module loaded into
+    IM3Module               module;                 // until it's loaded
+
+    u8 *                    bytes;
+    u32                     numBytes;
+    u32                     capacity;
+
+    u32                     parsed;                 // the bytes parsed so far
+    u8                      expectedSection;
+
+    u32                     codeEnd;                // in the code section: its end, and its function bodies
+    u32                     numBodies;
+    u32                     nextBody;
+
+    M3CallSites             calls;                  // calls compiled before their callee
+    M3Result                result;                 // a stream that failed stays failed
+}
+M3ModuleStream;
+
+
+static
+bytes_t  Rebase  (bytes_t i_pointer, bytes_t i_from, bytes_t i_to)
+{
+    return i_pointer ? i_to + (i_pointer - i_from) : NULL;
+}
+
+
+// the parsed sections point into the bytes; when they grow into a new buffer, the pointers move with them
+static
+void  RebaseModule  (IM3Module io_module, bytes_t i_from, bytes_t i_to)
+{
+    io_module->elementSection       = Rebase (io_module->elementSection, i_from, i_to);
+    io_module->elementSectionEnd    = Rebase (io_module->elementSectionEnd, i_from, i_to);
+
+    for (u32 i = 0; i < io_module->numGlobals; ++i)
+        io_module->globals [i].initExpr = Rebase (io_module->globals [i].initExpr, i_from, i_to);
+
+    for (u32 i = 0; i < io_module->numDataSegments; ++i)
+    {
+        M3DataSegment * segment = & io_module->dataSegments [i];
+        segment->initExpr   = Rebase (segment->initExpr, i_from, i_to);
+        segment->data       = Rebase (segment->data, i_from, i_to);
+    }
+
+    for (u32 i = 0; i < io_module->numFunctions; ++i)
+    {
+        IM3Function function = & io_module->functions [i];
+        function->wasm      = Rebase (function->wasm, i_from, i_to);
+        function->wasmEnd   = Rebase (function->wasmEnd, i_from, i_to);
+    }
+}
+
+
+static
+M3Result  BufferStreamBytes  (IM3ModuleStream io_stream, cbytes_t i_bytes, u32 i_numBytes)
+{
+_try {
+    _throwif ("module is too big", i_numBytes > UINT32_MAX - io_stream->numBytes);
+
+    u32 numBytes = io_stream->numBytes + i_numBytes;
+
+    if (numBytes > io_stream->capacity)
+    {
+        u32 capacity = M3_MAX (numBytes, io_stream->capacity < UINT32_MAX / 2 ? io_stream->capacity * 2 : UINT32_MAX);
+
+        u8 * bytes = m3_AllocArray (u8, capacity);
+        _throwifnull (bytes);
+
+        if (io_stream->numBytes)
+        {
+            memcpy (bytes, io_stream->bytes, io_stream->numBytes);
+            RebaseModule (io_stream->module, io_stream->bytes, bytes);
+        }
+
+        m3_Free (io_stream->bytes);
+        io_stream->bytes = bytes;
+        io_stream->capacity = capacity;
+    }
+
+    memcpy (io_stream->bytes + io_stream->numBytes, i_bytes, i_numBytes);
+    io_stream->numBytes = numBytes;
+
+    io_stream->module->wasmStart = io_stream->bytes;
+    io_stream->module->wasmEnd = io_stream->bytes + numBytes;
+
+} _catch: return result;
+}
+
+
+// running out of the bytes received so far only means the rest hasn't arrived yet
+#define _wait(READ)                         { result = READ; if (result == m3Err_wasmUnderrun) return m3Err_none; _ (result); }
+
+
+// parses what the next section, or the next function body in the code section, needs of the bytes, if they've arrived
+static
+M3Result  ParseStreamStep  (IM3ModuleStream io_stream, bool * o_parsed)
+{
+    IM3Module module = io_stream->module;
+
+    bytes_t pos = io_stream->bytes + io_stream->parsed;
+    cbytes_t end = io_stream->bytes + io_stream->numBytes;
+
+    * o_parsed = false;
+_try {
+    if (io_stream->parsed == 0)
+    {
+        if (end - pos < 8)
+            return m3Err_none;
+
+_       (ParseHeader (& pos, end));
+    }
+    else if (io_stream->codeEnd)
+    {
+        cbytes_t codeEnd = io_stream->bytes + io_stream->codeEnd;
+
+        bytes_t start = pos;
+
+        u32 size;
+_wait   (ReadLEB_u32 (& size, & pos, end));
+        _throwif (m3Err_wasmSectionOverrun, pos > codeEnd or size > (u32) (codeEnd - pos));
+
+        if (size > (u32) (end - pos))
+            return m3Err_none;
+
+        pos += size;
+
+        if (size)
+        {
+            IM3Function function = Module_GetFunction (module, module->numFuncImports + io_stream->nextBody);
+
+            function->wasm = start;
+            function->wasmEnd = pos;
+
+_           (CompileFunctionOn (io_stream->runtime, function, & io_stream->calls));
+        }
+
+        if (++io_stream->nextBody == io_stream->numBodies)
+        {
+            _throwif (m3Err_wasmSectionUnderrun, pos != codeEnd);
+            io_stream->codeEnd = 0;
+        }
+    }
+    else
+    {
+        u8 section;
+_wait   (ReadLEB_u7 (& section, & pos, end));
+
+        u32 sectionLength;
+_wait   (ReadLEB_u32 (& sectionLength, & pos, end));
+
+        if (section == 10)
+        {
+            // the code section is parsed a function body at a time
+            u32 numBodies;
+            bytes_t bodies = pos;
+_wait       (ReadLEB_u32 (& numBodies, & bodies, end));
+
+_           (CheckSectionOrder (& io_stream->expectedSection, section));
+            _throwif (m3Err_wasmSectionOverrun, (u32) (bodies - pos) > sectionLength);
+            _throwif ("module is too big", (u64) (pos - io_stream->bytes) + sectionLength > UINT32_MAX);
+            _throwif ("mismatched function count in code section", numBodies != module->numFunctions - module->numFuncImports);
+                                                                                    m3log (parse, "** Code [%d]", numBodies);
+            // the bodies compiled first call the ones still to come
+            for (u32 i = module->numFuncImports; i < module->numFunctions; ++i)
+                module->functions [i].module = module;
+
+            io_stream->numBodies = numBodies;
+            io_stream->nextBody = 0;
+
+            if (numBodies)
+                io_stream->codeEnd = (u32) (pos - io_stream->bytes) + sectionLength;
+            else
+                _throwif (m3Err_wasmSectionUnderrun, bodies != pos + sectionLength);
+
+            pos = bodies;
+        }
+        else
+        {
+            if (sectionLength > (u32) (end - pos))
+                return m3Err_none;
+
+_           (CheckSectionOrder (& io_stream->expectedSection, section));
+_           (ParseModuleSection (module, section, pos, sectionLength));
+
+            pos += sectionLength;
+        }
+    }
+
+    io_stream->parsed = (u32) (pos - io_stream->bytes);
+    * o_parsed = true;
+
+} _catch: return result;
+}
+
+
+M3Result  m3_NewModuleStream  (IM3Runtime io_runtime, IM3ModuleStream * o_stream, uint32_t i_numBytes)
+{
+    IM3ModuleStream stream = NULL;
+_try {
+    stream = m3_AllocStruct (M3ModuleStream);
+    _throwifnull (stream);
+
+    stream->runtime = io_runtime;
+_   (NewModule (io_runtime->environment, & stream->module));
+    stream->module->hasWasmCodeCopy = true;
+
+    if (i_numBytes)
+    {
+        stream->bytes = m3_AllocArray (u8, i_numBytes);
+        _throwifnull (stream->bytes);
+        stream->capacity = i_numBytes;
+        stream->module->wasmStart = stream->module->wasmEnd = stream->bytes;
+    }
+
+} _catch:
+
+    if (result)
+    {
+        m3_FreeModuleStream (stream);
+        stream = NULL;
+    }
+
+    * o_stream = stream;
+
+    return result;
+}
+
+
+M3Result  m3_AppendModuleStream  (IM3ModuleStream io_stream, const uint8_t * i_bytes, uint32_t i_numBytes)
+{
+_try {
+_   (io_stream->result);
+_   (BufferStreamBytes (io_stream, i_bytes, i_numBytes));
+
+    bool parsed = true;
+
+    while (parsed and io_stream->parsed < io_stream->numBytes)
+_       (ParseStreamStep (io_stream, & parsed));
+
+} _catch:
+
+    io_stream->result = result;
+
+    return result;
+}
+
+
+M3Result  m3_FinishModuleStream  (IM3ModuleStream io_stream, IM3Module * o_module)
+{
+    * o_module = NULL;
+_try {
+_   (io_stream->result);
+    _throwif (m3Err_wasmUnderrun, io_stream->parsed == 0 or io_stream->parsed != io_stream->numBytes or io_stream->codeEnd);
+
+    IM3Module module = io_stream->module;
+_   (Module_IndexNames (module));
+_   (m3_LoadModule (io_stream->runtime, module));
+    io_stream->module = NULL;
+
+    ResolveCallSites (& io_stream->calls);
+
+    * o_module = module;
+
+} _catch:
+
+    io_stream->result = result;
+
+    return result;
+}
+
+
+void  m3_FreeModuleStream  (IM3ModuleStream i_stream)
+{
+    if (i_stream)
+    {
+        m3_FreeModule (i_stream->module);   // unless it was loaded; it owns the bytes
+        m3_Free (i_stream->calls.calls);
+        m3_Free (i_stream);
+    }
+}
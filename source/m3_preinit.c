@@ -0,0 +1,535 @@
+//
+//  m3_preinit.c
+//
+//  Writes a module out with its initialization already done; see m3_PreinitializeModule () in wasm3.h
+//
+
+#include "m3_env.h"
+#include "m3_exception.h"
+
+
+typedef struct M3Output
+{
+    u8 *        bytes;
+    size_t      size;
+    size_t      capacity;
+}
+M3Output;
+
+
+static
+M3Result  Write  (M3Output * io_output, const void * i_bytes, size_t i_numBytes)
+{
+    if (io_output->size + i_numBytes > io_output->capacity)
+    {
+        size_t capacity = M3_MAX (io_output->capacity * 2, io_output->size + i_numBytes + 256);
+
+        // plain realloc: the caller of m3_PreinitializeModule () free ()s the result
+        u8 * bytes = realloc (io_output->bytes, capacity);
+        if (not bytes)
+            return m3Err_mallocFailed;
+
+        io_output->bytes = bytes;
+        io_output->capacity = capacity;
+    }
+
+    memcpy (io_output->bytes + io_output->size, i_bytes, i_numBytes);
+    io_output->size += i_numBytes;
+
+    return m3Err_none;
+}
+
+
+static
+M3Result  Write_u8  (M3Output * io_output, u8 i_value)
+{
+    return Write (io_output, & i_value, 1);
+}
+
+
+static
+M3Result  WriteLEB_u32  (M3Output * io_output, u32 i_value)
+{
+    u8 bytes [5];
+    size_t numBytes = 0;
+
+    do
+    {
+        u8 byte = i_value & 0x7f;
+        i_value >>= 7;
+        bytes [numBytes++] = i_value ? (byte | 0x80) : byte;
+    }
+    while (i_value);
+
+    return Write (io_output, bytes, numBytes);
+}
+
+
+static
+M3Result  WriteLEB_i64  (M3Output * io_output, i64 i_value)
+{
+    u8 bytes [10];
+    size_t numBytes = 0;
+
+    while (true)
+    {
+        u8 byte = i_value & 0x7f;
+        i_value >>= 7;      // arithmetic
+
+        bool done = (i_value == 0 and not (byte & 0x40)) or (i_value == -1 and (byte & 0x40));
+        bytes [numBytes++] = done ? byte : (byte | 0x80);
+
+        if (done)
+            break;
+    }
+
+    return Write (io_output, bytes, numBytes);
+}
+
+
+// a u32 LEB in its full five bytes, so it can be patched, or doesn't move what follows
+static
+void  EncodePaddedLEB_u32  (u8 * o_bytes, u64 i_value)
+{
+    for (u32 i = 0; i < 4; ++i)
+        o_bytes [i] = ((i_value >> (i * 7)) & 0x7f) | 0x80;
+
+    o_bytes [4] = (i_value >> 28) & 0x7f;
+}
+
+
+static
+M3Result  WritePaddedLEB  (M3Output * io_output, u64 i_value)
+{
+    u8 bytes [5];
+    EncodePaddedLEB_u32 (bytes, i_value);
+
+    return Write (io_output, bytes, sizeof (bytes));
+}
+
+
+static
+M3Result  Write_LittleEndian  (M3Output * io_output, u64 i_value, u32 i_numBytes)
+{
+    u8 bytes [8];
+
+    for (u32 i = 0; i < i_numBytes; ++i)
+        bytes [i] = (u8) (i_value >> (i * 8));
+
+    return Write (io_output, bytes, i_numBytes);
+}
+
+
+static
+M3Result  WriteSection  (M3Output * io_output, u8 i_sectionType, M3Output * i_payload)
+{
+    M3Result result = m3Err_none;
+
+_   (Write_u8 (io_output, i_sectionType));
+_   (WriteLEB_u32 (io_output, (u32) i_payload->size));
+_   (Write (io_output, i_payload->bytes, i_payload->size));
+
+    _catch: return result;
+}
+
+
+static
+M3Result  WriteGlobalInitExpr  (M3Output * io_output, IM3Global i_global)
+{
+    M3Result result = m3Err_none;
+
+    switch (i_global->type)
+    {
+        case c_m3Type_i32:
+_           (Write_u8 (io_output, 0x41));
+_           (WriteLEB_i64 (io_output, (i32) i_global->intValue));
+            break;
+
+        case c_m3Type_i64:
+_           (Write_u8 (io_output, 0x42));
+_           (WriteLEB_i64 (io_output, i_global->intValue));
+            break;
+
+        // the union holds the float's bits
+        case c_m3Type_f32:
+_           (Write_u8 (io_output, 0x43));
+_           (Write_LittleEndian (io_output, (u32) i_global->intValue, 4));
+            break;
+
+        case c_m3Type_f64:
+_           (Write_u8 (io_output, 0x44));
+_           (Write_LittleEndian (io_output, (u64) i_global->intValue, 8));
+            break;
+
+        default: _throw (m3Err_invalidTypeId);
+    }
+
+_   (Write_u8 (io_output, 0x0b));   // end
+
+    _catch: return result;
+}
+
+
+static
+M3Result  WriteGlobalSection  (M3Output * io_output, IM3Module i_module)
+{
+    M3Result result = m3Err_none;
+
+    u32 numGlobals = 0;
+
+    for (u32 i = 0; i < i_module->numGlobals; ++i)
+        numGlobals += not i_module->globals [i].imported;
+
+_   (WriteLEB_u32 (io_output, numGlobals));
+
+    for (u32 i = 0; i < i_module->numGlobals; ++i)
+    {
+        IM3Global global = & i_module->globals [i];
+
+        if (global->imported)
+            continue;
+
+_       (Write_u8 (io_output, (u8) (-(i8) global->type & 0x7f)));    // see NormalizeType ()
+_       (Write_u8 (io_output, global->isMutable));
+_       (WriteGlobalInitExpr (io_output, global));
+    }
+
+    _catch: return result;
+}
+
+
+static
+M3Result  WriteMemorySection  (M3Output * io_output, bytes_t i_bytes, cbytes_t i_end, u32 i_numPages)
+{
+    M3Result result = m3Err_none;
+
+    u32 numMemories, initPages, maxPages;
+    u8 flags;
+
+_   (ReadLEB_u32 (& numMemories, & i_bytes, i_end));
+    _throwif (m3Err_tooManyMemorySections, numMemories != 1);
+
+_   (ReadLEB_u7 (& flags, & i_bytes, i_end));
+_   (ReadLEB_u32 (& initPages, & i_bytes, i_end));
+
+_   (WriteLEB_u32 (io_output, 1));
+_   (Write_u8 (io_output, flags));
+_   (WriteLEB_u32 (io_output, i_numPages));
+
+    if (flags & 1)
+    {
+_       (ReadLEB_u32 (& maxPages, & i_bytes, i_end));
+_       (WriteLEB_u32 (io_output, maxPages));
+    }
+
+    _catch: return result;
+}
+
+
+// an aligned segment starts where its file offset lines up with its memory offset, so its pages can be mapped into
+// the memory from the file; see m3_SetModuleFile (). it starts early, with the memory before it, to line up, and its
+// header is of fixed size. these are 4 KiB pages; with larger ones, the segment is copied
+static const size_t c_m3DataPageSize = 4096;
+
+static
+M3Result  WriteDataSegment  (M3Output * io_output, const u8 * i_memory, size_t i_start, size_t i_end, bool i_aligned)
+{
+    M3Result result = m3Err_none;
+
+    const size_t headerSize = 1 + 1 + 5 + 1 + 5;
+    size_t misalignment = (i_start - (io_output->size + headerSize)) & (c_m3DataPageSize - 1);
+
+    // i_start is at least a page in
+    bool aligned = (i_aligned and misalignment <= i_start);
+
+_   (Write_u8 (io_output, 0));                                  // memory 0, active
+_   (Write_u8 (io_output, 0x41));                               // i32.const
+
+    if (aligned)
+    {
+        i_start -= misalignment;
+_       (WritePaddedLEB (io_output, (u64) (i64) (i32) (u32) i_start));
+_       (Write_u8 (io_output, 0x0b));
+_       (WritePaddedLEB (io_output, i_end - i_start));
+    }
+    else
+    {
+_       (WriteLEB_i64 (io_output, (i32) (u32) i_start));
+_       (Write_u8 (io_output, 0x0b));
+_       (WriteLEB_u32 (io_output, (u32) (i_end - i_start)));
+    }
+
+_   (Write (io_output, i_memory + i_start, i_end - i_start));
+
+    _catch: return result;
+}
+
+
+// the memory's non-zero runs, merging the ones closer than i_gap
+static
+M3Result  FindDataSegments  (u32 * o_numSegments, const u8 * i_memory, size_t i_length, size_t i_gap, M3Output * o_payload)
+{
+    M3Result result = m3Err_none;
+
+    u32 numSegments = 0;
+    size_t pos = 0;
+
+    while (pos < i_length)
+    {
+        while (pos < i_length and not i_memory [pos])
+            ++pos;
+
+        if (pos == i_length)
+            break;
+
+        size_t start = pos, end = pos;
+
+        while (pos < i_length and pos - end <= i_gap)
+        {
+            if (i_memory [pos])
+                end = pos + 1;
+            ++pos;
+        }
+
+        // a run with whole pages to map is split: up to a page boundary (a page in, at least), and aligned after that
+        size_t split = M3_MAX ((start + c_m3DataPageSize - 1) & ~(c_m3DataPageSize - 1), c_m3DataPageSize);
+        bool aligned = (end >= split + 2 * c_m3DataPageSize);
+
+        if (aligned and start < split)
+        {
+            if (o_payload)
+_               (WriteDataSegment (o_payload, i_memory, start, split, false));
+
+            ++numSegments;
+        }
+
+        if (o_payload)
+_           (WriteDataSegment (o_payload, i_memory, aligned ? split : start, end, aligned));
+
+        ++numSegments;
+        pos = end;
+    }
+
+    * o_numSegments = numSegments;
+
+    _catch: return result;
+}
+
+
+// a segment costs about 10 bytes, so short runs of zeros are cheaper to keep
+static
+M3Result  PlanDataSegments  (size_t * o_gap, u32 * o_numSegments, IM3Runtime i_runtime)
+{
+    M3Result result = m3Err_none;
+
+    const u8 * memory = i_runtime->memory.mallocated->dataBuffer;
+    size_t length = i_runtime->memory.mallocated->header.length;
+
+    size_t gap = 16;
+
+_   (FindDataSegments (o_numSegments, memory, length, gap, NULL));
+
+    while (* o_numSegments > d_m3MaxSaneDataSegments)
+    {
+        gap *= 2;
+_       (FindDataSegments (o_numSegments, memory, length, gap, NULL));
+    }
+
+    * o_gap = gap;
+
+    _catch: return result;
+}
+
+
+// written straight to the output, where the segments know their file offsets
+static
+M3Result  WriteDataSection  (M3Output * io_output, IM3Runtime i_runtime)
+{
+    M3Result result = m3Err_none;
+
+    size_t gap, sizeOffset, payloadOffset;
+    u32 numSegments;
+
+_   (PlanDataSegments (& gap, & numSegments, i_runtime));
+
+_   (Write_u8 (io_output, 11));
+
+    sizeOffset = io_output->size;
+_   (WritePaddedLEB (io_output, 0));
+
+    payloadOffset = io_output->size;
+
+_   (WriteLEB_u32 (io_output, numSegments));
+_   (FindDataSegments (& numSegments, i_runtime->memory.mallocated->dataBuffer, i_runtime->memory.mallocated->header.length, gap, io_output));
+
+    _throwif ("the data section is too large", io_output->size - payloadOffset > UINT32_MAX);
+    EncodePaddedLEB_u32 (io_output->bytes + sizeOffset, io_output->size - payloadOffset);
+
+    _catch: return result;
+}
+
+
+static
+M3Result  WriteExportSection  (M3Output * io_output, bytes_t i_bytes, cbytes_t i_end, const char * i_droppedExport)
+{
+    M3Result result = m3Err_none;
+
+    u32 numExports, numKept = 0;
+    M3Output exports = { 0 };
+
+_   (ReadLEB_u32 (& numExports, & i_bytes, i_end));
+
+    for (u32 i = 0; i < numExports; ++i)
+    {
+        bytes_t start = i_bytes;
+
+        u32 nameLength, index;
+        u8 kind;
+
+_       (ReadLEB_u32 (& nameLength, & i_bytes, i_end));
+        _throwif (m3Err_wasmMalformed, i_bytes + nameLength > i_end);
+
+        bool dropped = (i_droppedExport and nameLength == strlen (i_droppedExport) and memcmp (i_bytes, i_droppedExport, nameLength) == 0);
+        i_bytes += nameLength;
+
+_       (Read_u8 (& kind, & i_bytes, i_end));
+_       (ReadLEB_u32 (& index, & i_bytes, i_end));
+
+        if (not dropped)
+        {
+_           (Write (& exports, start, i_bytes - start));
+            ++numKept;
+        }
+    }
+
+_   (WriteLEB_u32 (io_output, numKept));
+_   (Write (io_output, exports.bytes, exports.size));
+
+    _catch:
+    free (exports.bytes);
+    return result;
+}
+
+
+static
+M3Result  WritePreinitializedModule  (M3Output * io_output, IM3Module i_module, const char * i_droppedExport)
+{
+    M3Result result = m3Err_none;
+
+    IM3Runtime runtime = i_module->runtime;
+    bool hasMemory = (runtime->memory.mallocated->dataBuffer != NULL);
+
+    M3Output section = { 0 };
+
+    bytes_t pos = i_module->wasmStart;
+    cbytes_t end = i_module->wasmEnd;
+
+_   (Write (io_output, pos, 8));    // magic, version
+    pos += 8;
+
+    while (pos < end)
+    {
+        u8 sectionType;
+        u32 sectionLength;
+
+_       (ReadLEB_u7 (& sectionType, & pos, end));
+_       (ReadLEB_u32 (& sectionLength, & pos, end));
+        _throwif (m3Err_wasmMalformed, pos + sectionLength > end);
+
+        bytes_t sectionEnd = pos + sectionLength;
+        section.size = 0;
+
+        switch (sectionType)
+        {
+            case 5:
+_               (WriteMemorySection (& section, pos, sectionEnd, runtime->memory.numPages));
+                break;
+
+            case 6:
+_               (WriteGlobalSection (& section, i_module));
+                break;
+
+            case 7:
+_               (WriteExportSection (& section, pos, sectionEnd, i_droppedExport));
+                break;
+
+            case 8:     // the start function has run
+            case 11:    // replaced by the memory
+                break;
+
+            case 12:
+            {
+                // the data section comes later; its segments are counted here
+                size_t gap;
+                u32 numDataSegments = 0;
+
+                if (hasMemory)
+_                   (PlanDataSegments (& gap, & numDataSegments, runtime));
+
+_               (WriteLEB_u32 (& section, numDataSegments));
+                break;
+            }
+
+            default:
+_               (Write (& section, pos, sectionLength));
+                break;
+        }
+
+        if (sectionType != 8 and sectionType != 11)
+_           (WriteSection (io_output, sectionType, & section));
+
+        // the data section follows the code section, possibly with custom sections in between
+        if ((sectionType == 10 or sectionType == 11) and hasMemory)
+        {
+_           (WriteDataSection (io_output, runtime));
+            hasMemory = false;
+        }
+
+        pos = sectionEnd;
+    }
+
+    if (hasMemory)
+_       (WriteDataSection (io_output, runtime));
+
+    _catch:
+    free (section.bytes);
+    return result;
+}
+
+
+M3Result  m3_PreinitializeModule  (IM3Module io_module, const char * i_initFunction, uint8_t ** o_wasmBytes, uint32_t * o_numWasmBytes)
+{
+    M3Result result = m3Err_none;
+
+    M3Output output = { 0 };
+    IM3Runtime runtime = io_module->runtime;
+
+    * o_wasmBytes = NULL;
+    * o_numWasmBytes = 0;
+
+    _throwif (m3Err_moduleNotLinked, not runtime);
+    _throwif ("only a runtime's only module can be preinitialized", runtime->modules != io_module or io_module->next);
+    _throwif ("imported memories can't be preinitialized", io_module->memoryImported or runtime->memory.isImported);
+
+_   (m3_RunStart (io_module));
+
+    if (i_initFunction)
+    {
+        IM3Function function;
+
+_       (m3_FindFunction (& function, runtime, i_initFunction));
+        _throwif (m3Err_argumentCountMismatch, m3_GetArgCount (function) != 0);
+_       (m3_CallV (function));
+    }
+
+_   (WritePreinitializedModule (& output, io_module, i_initFunction));
+    _throwif ("the module is too large", output.size > UINT32_MAX);
+
+    * o_wasmBytes = output.bytes;
+    * o_numWasmBytes = (u32) output.size;
+    output.bytes = NULL;
+
+    _catch:
+    free (output.bytes);
+    return result;
+}
@@ -34,6 +34,10 @@ struct M3Runtime;       typedef struct M3Runtime *      IM3Runtime;
 struct M3Module;        typedef struct M3Module *       IM3Module;
 struct M3Function;      typedef struct M3Function *     IM3Function;
 struct M3Global;        typedef struct M3Global *       IM3Global;
+struct M3Snapshot;      typedef struct M3Snapshot *     IM3Snapshot;
+struct M3SharedMemory;  typedef struct M3SharedMemory * IM3SharedMemory;
+struct M3CompiledModule; typedef struct M3CompiledModule * IM3CompiledModule;
+struct M3ModuleStream;  typedef struct M3ModuleStream *  IM3ModuleStream;
 
 typedef struct M3ErrorInfo
 {
@@ -121,6 +125,15 @@ struct M3Table;        typedef struct M3Table *       IM3Table;
 // 参数 userdata 为 m3_NewRuntime 传入的 userdata
 typedef int (*IM3MemToGrowCallback)(IM3Memory memory, uint32_t pagesToGrow, void *userdata);
 
+// how the linear memory's pages are backed. only with d_m3UseReservedMemory (64-bit Linux)
+typedef enum M3MemoryBacking
+{
+    c_m3MemoryBacking_default   = 0,
+    c_m3MemoryBacking_thp       = 1,    // transparent huge pages: madvise (MADV_HUGEPAGE)
+    c_m3MemoryBacking_hugeTLB   = 2,    // explicit huge pages (MAP_HUGETLB) from the hugetlbfs pool; memory.grow fails when it runs out
+    c_m3MemoryBacking_prefault  = 3,    // pages are faulted in as soon as they're accessible, instead of on first touch
+} M3MemoryBacking;
+
 // -------------------------------------------------------------------------------------------------------------------------------
 //  error codes
 // -------------------------------------------------------------------------------------------------------------------------------
@@ -213,6 +226,11 @@ d_m3ErrorConst  (trapStackOverflow,             "[trap] stack overflow")
 
     void                m3_SetCustomSectionHandler  (IM3Environment i_environment,    M3SectionHandler i_handler);
 
+    // Modules compiled with m3_CompileModule are written to i_directory (which must exist), keyed by their bytes and
+    // the engine build, and m3_LoadModule reads the code back instead of leaving it to be compiled. A missing or stale
+    // file is ignored. NULL stops it. Needs d_m3CodeCache
+    M3Result            m3_SetCodeCacheDirectory    (IM3Environment i_environment,    const char * i_directory);
+
 
 //-------------------------------------------------------------------------------------------------------------------------------
 //  execution context
@@ -237,6 +255,83 @@ d_m3ErrorConst  (trapStackOverflow,             "[trap] stack overflow")
     void                m3_SetMemToGrowCallback     (IM3Runtime             i_runtime,
                                                      IM3MemToGrowCallback   memToGrowCallback);
 
+    // must be set before a module with a memory is loaded into the runtime
+    M3Result            m3_SetMemoryBacking         (IM3Runtime             i_runtime,
+                                                     M3MemoryBacking        i_backing);
+
+    // maps i_numBytes of file i_fileDescriptor at i_fileOffset into the memory at i_memoryOffset, so it's read in place
+    // rather than copied. Both offsets must be multiples of the host page size (the wasm page size always is). The mapping
+    // is private: writes to it don't reach the file. It needs d_m3UseReservedMemory, where the memory never moves, so it
+    // lasts across memory.grow, until it's mapped over or a snapshot is restored.
+    // The range past the end of the file is zeroed, and a negative i_fileDescriptor zeroes the whole range. The file
+    // can be closed afterwards, but must not be truncated while mapped
+    M3Result            m3_MapFileIntoMemory        (IM3Runtime             io_runtime,
+                                                     uint32_t               i_memoryOffset,
+                                                     uint32_t               i_numBytes,
+                                                     int                    i_fileDescriptor,
+                                                     uint64_t               i_fileOffset);
+
+    // a linear memory for several runtimes at once, possibly on different threads (each with its own environment), so
+    // they can hand data to each other without copying. It needs d_m3UseReservedMemory: it's reserved for i_maxPages up
+    // front and never moves. m3_SetSharedMemory gives it to a runtime before a module with a memory is loaded; the
+    // module's initial size grows it if needed, and a maximum, if the module has one, can't be below i_maxPages. Growth
+    // by one runtime is seen by the others at their next call, memory.size or memory.grow. The runtimes hold references;
+    // m3_FreeSharedMemory drops the caller's, and the memory goes with the last one. Shared memories have the default
+    // backing, and can't be snapshotted, checkpointed or mapped into, like other memories from outside the runtime
+    M3Result            m3_NewSharedMemory          (IM3SharedMemory *      o_memory,
+                                                     uint32_t               i_numPages,
+                                                     uint32_t               i_maxPages);
+
+    void                m3_FreeSharedMemory         (IM3SharedMemory        i_memory);
+
+    M3Result            m3_SetSharedMemory          (IM3Runtime             io_runtime,
+                                                     IM3SharedMemory        i_memory);
+
+    // the current size, whichever runtime grew it
+    uint8_t *           m3_GetSharedMemory          (IM3SharedMemory        i_memory,
+                                                     uint32_t *             o_memorySizeInBytes);
+
+    // captures the memory, globals and tables of a runtime, typically once its modules are loaded and started.
+    // m3_RestoreSnapshot resets the runtime to that state without recompiling anything. With d_m3UseReservedMemory
+    // and the default backing, the memory is mapped copy-on-write from the snapshot, so a reset costs about what
+    // was written since. The runtime must keep the same modules, and must not be running
+    M3Result            m3_TakeSnapshot             (IM3Runtime             i_runtime,
+                                                     IM3Snapshot *          o_snapshot);
+
+    M3Result            m3_RestoreSnapshot          (IM3Runtime             io_runtime,
+                                                     IM3Snapshot            i_snapshot);
+
+    void                m3_FreeSnapshot             (IM3Snapshot            i_snapshot);
+
+    // dirty page tracking, with d_m3UseReservedMemory: the clean pages of the memory are write protected, and a SIGSEGV
+    // handler marks a page dirty on its first write. Every page starts out dirty. m3_GetDirtyPages returns a bit per page
+    // (page i is bit i % 8 of byte i / 8), and m3_ResetDirtyPages makes them all clean again. Huge TLB pages aren't supported
+    M3Result            m3_TrackDirtyPages          (IM3Runtime             io_runtime);
+
+    M3Result            m3_GetDirtyPages            (IM3Runtime             i_runtime,
+                                                     const uint8_t **       o_bits,
+                                                     uint32_t *             o_numPages,
+                                                     uint32_t *             o_pageSize);
+
+    M3Result            m3_ResetDirtyPages          (IM3Runtime             io_runtime);
+
+    // system calls fail on write protected pages instead of faulting; host functions that have the kernel write into
+    // the memory (read, getrandom) call this first
+    void                m3_MarkMemoryDirty          (IM3Runtime             io_runtime,
+                                                     const void *           i_address,
+                                                     uint32_t               i_numBytes);
+
+    // an incremental checkpoint: the dirty pages and the modules' globals, after which the pages are reset. Applying
+    // a runtime's checkpoints in order, to a runtime with the same modules loaded, brings it to the same state.
+    // The checkpoint is allocated with malloc; free () it
+    M3Result            m3_WriteCheckpoint          (IM3Runtime             io_runtime,
+                                                     uint8_t **             o_bytes,
+                                                     uint32_t *             o_numBytes);
+
+    M3Result            m3_ApplyCheckpoint          (IM3Runtime             io_runtime,
+                                                     const uint8_t *        i_bytes,
+                                                     uint32_t               i_numBytes);
+
 //-------------------------------------------------------------------------------------------------------------------------------
 //  modules
 //-------------------------------------------------------------------------------------------------------------------------------
@@ -247,6 +342,24 @@ d_m3ErrorConst  (trapStackOverflow,             "[trap] stack overflow")
                                                      const uint8_t * const  i_wasmBytes,
                                                      uint32_t               i_numWasmBytes);
 
+    // A module stream parses a module as its bytes arrive, and compiles each function body into io_runtime as soon as
+    // it has all arrived. i_numBytes is the module's size, if it's known, or 0; otherwise the bytes received are copied
+    // to a bigger buffer as they outgrow it. Finishing the stream loads the module into io_runtime, so m3_LoadModule
+    // isn't called on it; its imports are linked afterwards, as usual. A stream that fails stays failed.
+    // The stream is freed with m3_FreeModuleStream, finished or not
+    M3Result            m3_NewModuleStream          (IM3Runtime             io_runtime,
+                                                     IM3ModuleStream *      o_stream,
+                                                     uint32_t               i_numBytes);
+
+    M3Result            m3_AppendModuleStream       (IM3ModuleStream        io_stream,
+                                                     const uint8_t *        i_bytes,
+                                                     uint32_t               i_numBytes);
+
+    M3Result            m3_FinishModuleStream       (IM3ModuleStream        io_stream,
+                                                     IM3Module *            o_module);
+
+    void                m3_FreeModuleStream         (IM3ModuleStream        i_stream);
+
     // Only modules not loaded into a M3Runtime need to be freed. A module is considered unloaded if
     // a. m3_LoadModule has not yet been called on that module. Or,
     // b. m3_LoadModule returned a result.
@@ -258,9 +371,22 @@ d_m3ErrorConst  (trapStackOverflow,             "[trap] stack overflow")
     // Optional, compiles all functions in the module
     M3Result            m3_CompileModule            (IM3Module io_module);
 
+    // Like m3_CompileModule, on i_numThreads threads (0: one per processor, and never more than that), the calling one
+    // among them. Without d_m3ParallelCompilation, or with one processor, on the calling thread only
+    M3Result            m3_CompileModuleInParallel  (IM3Module io_module, uint32_t i_numThreads);
+
     // Calling m3_RunStart is optional
     M3Result            m3_RunStart                 (IM3Module i_module);
 
+    // Runs a module's start function, then i_initFunction (an export, optional), and writes out the module with their
+    // work done: the memory as its data segments, the globals' values as their initializers, no start function and no
+    // i_initFunction export. The module must be its runtime's only one, with its memory not imported.
+    // The result is allocated with malloc; free () it
+    M3Result            m3_PreinitializeModule      (IM3Module              io_module,
+                                                     const char *           i_initFunction,
+                                                     uint8_t **             o_wasmBytes,
+                                                     uint32_t *             o_numWasmBytes);
+
     // Arguments and return values are passed in and out through the stack pointer _sp.
     // Placeholder return value slots are first and arguments after. So, the first argument is at _sp [numReturns]
     // Return values should be written into _sp [0] to _sp [num_returns - 1]
@@ -279,10 +405,49 @@ d_m3ErrorConst  (trapStackOverflow,             "[trap] stack overflow")
                                                      M3RawCall              i_function,
                                                      const void *           i_userdata);
 
+    typedef struct M3RawImport
+    {
+        const char *            moduleName;         // "*" matches any module
+        const char *            functionName;
+        const char *            signature;          // optional
+        M3RawCall               function;
+        const void *            userdata;
+    }
+    M3RawImport;
+
+    // Links a whole table of host functions in one pass over the module's imports, each import to the last entry that
+    // matches it, as m3_LinkRawFunctionEx () on each entry in turn would. Entries without a matching import are ignored,
+    // rather than failing with m3Err_functionLookupFailed; imports without an entry are left unlinked
+    M3Result            m3_LinkRawFunctions         (IM3Module              io_module,
+                                                     const M3RawImport *    i_imports,
+                                                     uint32_t               i_numImports);
+
     const char*         m3_GetModuleName            (IM3Module i_module);
     void                m3_SetModuleName            (IM3Module i_module, const char* name);
+
+    // the module's wasm bytes are file i_fileDescriptor's contents from i_fileOffset on, mmapped rather than read. With
+    // d_m3UseReservedMemory, m3_LoadModule then maps the pages of the data segments copy-on-write from the file instead of
+    // copying them, where a segment's file offset and memory offset line up modulo the page size. The file has to stay
+    // open until the module is loaded, and unchanged for as long as the memory is in use
+    void                m3_SetModuleFile            (IM3Module i_module, int i_fileDescriptor, uint64_t i_fileOffset);
     IM3Runtime          m3_GetModuleRuntime         (IM3Module i_module);
 
+    // compiles io_module once for any number of runtimes. io_module must be loaded into a runtime of its own and have its
+    // imports linked, but nothing compiled or run; the compiled module then owns that runtime, which mustn't be used or
+    // freed any more. m3_InstantiateModule loads an instance of it into i_runtime without parsing or compiling anything:
+    // the instance has its own memory, globals and tables, and shares the code and the imports. Instances can be made
+    // and run on any thread; each runtime can hold one. The instances hold references to the compiled module, and the
+    // environment must outlive them all. The IM3Functions of imports see the compiled module in IM3ImportContext
+    M3Result            m3_NewCompiledModule        (IM3CompiledModule *    o_compiled,
+                                                     IM3Module              io_module);
+
+    void                m3_FreeCompiledModule       (IM3CompiledModule      i_compiled);
+
+    // like m3_LoadModule, the runtime owns o_instance
+    M3Result            m3_InstantiateModule        (IM3Runtime             io_runtime,
+                                                     IM3CompiledModule      i_compiled,
+                                                     IM3Module *            o_instance);
+
 //-------------------------------------------------------------------------------------------------------------------------------
 //  globals
 //-------------------------------------------------------------------------------------------------------------------------------
@@ -5,15 +5,29 @@
 //  Copyright © 2020 Steven Massey. All rights reserved.
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE      // for mkdtemp () and truncate () under -std=c99
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#   include <dirent.h>
+#   include <unistd.h>
+#endif
 
 #include "wasm3_ext.h"
+#include "m3_env.h"
 #include "m3_bind.h"
 
 #define Test(NAME) if (RunTest (argc, argv, #NAME) != 0)
 #define DisabledTest(NAME) printf ("\ndisabled: %s\n", #NAME); if (false)
-#define expect(TEST) if (not (TEST)) { printf ("failed: (%s) on line: %d\n", #TEST, __LINE__); }
+#define expect(TEST) if (not (TEST)) { printf ("failed: (%s) on line: %d\n", #TEST, __LINE__); ++s_numFailures; }
+
 
+static int s_numFailures = 0;
 
 bool RunTest (int i_argc, const char * i_argv [], cstr_t i_name)
 {
@@ -28,6 +42,173 @@ bool RunTest (int i_argc, const char * i_argv [], cstr_t i_name)
 }
 
 
+#if 0
+(module
+    (import "env" "host" (func $host (result i32)))
+    (memory (export "memory") 1 4)
+    (global $g (export "g") (mut i32) (i32.const 7))
+    (func (export "store") (param i32 i32) local.get 0 local.get 1 i32.store)
+    (func (export "load") (param i32) (result i32) local.get 0 i32.load)
+    (func (export "grow") (param i32) (result i32) local.get 0 memory.grow)
+    (func (export "size") (result i32) memory.size)
+    (func (export "setg") (param i32) local.get 0 global.set $g)
+    (func (export "getg") (result i32) global.get $g)
+    (func (export "host") (result i32) call $host)
+)
+#endif
+static const u8 c_memoryModule [183] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x13, 0x04, 0x60, 0x00, 0x01, 0x7f, 0x60, 0x02, 0x7f, 0x7f, 0x00, 0x60, 0x01, 0x7f, 0x01,
+    0x7f, 0x60, 0x01, 0x7f, 0x00, 0x02, 0x0c, 0x01, 0x03, 0x65, 0x6e, 0x76, 0x04, 0x68, 0x6f, 0x73, 0x74, 0x00, 0x00, 0x03, 0x08, 0x07, 0x01, 0x02,
+    0x02, 0x00, 0x03, 0x00, 0x00, 0x05, 0x04, 0x01, 0x01, 0x01, 0x04, 0x06, 0x06, 0x01, 0x7f, 0x01, 0x41, 0x07, 0x0b, 0x07, 0x40, 0x09, 0x05, 0x73,
+    0x74, 0x6f, 0x72, 0x65, 0x00, 0x01, 0x04, 0x6c, 0x6f, 0x61, 0x64, 0x00, 0x02, 0x04, 0x67, 0x72, 0x6f, 0x77, 0x00, 0x03, 0x04, 0x73, 0x69, 0x7a,
+    0x65, 0x00, 0x04, 0x04, 0x73, 0x65, 0x74, 0x67, 0x00, 0x05, 0x04, 0x67, 0x65, 0x74, 0x67, 0x00, 0x06, 0x04, 0x68, 0x6f, 0x73, 0x74, 0x00, 0x07,
+    0x01, 0x67, 0x03, 0x00, 0x06, 0x6d, 0x65, 0x6d, 0x6f, 0x72, 0x79, 0x02, 0x00, 0x0a, 0x30, 0x07, 0x09, 0x00, 0x20, 0x00, 0x20, 0x01, 0x36, 0x02,
+    0x00, 0x0b, 0x07, 0x00, 0x20, 0x00, 0x28, 0x02, 0x00, 0x0b, 0x06, 0x00, 0x20, 0x00, 0x40, 0x00, 0x0b, 0x04, 0x00, 0x3f, 0x00, 0x0b, 0x06, 0x00,
+    0x20, 0x00, 0x24, 0x00, 0x0b, 0x04, 0x00, 0x23, 0x00, 0x0b, 0x04, 0x00, 0x10, 0x00, 0x0b
+};
+
+
+#if 0
+(module
+    (import "env" "a" (func $envA (result i32)))
+    (import "env" "b" (func $envB (result i32)))
+    (import "other" "a" (func $otherA (result i32)))
+    (func (export "a") (result i32) call $envA)
+    (func (export "b") (result i32) call $envB)
+    (func (export "othera") (result i32) call $otherA)
+)
+#endif
+static const u8 c_importsModule [88] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x05, 0x01, 0x60, 0x00, 0x01, 0x7f, 0x02, 0x1b, 0x03, 0x03, 0x65, 0x6e, 0x76, 0x01, 0x61,
+    0x00, 0x00, 0x03, 0x65, 0x6e, 0x76, 0x01, 0x62, 0x00, 0x00, 0x05, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x01, 0x61, 0x00, 0x00, 0x03, 0x04, 0x03, 0x00,
+    0x00, 0x00, 0x07, 0x12, 0x03, 0x01, 0x61, 0x00, 0x03, 0x01, 0x62, 0x00, 0x04, 0x06, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x61, 0x00, 0x05, 0x0a, 0x10,
+    0x03, 0x04, 0x00, 0x10, 0x00, 0x0b, 0x04, 0x00, 0x10, 0x01, 0x0b, 0x04, 0x00, 0x10, 0x02, 0x0b
+};
+
+
+// env.host () returns its import's userdata
+m3ApiRawFunction (HostImportUserData)
+{
+    m3ApiReturnType (i32)
+    m3ApiReturn ((i32) (uintptr_t) _ctx->userdata)
+}
+
+
+// env.host () returns its runtime's userdata
+m3ApiRawFunction (HostRuntimeUserData)
+{
+    m3ApiReturnType (i32)
+    m3ApiReturn ((i32) (uintptr_t) m3_GetUserData (runtime))
+}
+
+
+IM3Module  LoadMemoryModule  (IM3Runtime io_runtime, M3RawCall i_host, const void * i_hostUserData)
+{
+    IM3Module module = NULL;
+
+    if (m3_ParseModule (io_runtime->environment, & module, c_memoryModule, sizeof (c_memoryModule)))
+        return NULL;
+
+    if (m3_LoadModule (io_runtime, module))
+    {
+        m3_FreeModule (module);
+        return NULL;
+    }
+
+    if (m3_LinkRawFunctionEx (module, "env", "host", "i()", i_host, i_hostUserData))
+        return NULL;
+
+    return module;
+}
+
+
+// calls an export with up to two arguments. the result, if there is one; -1 for a trap
+i32  CallExport  (IM3Runtime i_runtime, cstr_t i_name, i32 i_arg0, i32 i_arg1)
+{
+    IM3Function function = NULL;
+
+    if (m3_FindFunction (& function, i_runtime, i_name))
+        return -1;
+
+    const void * args [2] = { & i_arg0, & i_arg1 };
+
+    if (m3_Call (function, m3_GetArgCount (function), args))
+        return -1;
+
+    i32 ret = 0;
+    const void * rets [1] = { & ret };
+
+    if (m3_GetRetCount (function))
+        m3_GetResults (function, 1, rets);
+
+    return ret;
+}
+
+
+i32  LoadMemory  (IM3Runtime i_runtime, u32 i_offset)
+{
+    u32 size = 0;
+    u8 * memory = m3_GetMemory (i_runtime, & size, 0);
+
+    i32 value = -1;
+    if (memory and i_offset + sizeof (value) <= size)
+        memcpy (& value, memory + i_offset, sizeof (value));
+
+    return value;
+}
+
+
+#if d_m3CodeCache
+// the path of the one file in i_directory; false if there are none, or more
+bool  FindCacheFile  (char * o_path, size_t i_size, cstr_t i_directory)
+{
+    u32 numFiles = 0;
+
+    DIR * directory = opendir (i_directory);
+
+    if (directory)
+    {
+        for (struct dirent * entry = readdir (directory); entry; entry = readdir (directory))
+        {
+            if (entry->d_name [0] != '.')
+            {
+                snprintf (o_path, i_size, "%s/%s", i_directory, entry->d_name);
+                ++numFiles;
+            }
+        }
+
+        closedir (directory);
+    }
+
+    return numFiles == 1;
+}
+
+
+void  RemoveCacheFiles  (cstr_t i_directory)
+{
+    char path [1024];
+
+    DIR * directory = opendir (i_directory);
+
+    if (directory)
+    {
+        for (struct dirent * entry = readdir (directory); entry; entry = readdir (directory))
+        {
+            if (entry->d_name [0] != '.')
+            {
+                snprintf (path, sizeof (path), "%s/%s", i_directory, entry->d_name);
+                unlink (path);
+            }
+        }
+
+        closedir (directory);
+    }
+
+    rmdir (i_directory);
+}
+#endif
+
+
 int  main  (int argc, const char  * argv [])
 {
     Test (signatures)
@@ -176,6 +357,7 @@ int  main  (int argc, const char  * argv [])
         }
         
         m3_FreeRuntime (runtime);
+        m3_FreeEnvironment (env);
     }
     
 	IM3Environment env = m3_NewEnvironment ();
@@ -224,6 +406,8 @@ int  main  (int argc, const char  * argv [])
 			
 			printf ("%d %f\n", ret0, ret1);
 		}
+
+		m3_FreeRuntime (runtime);
 	}
 
 		
@@ -257,6 +441,668 @@ int  main  (int argc, const char  * argv [])
 			)
 #			endif
 	}
-    
-    return 0;
+
+
+    Test (snapshot)
+    {
+        M3Result result;
+
+        IM3Runtime runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module module = LoadMemoryModule (runtime, HostImportUserData, NULL);        expect (module)
+
+        CallExport (runtime, "store", 16, 1234);
+        CallExport (runtime, "setg", 5, 0);
+
+        IM3Snapshot snapshot = NULL;
+        result = m3_TakeSnapshot (runtime, & snapshot);                                 expect (result == m3Err_none)
+
+        // the state the second restore starts from is the one the first restore left, with the same changes on top
+        for (u32 i = 0; i < 2; ++i)
+        {
+            CallExport (runtime, "store", 16, 99);
+            CallExport (runtime, "setg", 77, 0);
+            i32 previous = CallExport (runtime, "grow", 2, 0);                          expect (previous == 1)
+            CallExport (runtime, "store", 65536 + 16, 4321);                            expect (LoadMemory (runtime, 65536 + 16) == 4321)
+                                                                                        expect (m3_GetMemorySize (runtime) == 3 * 65536)
+
+            result = m3_RestoreSnapshot (runtime, snapshot);                            expect (result == m3Err_none)
+
+                                                                                        expect (m3_GetMemorySize (runtime) == 65536)
+                                                                                        expect (CallExport (runtime, "size", 0, 0) == 1)
+                                                                                        expect (LoadMemory (runtime, 16) == 1234)
+                                                                                        expect (CallExport (runtime, "load", 16, 0) == 1234)
+#           if !d_m3UseIndexMasking
+                                                                                        expect (CallExport (runtime, "load", 65536 + 16, 0) == -1)
+#           endif
+                                                                                        expect (CallExport (runtime, "getg", 0, 0) == 5)
+
+            M3TaggedValue value;
+            result = m3_GetGlobal (m3_FindGlobal (module, "g"), & value);               expect (result == m3Err_none)
+                                                                                        expect (value.value.i32 == 5)
+        }
+
+        // the memory grown into after a restore is zero again
+        CallExport (runtime, "grow", 1, 0);                                             expect (LoadMemory (runtime, 65536 + 16) == 0)
+
+        // a snapshot of a grown memory keeps its size and what's in the grown part
+        CallExport (runtime, "store", 65536 + 8, 555);
+        IM3Snapshot grown = NULL;
+        result = m3_TakeSnapshot (runtime, & grown);                                    expect (result == m3Err_none)
+        CallExport (runtime, "grow", 2, 0);
+        CallExport (runtime, "store", 65536 + 8, 1);
+        result = m3_RestoreSnapshot (runtime, grown);                                   expect (result == m3Err_none)
+                                                                                        expect (CallExport (runtime, "size", 0, 0) == 2)
+                                                                                        expect (CallExport (runtime, "load", 65536 + 8, 0) == 555)
+        m3_FreeSnapshot (grown);
+
+        // a snapshot only restores into its own runtime
+        IM3Runtime other = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module otherModule = LoadMemoryModule (other, HostImportUserData, NULL);     expect (otherModule)
+        CallExport (other, "store", 16, 42);
+        result = m3_RestoreSnapshot (other, snapshot);                                  expect (result != m3Err_none)
+                                                                                        expect (CallExport (other, "load", 16, 0) == 42)
+        m3_FreeRuntime (other);
+
+        // nor into one that has loaded a module since, and a refused restore leaves the runtime as it was
+        IM3Module second = LoadMemoryModule (runtime, HostImportUserData, NULL);        expect (second)
+        CallExport (runtime, "store", 16, 66);
+        u32 size = m3_GetMemorySize (runtime);
+        result = m3_RestoreSnapshot (runtime, snapshot);                                expect (result != m3Err_none)
+                                                                                        expect (m3_GetMemorySize (runtime) == size)
+                                                                                        expect (CallExport (runtime, "load", 16, 0) == 66)
+
+        m3_FreeSnapshot (snapshot);
+        m3_FreeRuntime (runtime);
+    }
+
+
+#   if d_m3UseReservedMemory
+    Test (checkpoint)
+    {
+        M3Result result;
+
+        IM3Runtime runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module module = LoadMemoryModule (runtime, HostImportUserData, NULL);        expect (module)
+
+        IM3Runtime replica = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module replicaModule = LoadMemoryModule (replica, HostImportUserData, NULL); expect (replicaModule)
+
+        result = m3_TrackDirtyPages (runtime);                                          expect (result == m3Err_none)
+
+        for (u32 i = 0; i < 3; ++i)
+        {
+            if (i == 0)
+            {
+                CallExport (runtime, "store", 16, 1234);
+                CallExport (runtime, "setg", 5, 0);
+            }
+            else if (i == 1)
+            {
+                // the pages grown into are written as well, and the replica grows to fit them
+                CallExport (runtime, "grow", 1, 0);
+                CallExport (runtime, "store", 65536 + 32, 777);
+                CallExport (runtime, "store", 16, 55);
+            }
+            // and with nothing written, nothing changes
+
+            u8 * checkpoint = NULL;
+            u32 numBytes = 0;
+            result = m3_WriteCheckpoint (runtime, & checkpoint, & numBytes);            expect (result == m3Err_none)
+            result = m3_ApplyCheckpoint (replica, checkpoint, numBytes);                expect (result == m3Err_none)
+            free (checkpoint);
+
+            u32 size = 0, replicaSize = 0;
+            u8 * memory = m3_GetMemory (runtime, & size, 0);
+            u8 * replicaMemory = m3_GetMemory (replica, & replicaSize, 0);
+                                                                                        expect (replicaSize == size)
+                                                                                        expect (size == (i ? 2 : 1) * 65536)
+                                                                                        expect (memory and replicaMemory and memcmp (memory, replicaMemory, size) == 0)
+                                                                                        expect (CallExport (replica, "getg", 0, 0) == 5)
+                                                                                        expect (CallExport (replica, "load", 16, 0) == (i ? 55 : 1234))
+        }
+                                                                                        expect (CallExport (replica, "load", 65536 + 32, 0) == 777)
+
+        // tracking twice is tracking once; a runtime that isn't tracked has nothing to write
+        result = m3_TrackDirtyPages (runtime);                                          expect (result == m3Err_none)
+        u8 * checkpoint = NULL;
+        u32 numBytes = 0;
+        result = m3_WriteCheckpoint (replica, & checkpoint, & numBytes);                expect (result != m3Err_none)
+                                                                                        expect (not checkpoint)
+
+        CallExport (runtime, "store", 16, 4321);
+        result = m3_WriteCheckpoint (runtime, & checkpoint, & numBytes);                expect (result == m3Err_none)
+
+        // damaged or cut short, or for other modules, it's refused
+        result = m3_ApplyCheckpoint (replica, checkpoint, 12);                          expect (result != m3Err_none)
+        result = m3_ApplyCheckpoint (replica, checkpoint, numBytes - 1);                expect (result != m3Err_none)
+
+        IM3Runtime empty = m3_NewRuntime (env, 64 * 1024, NULL);
+        result = m3_ApplyCheckpoint (empty, checkpoint, numBytes);                      expect (result != m3Err_none)
+        m3_FreeRuntime (empty);
+
+        checkpoint [0] ^= 0xff;
+        result = m3_ApplyCheckpoint (replica, checkpoint, numBytes);                    expect (result != m3Err_none)
+        checkpoint [0] ^= 0xff;
+
+        result = m3_ApplyCheckpoint (replica, checkpoint, numBytes);                    expect (result == m3Err_none)
+                                                                                        expect (CallExport (replica, "load", 16, 0) == 4321)
+        free (checkpoint);
+
+        m3_FreeRuntime (replica);
+        m3_FreeRuntime (runtime);
+    }
+#   endif
+
+
+#   if d_m3UseReservedMemory
+    Test (sharedmemory)
+    {
+        M3Result result;
+
+        IM3SharedMemory shared = NULL;
+        result = m3_NewSharedMemory (& shared, 1, 4);                                   expect (result == m3Err_none)
+
+        IM3Runtime runtimes [2] = { NULL };
+
+        for (u32 i = 0; i < 2; ++i)
+        {
+            runtimes [i] = m3_NewRuntime (env, 64 * 1024, NULL);
+            result = m3_SetSharedMemory (runtimes [i], shared);                         expect (result == m3Err_none)
+            IM3Module module = LoadMemoryModule (runtimes [i], HostImportUserData, NULL);
+                                                                                        expect (module)
+        }
+
+        // the runtimes hold on to it
+        m3_FreeSharedMemory (shared);
+
+        CallExport (runtimes [0], "store", 16, 1234);                                   expect (CallExport (runtimes [1], "load", 16, 0) == 1234)
+                                                                                        expect (LoadMemory (runtimes [1], 16) == 1234)
+
+        // growing by one is seen by the other at its next memory.size or call
+        i32 previous = CallExport (runtimes [0], "grow", 1, 0);                         expect (previous == 1)
+                                                                                        expect (CallExport (runtimes [1], "size", 0, 0) == 2)
+                                                                                        expect (m3_GetMemorySize (runtimes [1]) == 2 * 65536)
+
+        CallExport (runtimes [1], "store", 65536 + 16, 4321);                           expect (CallExport (runtimes [0], "load", 65536 + 16, 0) == 4321)
+        previous = CallExport (runtimes [1], "grow", 1, 0);                             expect (previous == 2)
+                                                                                        expect (CallExport (runtimes [0], "size", 0, 0) == 3)
+                                                                                        expect (CallExport (runtimes [0], "grow", 2, 0) == -1)
+
+        m3_FreeRuntime (runtimes [0]);
+                                                                                        expect (CallExport (runtimes [1], "load", 16, 0) == 1234)
+        m3_FreeRuntime (runtimes [1]);
+
+        // more pages than the maximum, or a maximum past 4 GiB
+        result = m3_NewSharedMemory (& shared, 2, 1);                                   expect (result != m3Err_none)
+                                                                                        expect (not shared)
+        result = m3_NewSharedMemory (& shared, 1, 65537);                               expect (result != m3Err_none)
+                                                                                        expect (not shared)
+
+        // a runtime takes a shared memory before it has a memory of its own, and only with the default backing
+        result = m3_NewSharedMemory (& shared, 1, 4);                                   expect (result == m3Err_none)
+
+        IM3Runtime loaded = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module module = LoadMemoryModule (loaded, HostImportUserData, NULL);         expect (module)
+        result = m3_SetSharedMemory (loaded, shared);                                   expect (result != m3Err_none)
+        CallExport (loaded, "store", 16, 99);                                           expect (m3_GetSharedMemory (shared, NULL) [16] == 0)
+        m3_FreeRuntime (loaded);
+
+        IM3Runtime prefaulted = m3_NewRuntime (env, 64 * 1024, NULL);
+        result = m3_SetMemoryBacking (prefaulted, c_m3MemoryBacking_prefault);          expect (result == m3Err_none)
+        result = m3_SetSharedMemory (prefaulted, shared);                               expect (result != m3Err_none)
+        m3_FreeRuntime (prefaulted);
+
+        m3_FreeSharedMemory (shared);
+    }
+#   endif
+
+
+    Test (compiledmodule)
+    {
+        M3Result result;
+
+        // the runtime the compiled module takes over
+        IM3Runtime runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module module = LoadMemoryModule (runtime, HostRuntimeUserData, NULL);       expect (module)
+
+        IM3CompiledModule compiled = NULL;
+        result = m3_NewCompiledModule (& compiled, module);                             expect (result == m3Err_none)
+
+        IM3Runtime runtimes [2] = { NULL };
+        IM3Module instances [2] = { NULL };
+
+        for (u32 i = 0; i < 2; ++i)
+        {
+            runtimes [i] = m3_NewRuntime (env, 64 * 1024, (void *) (uintptr_t) (10 + i));
+            result = m3_InstantiateModule (runtimes [i], compiled, & instances [i]);    expect (result == m3Err_none)
+        }
+
+        // the instances hold on to it
+        m3_FreeCompiledModule (compiled);
+
+                                                                                        expect (CallExport (runtimes [0], "getg", 0, 0) == 7)
+        CallExport (runtimes [0], "setg", 11, 0);
+        CallExport (runtimes [0], "store", 16, 100);
+                                                                                        expect (CallExport (runtimes [1], "getg", 0, 0) == 7)
+                                                                                        expect (CallExport (runtimes [1], "load", 16, 0) == 0)
+        CallExport (runtimes [1], "setg", 22, 0);
+        CallExport (runtimes [1], "store", 16, 200);
+        CallExport (runtimes [1], "grow", 1, 0);
+
+        for (u32 i = 0; i < 2; ++i)
+        {
+                                                                                        expect (CallExport (runtimes [i], "getg", 0, 0) == (i ? 22 : 11))
+            M3TaggedValue value;
+            result = m3_GetGlobal (m3_FindGlobal (instances [i], "g"), & value);        expect (result == m3Err_none)
+                                                                                        expect (value.value.i32 == (i ? 22 : 11))
+                                                                                        expect (CallExport (runtimes [i], "load", 16, 0) == (i ? 200 : 100))
+                                                                                        expect (CallExport (runtimes [i], "size", 0, 0) == (i ? 2 : 1))
+            // the shared import sees the runtime that called it
+                                                                                        expect (CallExport (runtimes [i], "host", 0, 0) == 10 + (i32) i)
+        }
+
+        // a runtime holds one instance, of a compiled module from its own environment
+        IM3Module extra = NULL;
+        result = m3_InstantiateModule (runtimes [0], compiled, & extra);                expect (result != m3Err_none)
+                                                                                        expect (not extra)
+
+        IM3Environment otherEnv = m3_NewEnvironment ();
+        IM3Runtime otherRuntime = m3_NewRuntime (otherEnv, 64 * 1024, NULL);
+        result = m3_InstantiateModule (otherRuntime, compiled, & extra);                expect (result != m3Err_none)
+                                                                                        expect (not extra)
+        m3_FreeRuntime (otherRuntime);
+        m3_FreeEnvironment (otherEnv);
+
+        // a module is compiled for instances once, and only while it's loaded, alone in its runtime and not compiled yet
+        IM3CompiledModule again = NULL;
+        result = m3_NewCompiledModule (& again, module);                                expect (result != m3Err_none)
+                                                                                        expect (not again)
+
+        IM3Module unloaded = NULL;
+        result = m3_ParseModule (env, & unloaded, c_memoryModule, sizeof (c_memoryModule));
+                                                                                        expect (result == m3Err_none)
+        result = m3_NewCompiledModule (& again, unloaded);                              expect (result != m3Err_none)
+        m3_FreeModule (unloaded);
+
+        IM3Runtime crowded = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module first = LoadMemoryModule (crowded, HostImportUserData, NULL);         expect (first)
+        IM3Module second = LoadMemoryModule (crowded, HostImportUserData, NULL);        expect (second)
+        result = m3_NewCompiledModule (& again, first);                                 expect (result != m3Err_none)
+        m3_FreeRuntime (crowded);
+
+        IM3Runtime eager = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module compiledEarly = LoadMemoryModule (eager, HostImportUserData, NULL);   expect (compiledEarly)
+        result = m3_CompileModule (compiledEarly);                                      expect (result == m3Err_none)
+        result = m3_NewCompiledModule (& again, compiledEarly);                         expect (result != m3Err_none)
+                                                                                        expect (not again)
+        m3_FreeRuntime (eager);
+
+        m3_FreeRuntime (runtimes [0]);
+                                                                                        expect (CallExport (runtimes [1], "getg", 0, 0) == 22)
+        m3_FreeRuntime (runtimes [1]);
+    }
+
+
+    Test (parallelcompile)
+    {
+        M3Result result;
+
+        // more threads than processors, one per processor, and the calling thread only
+        const u32 numThreads [3] = { 64, 0, 1 };
+
+        for (u32 i = 0; i < 3; ++i)
+        {
+            IM3Runtime runtime = m3_NewRuntime (env, 64 * 1024, (void *) (uintptr_t) 5);
+            IM3Module module = LoadMemoryModule (runtime, HostRuntimeUserData, NULL);   expect (module)
+
+            result = m3_CompileModuleInParallel (module, numThreads [i]);               expect (result == m3Err_none)
+
+            for (u32 f = 0; f < module->numFunctions; ++f)
+            {
+                                                                                        expect (not module->functions [f].wasm or module->functions [f].compiled)
+            }
+
+            CallExport (runtime, "store", 16, 1234);
+            CallExport (runtime, "setg", 9, 0);
+                                                                                        expect (CallExport (runtime, "load", 16, 0) == 1234)
+                                                                                        expect (CallExport (runtime, "getg", 0, 0) == 9)
+                                                                                        expect (CallExport (runtime, "grow", 1, 0) == 1)
+                                                                                        expect (CallExport (runtime, "size", 0, 0) == 2)
+                                                                                        expect (CallExport (runtime, "host", 0, 0) == 5)
+
+            // compiling what's already compiled does nothing
+            result = m3_CompileModuleInParallel (module, numThreads [i]);               expect (result == m3Err_none)
+                                                                                        expect (CallExport (runtime, "load", 16, 0) == 1234)
+
+            m3_FreeRuntime (runtime);
+        }
+    }
+
+
+    Test (modulestream)
+    {
+        M3Result result;
+        const u32 numBytes = sizeof (c_memoryModule);
+
+        // a byte at a time, of a size not known up front: the buffer is outgrown, and the module moved, over and over
+        IM3Runtime runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+
+        IM3ModuleStream stream = NULL;
+        result = m3_NewModuleStream (runtime, & stream, 0);                             expect (result == m3Err_none)
+
+        for (u32 i = 0; i < numBytes and not result; ++i)
+            result = m3_AppendModuleStream (stream, c_memoryModule + i, 1);
+                                                                                        expect (result == m3Err_none)
+
+        IM3Module module = NULL;
+        result = m3_FinishModuleStream (stream, & module);                              expect (result == m3Err_none)
+        m3_FreeModuleStream (stream);
+
+        if (module)
+        {
+            result = m3_LinkRawFunctionEx (module, "env", "host", "i()", HostImportUserData, (void *) 42);
+                                                                                        expect (result == m3Err_none)
+            CallExport (runtime, "store", 16, 1234);                                    expect (CallExport (runtime, "load", 16, 0) == 1234)
+                                                                                        expect (CallExport (runtime, "getg", 0, 0) == 7)
+                                                                                        expect (CallExport (runtime, "grow", 1, 0) == 1)
+                                                                                        expect (CallExport (runtime, "host", 0, 0) == 42)
+        }
+
+        m3_FreeRuntime (runtime);
+
+        // cut off anywhere, it's a module where m3_ParseModule () says it's one, and an underrun elsewhere. the rest
+        // coming in after the stream failed doesn't revive it
+        for (u32 length = 1; length < numBytes; ++length)
+        {
+            runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+
+            IM3Module parsed = NULL;
+            M3Result parseResult = m3_ParseModule (env, & parsed, c_memoryModule, length);
+            m3_FreeModule (parsed);
+
+            result = m3_NewModuleStream (runtime, & stream, 0);                         expect (result == m3Err_none)
+            result = m3_AppendModuleStream (stream, c_memoryModule, length);            expect (result == m3Err_none)
+
+            module = NULL;
+            result = m3_FinishModuleStream (stream, & module);                          expect ((result == m3Err_none) == (parseResult == m3Err_none))
+                                                                                        expect (result == m3Err_none or result == m3Err_wasmUnderrun)
+                                                                                        expect ((module != NULL) == (result == m3Err_none))
+            if (result)
+            {
+                m3_AppendModuleStream (stream, c_memoryModule + length, numBytes - length);
+                result = m3_FinishModuleStream (stream, & module);                      expect (result == m3Err_wasmUnderrun)
+                                                                                        expect (module == NULL)
+            }
+
+            m3_FreeModuleStream (stream);
+            m3_FreeRuntime (runtime);
+        }
+
+        // in chunks, with a size hint that's too small, exact, or too big
+        const u32 hints [3] = { 16, numBytes, 4 * numBytes };
+
+        for (u32 h = 0; h < 3; ++h)
+        {
+            runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+
+            result = m3_NewModuleStream (runtime, & stream, hints [h]);                 expect (result == m3Err_none)
+
+            for (u32 offset = 0; offset < numBytes and not result; offset += 50)
+                result = m3_AppendModuleStream (stream, c_memoryModule + offset, M3_MIN (50, numBytes - offset));
+                                                                                        expect (result == m3Err_none)
+            module = NULL;
+            result = m3_FinishModuleStream (stream, & module);                          expect (result == m3Err_none)
+            m3_FreeModuleStream (stream);
+
+            if (module)
+            {
+                CallExport (runtime, "store", 16, 77);                                  expect (CallExport (runtime, "load", 16, 0) == 77)
+            }
+
+            m3_FreeRuntime (runtime);
+        }
+
+        // a wrong magic number or version fails the stream at once, and for good; so does finishing one that's empty
+        runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+
+        for (u32 wrong = 0; wrong < 8; wrong += 4)
+        {
+            u8 header [8];
+            memcpy (header, c_memoryModule, sizeof (header));
+            header [wrong] ^= 0xff;
+
+            result = m3_NewModuleStream (runtime, & stream, 0);                         expect (result == m3Err_none)
+            result = m3_AppendModuleStream (stream, header, sizeof (header));           expect (result != m3Err_none)
+            M3Result failure = result;
+            result = m3_AppendModuleStream (stream, c_memoryModule + 8, numBytes - 8);  expect (result == failure)
+            module = NULL;
+            result = m3_FinishModuleStream (stream, & module);                          expect (result == failure)
+                                                                                        expect (module == NULL)
+            m3_FreeModuleStream (stream);
+        }
+
+        result = m3_NewModuleStream (runtime, & stream, 0);                             expect (result == m3Err_none)
+        result = m3_FinishModuleStream (stream, & module);                              expect (result == m3Err_wasmUnderrun)
+        m3_FreeModuleStream (stream);
+
+        // given up on halfway through
+        result = m3_NewModuleStream (runtime, & stream, 0);                             expect (result == m3Err_none)
+        result = m3_AppendModuleStream (stream, c_memoryModule, numBytes / 2);          expect (result == m3Err_none)
+        m3_FreeModuleStream (stream);
+
+        m3_FreeRuntime (runtime);
+    }
+
+
+    Test (linkrawfunctions)
+    {
+        M3Result result;
+
+        // the userdata says which entry an import was linked to. "*" matches env and other alike; a later entry
+        // overrides an earlier one; other.b and nowhere.c match no import, and the second table leaves env.b unlinked
+        const M3RawImport tables [2][6] = {
+            {
+                { "env",     "a",    "i()",  HostImportUserData, (void *) 1 },
+                { "*",       "a",    "i()",  HostImportUserData, (void *) 2 },
+                { "env",     "b",    "i()",  HostImportUserData, (void *) 3 },
+                { "other",   "b",    "i()",  HostImportUserData, (void *) 4 },
+                { "env",     "a",    NULL,   HostImportUserData, (void *) 5 },
+                { "nowhere", "c",    "i()",  HostImportUserData, (void *) 6 }
+            },
+            {
+                { "env",     "a",    "i()",  HostImportUserData, (void *) 1 },
+                { "*",       "a",    "i()",  HostImportUserData, (void *) 2 }
+            }
+        };
+        const u32 numEntries [2] = { 6, 2 };
+
+        // what env.a, env.b and other.a return; -1 for a trap, unlinked
+        const i32 expected [2][3] = { { 5, 3, 2 }, { 2, -1, 2 } };
+
+        for (u32 t = 0; t < 2; ++t)
+        {
+            IM3Runtime runtimes [2] = { NULL };
+            IM3Module modules [2] = { NULL };
+
+            for (u32 i = 0; i < 2; ++i)
+            {
+                runtimes [i] = m3_NewRuntime (env, 64 * 1024, NULL);
+                result = m3_ParseModule (env, & modules [i], c_importsModule, sizeof (c_importsModule));
+                                                                                        expect (result == m3Err_none)
+                result = m3_LoadModule (runtimes [i], modules [i]);                     expect (result == m3Err_none)
+            }
+
+            // the whole table at once, then the same entries one by one
+            result = m3_LinkRawFunctions (modules [0], tables [t], numEntries [t]);    expect (result == m3Err_none)
+
+            for (u32 e = 0; e < numEntries [t]; ++e)
+            {
+                const M3RawImport * entry = & tables [t][e];
+                bool matches = strcmp (entry->functionName, "c") != 0 and strcmp (entry->moduleName, "other") != 0;
+
+                result = m3_LinkRawFunctionEx (modules [1], entry->moduleName, entry->functionName, entry->signature,
+                                               entry->function, entry->userdata);
+                                                                                        expect (result == (matches ? m3Err_none : m3Err_functionLookupFailed))
+            }
+
+            for (u32 i = 0; i < 2; ++i)
+            {
+                                                                                        expect (CallExport (runtimes [i], "a", 0, 0) == expected [t][0])
+                                                                                        expect (CallExport (runtimes [i], "b", 0, 0) == expected [t][1])
+                                                                                        expect (CallExport (runtimes [i], "othera", 0, 0) == expected [t][2])
+                m3_FreeRuntime (runtimes [i]);
+            }
+        }
+
+        // a signature that doesn't fit fails the table
+        IM3Runtime runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+        IM3Module module = NULL;
+        result = m3_ParseModule (env, & module, c_importsModule, sizeof (c_importsModule));
+                                                                                        expect (result == m3Err_none)
+        result = m3_LoadModule (runtime, module);                                       expect (result == m3Err_none)
+
+        const M3RawImport mismatched = { "env", "b", "v(i)", HostImportUserData, NULL };
+        result = m3_LinkRawFunctions (module, & mismatched, 1);                         expect (result != m3Err_none)
+
+        m3_FreeRuntime (runtime);
+
+        // an empty table links nothing; a long one of the same name still leaves the last match linked
+        M3RawImport sameName [20];
+        for (u32 e = 0; e < 20; ++e)
+        {
+            sameName [e] = (M3RawImport) { (e % 3 == 0) ? "*" : (e % 3 == 1) ? "env" : "other", "a", "i()",
+                                           HostImportUserData, (void *) (uintptr_t) (e + 1) };
+        }
+
+        runtime = m3_NewRuntime (env, 64 * 1024, NULL);
+        module = NULL;
+        result = m3_ParseModule (env, & module, c_importsModule, sizeof (c_importsModule));
+                                                                                        expect (result == m3Err_none)
+        result = m3_LoadModule (runtime, module);                                       expect (result == m3Err_none)
+
+        result = m3_LinkRawFunctions (module, sameName, 0);                             expect (result == m3Err_none)
+                                                                                        expect (CallExport (runtime, "a", 0, 0) == -1)
+        result = m3_LinkRawFunctions (module, sameName, 20);                            expect (result == m3Err_none)
+                                                                                        expect (CallExport (runtime, "a", 0, 0) == 20)
+                                                                                        expect (CallExport (runtime, "othera", 0, 0) == 19)
+                                                                                        expect (CallExport (runtime, "b", 0, 0) == -1)
+        m3_FreeRuntime (runtime);
+
+        // a module that isn't loaded into a runtime can't be linked
+        module = NULL;
+        result = m3_ParseModule (env, & module, c_importsModule, sizeof (c_importsModule));
+                                                                                        expect (result == m3Err_none)
+        result = m3_LinkRawFunctions (module, tables [0], numEntries [0]);             expect (result == m3Err_moduleNotLinked)
+        m3_FreeModule (module);
+    }
+
+
+#   if d_m3CodeCache
+    Test (codecache)
+    {
+        M3Result result;
+
+        char directory [] = "/tmp/m3_test_XXXXXX";
+        expect (mkdtemp (directory))
+
+        IM3Environment cacheEnv = m3_NewEnvironment ();
+        result = m3_SetCodeCacheDirectory (cacheEnv, directory);                        expect (result == m3Err_none)
+
+        char path [1024] = "";
+
+        // cold, warm, then from a damaged file, a truncated one, and none, which the compilation writes again
+        for (u32 i = 0; i < 5; ++i)
+        {
+            IM3Runtime runtime = m3_NewRuntime (cacheEnv, 64 * 1024, NULL);
+            IM3Module module = LoadMemoryModule (runtime, HostImportUserData, (void *) 42);
+                                                                                        expect (module)
+            bool warm = (i == 1);
+            if (module)
+            {
+                                                                                        expect (module->codeFromCache == warm)
+                result = m3_CompileModule (module);                                     expect (result == m3Err_none)
+
+                CallExport (runtime, "store", 16, 1234);                                expect (CallExport (runtime, "load", 16, 0) == 1234)
+                                                                                        expect (CallExport (runtime, "getg", 0, 0) == 7)
+                                                                                        expect (CallExport (runtime, "grow", 1, 0) == 1)
+                                                                                        expect (CallExport (runtime, "host", 0, 0) == 42)
+            }
+
+            m3_FreeRuntime (runtime);
+
+            bool found = FindCacheFile (path, sizeof (path), directory);                expect (found)
+
+            if (found and i == 1)
+            {
+                FILE * file = fopen (path, "r+b");                                      expect (file)
+                if (file)
+                {
+                    fseek (file, -16, SEEK_END);
+                    int byte = fgetc (file);
+                    fseek (file, -1, SEEK_CUR);
+                    fputc (byte ^ 0xff, file);
+                    fclose (file);
+                }
+            }
+            else if (found and i == 2)
+            {
+                expect (truncate (path, 100) == 0)
+            }
+            else if (found and i == 3)
+            {
+                unlink (path);
+            }
+        }
+
+        // a module that differs in a byte gets a file of its own, and doesn't take the other one's
+        u8 otherModule [sizeof (c_memoryModule)];
+        memcpy (otherModule, c_memoryModule, sizeof (otherModule));
+        otherModule [65] = 8;                                                           // the global's initializer: i32.const 8
+
+        for (u32 i = 0; i < 2; ++i)
+        {
+            IM3Runtime runtime = m3_NewRuntime (cacheEnv, 64 * 1024, NULL);
+            IM3Module module = NULL;
+            result = m3_ParseModule (cacheEnv, & module, i ? c_memoryModule : otherModule, sizeof (otherModule));
+                                                                                        expect (result == m3Err_none)
+            result = m3_LoadModule (runtime, module);                                   expect (result == m3Err_none)
+                                                                                        expect (module->codeFromCache == (i == 1))
+            result = m3_LinkRawFunction (module, "env", "host", "i()", HostImportUserData);
+                                                                                        expect (result == m3Err_none)
+            result = m3_CompileModule (module);                                         expect (result == m3Err_none)
+                                                                                        expect (CallExport (runtime, "getg", 0, 0) == (i ? 7 : 8))
+            m3_FreeRuntime (runtime);
+        }
+                                                                                        expect (not FindCacheFile (path, sizeof (path), directory))
+
+        // without a directory, or with one that can't be written, it just compiles
+        cstr_t directories [2] = { NULL, "/nonexistent/m3_test" };
+
+        for (u32 i = 0; i < 2; ++i)
+        {
+            result = m3_SetCodeCacheDirectory (cacheEnv, directories [i]);              expect (result == m3Err_none)
+
+            IM3Runtime runtime = m3_NewRuntime (cacheEnv, 64 * 1024, NULL);
+            IM3Module module = LoadMemoryModule (runtime, HostImportUserData, (void *) 42);
+                                                                                        expect (module)
+            if (module)
+            {
+                                                                                        expect (not module->codeFromCache)
+                result = m3_CompileModule (module);                                     expect (result == m3Err_none)
+                                                                                        expect (CallExport (runtime, "host", 0, 0) == 42)
+            }
+            m3_FreeRuntime (runtime);
+        }
+
+        m3_FreeEnvironment (cacheEnv);
+
+        RemoveCacheFiles (directory);
+    }
+#   endif
+
+    m3_FreeEnvironment (env);
+
+    printf ("\n%d failed\n", s_numFailures);
+
+    return s_numFailures ? 1 : 0;
 }
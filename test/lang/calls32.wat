@@ -0,0 +1,46 @@
+(module
+ (export "calls" (func $calls))
+ (func $mix (param $x i32) (result i32)
+  (set_local $x
+   (i32.xor
+    (get_local $x)
+    (i32.shr_u (get_local $x) (i32.const 16))
+   )
+  )
+  (set_local $x
+   (i32.mul (get_local $x) (i32.const 0x45d9f3b))
+  )
+  (i32.xor
+   (get_local $x)
+   (i32.shr_u (get_local $x) (i32.const 16))
+  )
+ )
+ (func $clamp (param $x i32) (result i32)
+  (if (i32.lt_s (get_local $x) (i32.const 0))
+   (return (i32.const 0))
+  )
+  (if (i32.gt_s (get_local $x) (i32.const 255))
+   (return (i32.const 255))
+  )
+  (get_local $x)
+ )
+ (func $calls (param $n i32) (result i32)
+  (local $acc i32)
+  (local $i i32)
+  (loop $next
+   (set_local $acc
+    (i32.add
+     (call $mix (i32.add (get_local $acc) (get_local $i)))
+     (call $clamp (i32.sub (get_local $i) (i32.const 100)))
+    )
+   )
+   (br_if $next
+    (i32.lt_u
+     (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+     (get_local $n)
+    )
+   )
+  )
+  (get_local $acc)
+ )
+)
@@ -0,0 +1,80 @@
+(module
+  ;; locals that aren't set on every path to a read must still read as zero,
+  ;; even when the stack under them holds whatever the previous call left.
+  ;; main traps if any of them doesn't
+  (func $dirty
+    (local i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64)
+    (local.set 0 (i64.const -1))  (local.set 1 (i64.const -1))
+    (local.set 2 (i64.const -1))  (local.set 3 (i64.const -1))
+    (local.set 4 (i64.const -1))  (local.set 5 (i64.const -1))
+    (local.set 6 (i64.const -1))  (local.set 7 (i64.const -1))
+    (local.set 8 (i64.const -1))  (local.set 9 (i64.const -1))
+    (local.set 10 (i64.const -1)) (local.set 11 (i64.const -1))
+    (local.set 12 (i64.const -1)) (local.set 13 (i64.const -1))
+    (local.set 14 (i64.const -1)) (local.set 15 (i64.const -1)))
+
+  (func $expect0 (param i32)
+    (if (local.get 0) (then unreachable)))
+
+  ;; the set after br is never reached
+  (func $br (result i32) (local $a i32) (local $b i64)
+    (block
+      (local.set $a (i32.const 1))
+      (br 0)
+      (local.set $b (i64.const 1)))
+    (i32.or (i32.sub (local.get $a) (i32.const 1))
+            (i32.wrap_i64 (local.get $b))))
+
+  (func $br_if (param $p i32) (result i32) (local $a i32)
+    (block
+      (br_if 0 (local.get $p))
+      (local.set $a (i32.const 5)))
+    (local.get $a))
+
+  (func $br_table (param $i i32) (result i32) (local $a f64)
+    (block
+      (block
+        (br_table 0 1 (local.get $i)))
+      (local.set $a (f64.const 3)))
+    (i32.trunc_f64_s (local.get $a)))
+
+  ;; either arm sets one of them, so both are read
+  (func $if_else (param $p i32) (result i32) (local $a i32) (local $b i32)
+    (if (local.get $p)
+      (then (local.set $a (i32.const 7)))
+      (else (local.set $b (i32.const 7))))
+    (i32.add (local.get $a) (local.get $b)))
+
+  (func $if (param $p i32) (result i32) (local $a i32)
+    (if (local.get $p)
+      (then (local.set $a (i32.const 9))))
+    (local.get $a))
+
+  ;; $a is read before it's set on the first iteration
+  (func $loop (result i32) (local $a i32) (local $n i32) (local $acc i32)
+    (loop $l
+      (local.set $acc (i32.add (local.get $acc) (local.get $a)))
+      (local.set $a (i32.const 1))
+      (br_if $l (i32.lt_u (local.tee $n (i32.add (local.get $n) (i32.const 1)))
+                          (i32.const 3))))
+    (i32.sub (local.get $acc) (i32.const 2)))
+
+  ;; set at the loop's own level, so it's set after it
+  (func $loop_set (result i32) (local $a i32)
+    (loop (local.set $a (i32.const 4)))
+    (i32.sub (local.get $a) (i32.const 4)))
+
+  (func $main
+    (call $dirty) (call $expect0 (call $br))
+    (call $dirty) (call $expect0 (call $br_if (i32.const 1)))
+    (call $dirty) (call $expect0 (i32.sub (call $br_if (i32.const 0)) (i32.const 5)))
+    (call $dirty) (call $expect0 (call $br_table (i32.const 1)))
+    (call $dirty) (call $expect0 (i32.sub (call $br_table (i32.const 0)) (i32.const 3)))
+    (call $dirty) (call $expect0 (i32.sub (call $if_else (i32.const 1)) (i32.const 7)))
+    (call $dirty) (call $expect0 (i32.sub (call $if_else (i32.const 0)) (i32.const 7)))
+    (call $dirty) (call $expect0 (call $if (i32.const 0)))
+    (call $dirty) (call $expect0 (i32.sub (call $if (i32.const 1)) (i32.const 9)))
+    (call $dirty) (call $expect0 (call $loop))
+    (call $dirty) (call $expect0 (call $loop_set)))
+
+  (export "main" (func $main)))
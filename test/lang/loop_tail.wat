@@ -0,0 +1,15 @@
+(module
+  ;; return_call from inside a loop: the loop mustn't keep a native frame
+  ;; for every call it makes
+  (func $count2 (param $n i32) (param $acc i32) (result i32)
+    (loop $continue
+      (if (i32.eqz (local.get $n))
+        (then (return (local.get $acc))))
+      (return_call $count2 (i32.sub (local.get $n) (i32.const 1))
+                           (i32.add (local.get $acc) (i32.const 1))))
+    (i32.const -1))
+
+  (func $count (param i32) (result i32)
+    (return_call $count2 (local.get 0) (i32.const 0)))
+
+  (export "count" (func $count)))
@@ -0,0 +1,40 @@
+(module
+ (memory 1)
+ (export "rand" (func $rand))
+ (export "memory" (memory 0))
+ ;; grows the memory to $pages (< 65536) pages, then does $n read-modify-writes of pseudo-random words in it
+ (func $rand (param $pages i32) (param $n i32) (result i32)
+  (local $x i32)
+  (local $i i32)
+  (local $acc i32)
+  (local $addr i32)
+  (drop
+   (memory.grow (i32.sub (get_local $pages) (i32.const 1)))
+  )
+  (loop $next
+   (set_local $x
+    (i32.add
+     (i32.mul (get_local $x) (i32.const 1664525))
+     (i32.const 1013904223)
+    )
+   )
+   (set_local $addr
+    (i32.and
+     (i32.rem_u (get_local $x) (i32.shl (get_local $pages) (i32.const 16)))
+     (i32.const -4)
+    )
+   )
+   (set_local $acc
+    (i32.add (get_local $acc) (i32.load (get_local $addr)))
+   )
+   (i32.store (get_local $addr) (get_local $acc))
+   (br_if $next
+    (i32.lt_u
+     (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+     (get_local $n)
+    )
+   )
+  )
+  (get_local $acc)
+ )
+)
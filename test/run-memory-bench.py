@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+
+# Compares the linear memory backings (see M3MemoryBacking in wasm3.h)
+# Usage:
+#   ./run-memory-bench.py
+#   ./run-memory-bench.py --exec ../custom_build/wasm3 --pages 16384 --accesses 20000000
+#
+# hugetlb needs huge pages in the pool, i.e.:
+#   echo 600 | sudo tee /proc/sys/vm/nr_hugepages
+
+import argparse
+import re
+import subprocess
+import time
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--exec", metavar="<interpreter>", default="../build/wasm3")
+parser.add_argument("--pages",    type=int, default=16384)          # 1 GiB
+parser.add_argument("--accesses", type=int, default=20000000)
+parser.add_argument("--repeat",   type=int, default=3)
+parser.add_argument("--backings", default="default,thp,hugetlb,prefault")
+
+args = parser.parse_args()
+
+def run(backing, command):
+    best = None
+    for _ in range(args.repeat):
+        start = time.perf_counter()
+        p = subprocess.run([args.exec, "--memory-backing", backing] + command,
+                           stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        elapsed = time.perf_counter() - start
+        output = p.stdout.decode("utf-8")
+        if p.returncode or "Error" in output:
+            return None, output.strip().splitlines()[-1]
+        best = elapsed if best is None else min(best, elapsed)
+    return best, output
+
+print(f"{'backing':<10} {'random access':>14} {'STREAM':>10} {'Triad MB/s':>11}")
+
+for backing in args.backings.split(","):
+    rand, rand_out = run(backing, ["--func", "rand", "./lang/memrand.wasm", str(args.pages), str(args.accesses)])
+    stream, stream_out = run(backing, ["./wasi/stream/stream.wasm"])
+
+    if rand is None or stream is None:
+        print(f"{backing:<10} {rand_out if rand is None else stream_out}")
+        continue
+
+    triad = re.search(r"Triad:\s+([\d.]+)", stream_out)
+    print(f"{backing:<10} {rand:>13.3f}s {stream:>9.3f}s {triad.group(1) if triad else '?':>11}")
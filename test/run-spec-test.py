@@ -54,6 +54,7 @@ parser.add_argument("--timeout", type=int,             default=30)
 parser.add_argument("--line", metavar="<source line>", type=int)
 parser.add_argument("--all", action="store_true")
 parser.add_argument("--show-logs", action="store_true")
+parser.add_argument("--no-memory-traps", action="store_true", help="skip out of bounds memory access traps (d_m3UseIndexMasking)")
 parser.add_argument("--format", choices=["raw", "hex", "fp"], default="fp")
 parser.add_argument("-v", "--verbose", action="store_true")
 parser.add_argument("-s", "--silent", action="store_true")
@@ -476,6 +477,7 @@ else:
     jsonFiles  = glob.glob(os.path.join(spec_dir, "core", "*.json"))
     jsonFiles += glob.glob(os.path.join(spec_dir, "proposals", "sign-extension-ops", "*.json"))
     jsonFiles += glob.glob(os.path.join(spec_dir, "proposals", "nontrapping-float-to-int-conversions", "*.json"))
+    jsonFiles += glob.glob(os.path.join(spec_dir, "proposals", "tail-call", "*.json"))
 
 jsonFiles = list(map(lambda x: os.path.relpath(x, scriptDir), jsonFiles))
 jsonFiles.sort()
@@ -535,6 +537,11 @@ for fn in jsonFiles:
                 test.expected[0]["value"] = "nan:arithmetic"
             elif test.type == "assert_trap":
                 test.expected_trap = cmd["text"]
+                # not run at all: with index masking, an out of bounds store would write where later asserts read
+                if args.no_memory_traps and test.expected_trap == "out of bounds memory access":
+                    stats.skipped += 1
+                    warning(f"Skipped {test.source} (no memory traps)")
+                    continue
             elif test.type == "assert_exhaustion":
                 test.expected_trap = "stack overflow"
             else: